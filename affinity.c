@@ -0,0 +1,92 @@
+#define _GNU_SOURCE
+#include "affinity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// From <numaif.h>; the raw syscall keeps libnuma out of the build
+#define AFFINITY_MPOL_PREFERRED 1
+#define AFFINITY_MPOL_MF_MOVE (1 << 1)
+
+int affinity_parse_cpus(const char *list, int *cpus, int max) {
+    int n = 0;
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0) return -1;
+        long hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo) return -1;
+            p = end;
+        }
+        for (long cpu = lo; cpu <= hi && n < max; cpu++) cpus[n++] = (int)cpu;
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+int affinity_load_cpus(const char *defaults, int *cpus, int max) {
+    const char *list = getenv(AFFINITY_ENV);
+    if (!list || !*list) list = defaults;
+    if (!list || !*list) return 0;
+    int n = affinity_parse_cpus(list, cpus, max);
+    if (n < 0) fprintf(stderr, "Invalid CPU list \"%s\", threads are not pinned\n", list);
+    return n < 0 ? 0 : n;
+}
+
+int affinity_cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *d = opendir(path);
+    if (!d) return -1;
+    int node = -1;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (strncmp(de->d_name, "node", 4) == 0 && de->d_name[4] >= '0' && de->d_name[4] <= '9') {
+            node = atoi(de->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+int affinity_attr_set_cpu(pthread_attr_t *attr, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+}
+
+int affinity_bind_memory(void *addr, size_t len, int node) {
+#ifdef SYS_mbind
+    if (node < 0 || node >= 64 || !addr || len == 0) return -1;
+    // mbind works on whole pages
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(page - 1);
+    uintptr_t end = ((uintptr_t)addr + len + (uintptr_t)page - 1) & ~(uintptr_t)(page - 1);
+    unsigned long mask = 1ul << node;
+    if (syscall(SYS_mbind, (void*)start, end - start, AFFINITY_MPOL_PREFERRED, &mask,
+                sizeof(mask) * 8, AFFINITY_MPOL_MF_MOVE) != 0) {
+        return -1;
+    }
+    return 0;
+#else
+    (void)addr; (void)len; (void)node;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Привязка потоков ядер к CPU и размещение их памяти на NUMA-узле этого CPU
+
+#ifndef AFFINITY_MAX_CPUS
+#define AFFINITY_MAX_CPUS 1024
+#endif
+#define AFFINITY_ENV "PSEUDO_CORE_CPUS"  // переопределяет CORE_CPUS из config.h
+
+// Список CPU вида "0-3,8,10-11"; возвращает число CPU или -1 при ошибке разбора
+int affinity_parse_cpus(const char *list, int *cpus, int max);
+// Список из AFFINITY_ENV, иначе из defaults; 0 — привязка не задана
+int affinity_load_cpus(const char *defaults, int *cpus, int max);
+// NUMA-узел CPU по sysfs; -1, если неизвестен (нет NUMA)
+int affinity_cpu_node(int cpu);
+// Поток, созданный с этими атрибутами, сразу стартует на cpu
+int affinity_attr_set_cpu(pthread_attr_t *attr, int cpu);
+// Предпочитать узел node для [addr, addr + len) и перенести уже занятые страницы; -1 без mbind
+int affinity_bind_memory(void *addr, size_t len, int node);
+
+#endif // AFFINITY_H
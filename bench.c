@@ -0,0 +1,402 @@
+// Микробенчмарки PseudoCore: кэш, сжатие, кольцо вытесненных страниц, планировщик, запись метрик.
+// Результаты — JSON в stdout (ops/s и перцентили задержки), ход выполнения — в stderr.
+// Запуск: ./pseudo_bench [макс. потоков] [операций на поток], или make bench
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+
+#include "config.h"
+#include "cache.h"
+#include "compress.h"
+#include "ring_cache.h"
+#include "scheduler.h"
+#include "io_backend.h"
+#include "transform.h"
+#include "metrics.h"
+
+#ifndef BENCH_FILE
+#define BENCH_FILE "bench_swap.img"     // временный образ для путей промаха и вытеснения
+#endif
+#ifndef BENCH_FILE_MB
+#define BENCH_FILE_MB 256
+#endif
+#ifndef BENCH_MAX_THREADS
+#define BENCH_MAX_THREADS 8
+#endif
+#ifndef BENCH_OPS
+#define BENCH_OPS 100000                // операций на поток в многопоточных тестах
+#endif
+#ifndef BENCH_COMPRESS_OPS
+#define BENCH_COMPRESS_OPS 2000         // страниц на уровень и тип данных
+#endif
+
+#define BENCH_HIT_FRAMES 4096
+#define BENCH_HIT_SET 2048              // рабочее множество попаданий помещается в кэш
+#define BENCH_MISS_FRAMES 1024
+#define BENCH_EVICT_FRAMES 1024
+#define BENCH_EVICT_SET 8192            // грязное множество в 8 раз больше кэша
+#define BENCH_METRICS_BATCH 64          // записей метрик на один замер: clock_gettime дороже самой записи
+
+typedef struct {
+    uint32_t *samples;          // задержки операций, нс
+    size_t n;
+    unsigned seed;
+    uint64_t start_ns, end_ns;  // своё окно потока: главный поток может проснуться позже
+} bench_thread_t;
+
+typedef void (*bench_fn_t)(int tid, void *arg, bench_thread_t *t, size_t ops);
+
+typedef struct {
+    bench_fn_t fn;
+    void *arg;
+    size_t ops;
+    int tid;
+    bench_thread_t *t;
+    pthread_barrier_t *start;
+} bench_worker_t;
+
+static int first_result = 1;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned xorshift(unsigned *s) {
+    unsigned x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *s = x;
+}
+
+static void record(bench_thread_t *t, uint64_t ns) {
+    t->samples[t->n++] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// One JSON object per result; extra is a preformatted list of fields or ""
+static void emit(const char *name, int threads, const char *extra, uint32_t *samples, size_t n, uint64_t wall_ns) {
+    qsort(samples, n, sizeof(*samples), cmp_u32);
+    double ops_per_sec = wall_ns > 0 ? (double)n * 1e9 / (double)wall_ns : 0.0;
+    uint32_t p50 = n ? samples[n / 2] : 0;
+    uint32_t p90 = n ? samples[n * 90 / 100] : 0;
+    uint32_t p99 = n ? samples[n * 99 / 100] : 0;
+    uint32_t max = n ? samples[n - 1] : 0;
+    printf("%s\n    {\"name\": \"%s\", \"threads\": %d%s%s, \"ops\": %zu, \"ops_per_sec\": %.0f, "
+           "\"p50_ns\": %u, \"p90_ns\": %u, \"p99_ns\": %u, \"max_ns\": %u}",
+           first_result ? "" : ",", name, threads, extra[0] ? ", " : "", extra, n, ops_per_sec, p50, p90, p99, max);
+    first_result = 0;
+    fflush(stdout);
+    fprintf(stderr, "%-28s %-28s threads %2d: %10.0f ops/s, p50 %6u ns, p99 %7u ns\n",
+            name, extra, threads, ops_per_sec, p50, p99);
+}
+
+static void *worker_run(void *v) {
+    bench_worker_t *w = v;
+    pthread_barrier_wait(w->start);
+    w->t->start_ns = now_ns();
+    w->fn(w->tid, w->arg, w->t, w->ops);
+    w->t->end_ns = now_ns();
+    return NULL;
+}
+
+// Run fn on nthreads threads started together; emits one result for the merged samples
+static void run_threads(const char *name, const char *extra, int nthreads, size_t ops, bench_fn_t fn, void *arg) {
+    pthread_t th[BENCH_MAX_THREADS];
+    bench_worker_t w[BENCH_MAX_THREADS];
+    bench_thread_t t[BENCH_MAX_THREADS];
+    pthread_barrier_t start;
+    uint32_t *all = malloc((size_t)nthreads * ops * sizeof(uint32_t));
+    if (!all) return;
+    pthread_barrier_init(&start, NULL, (unsigned)nthreads + 1);
+    for (int i = 0; i < nthreads; i++) {
+        t[i] = (bench_thread_t){ .samples = all + (size_t)i * ops, .n = 0, .seed = 2463534242u + (unsigned)i * 7919u };
+        w[i] = (bench_worker_t){ .fn = fn, .arg = arg, .ops = ops, .tid = i, .t = &t[i], .start = &start };
+        pthread_create(&th[i], NULL, worker_run, &w[i]);
+    }
+    pthread_barrier_wait(&start);
+    for (int i = 0; i < nthreads; i++) pthread_join(th[i], NULL);
+    // Wall time from the first thread starting to the last one finishing
+    uint64_t first = UINT64_MAX, last = 0;
+    for (int i = 0; i < nthreads; i++) {
+        if (t[i].start_ns < first) first = t[i].start_ns;
+        if (t[i].end_ns > last) last = t[i].end_ns;
+    }
+    uint64_t wall = last - first;
+    size_t n = 0;
+    for (int i = 0; i < nthreads; i++) {
+        memmove(all + n, t[i].samples, t[i].n * sizeof(uint32_t));
+        n += t[i].n;
+    }
+    emit(name, nthreads, extra, all, n, wall);
+    pthread_barrier_destroy(&start);
+    free(all);
+}
+
+typedef struct {
+    cache_t *cache;
+    int fd;
+    uint64_t set;               // страниц в рабочем множестве
+    int write;
+} cache_arg_t;
+
+static void bench_cache_get(int tid, void *v, bench_thread_t *t, size_t ops) {
+    cache_arg_t *a = v;
+    (void)tid;
+    for (size_t i = 0; i < ops; i++) {
+        uint64_t off = (uint64_t)(xorshift(&t->seed) % a->set) * PAGE_SIZE;
+        uint64_t t0 = now_ns();
+        char *page = cache_get(a->cache, a->fd, off, a->write);
+        if (page && a->write) page[0]++;
+        record(t, now_ns() - t0);
+    }
+}
+
+static void bench_cache(int fd, int max_threads, size_t ops) {
+    cache_t c;
+    // Hits: the working set is loaded once and stays resident
+    if (cache_init_frames(&c, CACHE_POLICY_2Q, BENCH_HIT_FRAMES) == 0) {
+        c.ring_victims = 0;
+        for (uint64_t p = 0; p < BENCH_HIT_SET; p++) cache_get(&c, fd, p * PAGE_SIZE, 0);
+        cache_arg_t a = { &c, fd, BENCH_HIT_SET, 0 };
+        for (int n = 1; n <= max_threads; n *= 2) run_threads("cache_get_hit", "", n, ops, bench_cache_get, &a);
+        cache_destroy(&c, fd);
+    }
+    // Misses: uniform over the whole file, almost every access reads the backing store
+    if (cache_init_frames(&c, CACHE_POLICY_2Q, BENCH_MISS_FRAMES) == 0) {
+        c.ring_victims = 0;
+        cache_arg_t a = { &c, fd, (uint64_t)BENCH_FILE_MB * 1024 * 1024 / PAGE_SIZE, 0 };
+        for (int n = 1; n <= max_threads; n *= 2) run_threads("cache_get_miss", "", n, ops / 4, bench_cache_get, &a);
+        cache_destroy(&c, fd);
+    }
+    // Dirty eviction without a flusher: each miss writes back the victim synchronously
+    if (cache_init_frames(&c, CACHE_POLICY_2Q, BENCH_EVICT_FRAMES) == 0) {
+        c.ring_victims = 0;
+        cache_arg_t a = { &c, fd, BENCH_EVICT_SET, 1 };
+        for (int n = 1; n <= max_threads; n *= 2) run_threads("cache_evict_dirty", "", n, ops / 4, bench_cache_get, &a);
+        cache_destroy(&c, fd);
+    }
+}
+
+// Test pages: all zeros, English-like text, random bytes, pages of the real image
+enum { DATA_ZERO, DATA_TEXT, DATA_RANDOM, DATA_REAL, DATA_TYPES };
+static const char *const data_names[DATA_TYPES] = { "zero", "text", "random", "real" };
+
+#define BENCH_PAGES 64
+
+static int fill_pages(int type, char *pages, int real_fd) {
+    static const char *const words[] = { "the ", "cache ", "page ", "of ", "core ", "segment ", "and ",
+                                         "block ", "data ", "is ", "written ", "to ", "log ", "\n" };
+    unsigned seed = 88172645u;
+    for (int p = 0; p < BENCH_PAGES; p++) {
+        char *page = pages + (size_t)p * PAGE_SIZE;
+        switch (type) {
+        case DATA_ZERO:
+            memset(page, 0, PAGE_SIZE);
+            break;
+        case DATA_TEXT:
+            for (size_t i = 0; i < PAGE_SIZE; ) {
+                const char *w = words[xorshift(&seed) % (sizeof(words) / sizeof(words[0]))];
+                size_t len = strlen(w);
+                if (len > PAGE_SIZE - i) len = PAGE_SIZE - i;
+                memcpy(page + i, w, len);
+                i += len;
+            }
+            break;
+        case DATA_RANDOM:
+            for (size_t i = 0; i < PAGE_SIZE; i += 4) {
+                unsigned r = xorshift(&seed);
+                memcpy(page + i, &r, 4);
+            }
+            break;
+        case DATA_REAL:
+            if (real_fd < 0) return -1;
+            if (pread(real_fd, page, PAGE_SIZE, (off_t)p * 1024 * 1024) != PAGE_SIZE) return -1;
+            break;
+        }
+    }
+    return 0;
+}
+
+static void bench_compress(int real_fd, size_t ops) {
+    char *pages = malloc((size_t)BENCH_PAGES * PAGE_SIZE);
+    char *out = malloc((size_t)BENCH_PAGES * 2 * PAGE_SIZE);
+    int *clen = malloc(BENCH_PAGES * sizeof(int));
+    uint32_t *samples = malloc(ops * sizeof(uint32_t));
+    char page[PAGE_SIZE];
+    if (!pages || !out || !clen || !samples) goto out;
+    for (int type = 0; type < DATA_TYPES; type++) {
+        if (fill_pages(type, pages, real_fd) != 0) {
+            fprintf(stderr, "No %s pages (image %s missing or short), skipped\n", data_names[type], SWAP_IMG_PATH);
+            continue;
+        }
+        for (int lvl = COMPRESSION_MIN_LVL; lvl <= COMPRESSION_MAX_LVL; lvl++) {
+            uint64_t in_bytes = 0, out_bytes = 0;
+            uint64_t t0 = now_ns();
+            for (size_t i = 0; i < ops; i++) {
+                int p = (int)(i % BENCH_PAGES);
+                uint64_t s = now_ns();
+                int cs = compress_page(pages + (size_t)p * PAGE_SIZE, PAGE_SIZE, out + (size_t)p * 2 * PAGE_SIZE, lvl);
+                samples[i] = (uint32_t)(now_ns() - s);
+                clen[p] = cs;
+                in_bytes += PAGE_SIZE;
+                out_bytes += cs > 0 ? (uint64_t)cs : PAGE_SIZE;
+            }
+            uint64_t wall = now_ns() - t0;
+            char extra[128];
+            snprintf(extra, sizeof(extra), "\"data\": \"%s\", \"level\": %d, \"ratio\": %.2f",
+                     data_names[type], lvl, out_bytes ? (double)in_bytes / out_bytes : 0.0);
+            emit("compress_page", 1, extra, samples, ops, wall);
+
+            size_t n = 0;
+            t0 = now_ns();
+            for (size_t i = 0; i < ops; i++) {
+                int p = (int)(i % BENCH_PAGES);
+                if (clen[p] <= 0) continue;
+                uint64_t s = now_ns();
+                decompress_page(out + (size_t)p * 2 * PAGE_SIZE, (size_t)clen[p], page, PAGE_SIZE);
+                samples[n++] = (uint32_t)(now_ns() - s);
+            }
+            wall = now_ns() - t0;
+            snprintf(extra, sizeof(extra), "\"data\": \"%s\", \"level\": %d", data_names[type], lvl);
+            emit("decompress_page", 1, extra, samples, n, wall);
+        }
+    }
+out:
+    free(pages);
+    free(out);
+    free(clen);
+    free(samples);
+}
+
+// Ring: every thread inserts and looks up its own offsets (text pages, so they are stored)
+static char ring_page[PAGE_SIZE];
+
+static void bench_ring_op(int tid, void *v, bench_thread_t *t, size_t ops) {
+    (void)v;
+    char out[PAGE_SIZE];
+    uint64_t base = (uint64_t)tid << 32;
+    for (size_t i = 0; i < ops; i++) {
+        uint64_t off = (base + (xorshift(&t->seed) % 65536)) * PAGE_SIZE;
+        uint64_t t0 = now_ns();
+        if (i & 1) {
+            ring_cache_lookup(off, out);
+        } else {
+            cache_to_ring(off, ring_page);
+        }
+        record(t, now_ns() - t0);
+    }
+}
+
+static void bench_ring(int max_threads, size_t ops) {
+    char pages[BENCH_PAGES * PAGE_SIZE];
+    fill_pages(DATA_TEXT, pages, -1);
+    memcpy(ring_page, pages, PAGE_SIZE);
+    for (int n = 1; n <= max_threads; n *= 2) run_threads("ring_insert_lookup", "", n, ops, bench_ring_op, NULL);
+}
+
+static void bench_sched_report(int tid, void *v, bench_thread_t *t, size_t ops) {
+    (void)v;
+    for (size_t i = 0; i < ops; i++) {
+        // Mostly a hot subset, as in the core loop, with a cold tail
+        uint64_t r = xorshift(&t->seed);
+        uint64_t block = (r & 3) ? r % 4096 : r % (1u << 20);
+        uint64_t t0 = now_ns();
+        scheduler_report_access(tid % sched_cores, block * BLOCK_SIZE);
+        record(t, now_ns() - t0);
+    }
+}
+
+// The core loop's take: own deque refilled a batch at a time, popped from the bottom, stolen when empty
+static void bench_sched_migrate(int tid, void *v, bench_thread_t *t, size_t ops) {
+    (void)v;
+    int core = tid % sched_cores;
+    for (size_t i = 0; i < ops; i++) {
+        uint64_t task;
+        if (i % (2 * SCHED_REFILL) == 0) {
+            for (int k = 0; k < SCHED_REFILL; k++) scheduler_push_task(core, (i + (size_t)k) * BLOCK_SIZE);
+        }
+        uint64_t t0 = now_ns();
+        if (!scheduler_pop_task(core, &task) && scheduler_should_migrate(core)) scheduler_get_migrated_task(core, &task);
+        record(t, now_ns() - t0);
+    }
+}
+
+static void bench_scheduler(int max_threads, size_t ops) {
+    for (int n = 1; n <= max_threads; n *= 2) run_threads("scheduler_report_access", "", n, ops, bench_sched_report, NULL);
+    for (int n = 1; n <= max_threads; n *= 2) run_threads("scheduler_migrate", "", n, ops, bench_sched_migrate, NULL);
+}
+
+// Cost of one latency sample (timestamp, bucket, counters), the overhead every instrumented call pays
+static void bench_metrics_op(int tid, void *v, bench_thread_t *t, size_t ops) {
+    (void)tid;
+    (void)v;
+    for (size_t i = 0; i < ops; i += BENCH_METRICS_BATCH) {
+        uint64_t t0 = now_ns();
+        size_t k, batch = ops - i < BENCH_METRICS_BATCH ? ops - i : BENCH_METRICS_BATCH;
+        for (k = 0; k < batch; k++) metrics_record(METRIC_CACHE_HIT, metrics_now());
+        // Each call of the batch gets its average, so ops and ops/s count calls
+        uint64_t avg = (now_ns() - t0) / batch;
+        for (k = 0; k < batch; k++) record(t, avg);
+    }
+}
+
+static void bench_metrics(int max_threads, size_t ops) {
+    for (int n = 1; n <= max_threads; n *= 2) run_threads("metrics_record", "", n, ops, bench_metrics_op, NULL);
+}
+
+int main(int argc, char **argv) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 0;
+    size_t ops = argc > 2 ? (size_t)strtoull(argv[2], NULL, 10) : BENCH_OPS;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads <= 0) max_threads = cpus > 0 ? (int)cpus : 1;
+    if (max_threads > BENCH_MAX_THREADS) max_threads = BENCH_MAX_THREADS;
+    if (ops == 0) ops = BENCH_OPS;
+
+    int fd = open(BENCH_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)BENCH_FILE_MB * 1024 * 1024) != 0) {
+        fprintf(stderr, "Cannot create %s: %s\n", BENCH_FILE, strerror(errno));
+        return 1;
+    }
+    int real_fd = open(SWAP_IMG_PATH, O_RDONLY);
+
+    metrics_init(""); // In-process histograms: the instrumented paths pay their real cost
+    io_backend_init(IO_BACKEND_DEFAULT);
+    transform_init();
+    ring_cache_init(0);
+    // One scheduler core per benchmark thread
+    if (scheduler_init(max_threads, 0) != 0) {
+        fprintf(stderr, "Cannot allocate scheduler tables\n");
+        return 1;
+    }
+
+    printf("{\n  \"version\": 1,\n  \"cpus\": %ld,\n  \"max_threads\": %d,\n  \"ops_per_thread\": %zu,\n"
+           "  \"io_backend\": \"%s\",\n  \"isa\": \"%s\",\n  \"results\": [",
+           cpus, max_threads, ops, io_backend_name(), transform_isa_name(transform_isa()));
+    bench_cache(fd, max_threads, ops);
+    bench_compress(real_fd, BENCH_COMPRESS_OPS);
+    bench_ring(max_threads, ops);
+    bench_scheduler(max_threads, ops);
+    bench_metrics(max_threads, ops);
+    printf("\n  ]\n}\n");
+
+    scheduler_destroy();
+    ring_cache_destroy();
+    metrics_destroy();
+    if (real_fd >= 0) close(real_fd);
+    close(fd);
+    unlink(BENCH_FILE);
+    return 0;
+}
@@ -4,6 +4,9 @@
 // Пожалуйста, обновите includePath, выбрав команду "C/C++: Select IntelliSense Configuration..." 
 // или добавив необходимые пути в настройки c_cpp_properties.json.
 #include "cache.h"
+#include "io_backend.h"
+#include "ring_cache.h"
+#include "metrics.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <sys/types.h>
@@ -11,14 +14,16 @@
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include <sys/uio.h>
 
-// Cache statistics for monitoring performance
-static size_t cache_hits = 0;
-static size_t cache_misses = 0;
-static pthread_mutex_t stats_mutex;
+// Per-thread statistics slot, assigned round-robin on first use
+static atomic_uint stats_slot_seq;
+static _Thread_local int stats_slot = -1;
 
 // Improved hash function using FNV-1a to reduce collisions
-static size_t hash_func(uint64_t off) {
+static size_t hash_func(const cache_t *c, uint64_t off) {
     const uint64_t FNV_PRIME = 1099511628211ULL;
     const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
     uint64_t hash = FNV_OFFSET_BASIS;
@@ -27,12 +32,12 @@ static size_t hash_func(uint64_t off) {
         hash ^= bytes[i];
         hash *= FNV_PRIME;
     }
-    return (hash / PAGE_SIZE) % HASH_SIZE;
+    return (hash / PAGE_SIZE) & c->hash_mask;
 }
 
 // Calculate mutex group for a hash index
-static size_t mutex_group(size_t h) {
-    return h % MUTEX_GROUPS;
+static size_t mutex_group(const cache_t *c, size_t h) {
+    return h & c->stripe_mask;
 }
 
 // Log cache-related errors or information
@@ -44,99 +49,809 @@ static void log_cache_message(const char *level, const char *message) {
     fprintf(stderr, "[%s] [%s] Cache: %s\n", timestamp, level, message);
 }
 
-// Display cache statistics for monitoring
-static void display_cache_stats(void) {
-    pthread_mutex_lock(&stats_mutex);
-    size_t total_requests = cache_hits + cache_misses;
-    double hit_ratio = total_requests > 0 ? (double)cache_hits / total_requests * 100.0 : 0.0;
-    fprintf(stderr, "[CACHE STATS] Hits: %zu, Misses: %zu, Hit Ratio: %.2f%%\n", 
-            cache_hits, cache_misses, hit_ratio);
-    pthread_mutex_unlock(&stats_mutex);
+// Absolute CLOCK_MONOTONIC time ms from now, for timed waits on the flusher conditions
+static void deadline_after_ms(struct timespec *ts, long ms) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    ts->tv_sec += ts->tv_nsec / 1000000000L;
+    ts->tv_nsec %= 1000000000L;
 }
 
-void cache_init(cache_t *c) {
-    for (int i = 0; i < HASH_SIZE; i++) {
-        c->hash[i] = NULL;
+// A failing store fails every retry the same way: one message per CACHE_ERROR_LOG_MS, the rest counted
+static void log_write_error(cache_t *c, const char *level, const char *message) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000 + 1; // 0 = never logged
+    uint64_t last = atomic_load_explicit(&c->error_logged_ms, memory_order_relaxed);
+    if ((last && now - last < CACHE_ERROR_LOG_MS) ||
+        !atomic_compare_exchange_strong_explicit(&c->error_logged_ms, &last, now,
+                                                 memory_order_relaxed, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&c->errors_suppressed, 1, memory_order_relaxed);
+        return;
     }
-    for (int i = 0; i < MUTEX_GROUPS; i++) {
-        pthread_mutex_init(&c->mutex[i], NULL);
+    unsigned skipped = atomic_exchange_explicit(&c->errors_suppressed, 0, memory_order_relaxed);
+    if (skipped == 0) {
+        log_cache_message(level, message);
+        return;
     }
-    c->lru_head = NULL;
-    c->lru_tail = NULL;
-    c->entry_count = 0;
-    pthread_mutex_init(&c->lru_mutex, NULL);
-    pthread_mutex_init(&stats_mutex, NULL);
-    log_cache_message("INFO", "Cache initialized");
+    char msg[384];
+    snprintf(msg, sizeof(msg), "%s (%u similar errors since the last message)", message, skipped);
+    log_cache_message(level, msg);
 }
 
-char* cache_get(cache_t *c, int fd, uint64_t off, int write) {
-    size_t h = hash_func(off);
-    size_t mg = mutex_group(h);
-    pthread_mutex_lock(&c->mutex[mg]);
-    cache_entry_t *e = c->hash[h];
-    while (e) {
-        if (e->offset == off) {
-            if (write) e->dirty = 1;
-            e->last_access = time(NULL);
-            pthread_mutex_lock(&c->lru_mutex);
-            // Move to the front of LRU list (recently used)
-            if (e != c->lru_head) {
-                if (e->prev) e->prev->next = e->next;
-                if (e->next) e->next->prev = e->prev;
-                if (e == c->lru_tail) c->lru_tail = e->prev;
-                e->next = c->lru_head;
-                e->prev = NULL;
-                if (c->lru_head) c->lru_head->prev = e;
-                c->lru_head = e;
-                if (!c->lru_tail) c->lru_tail = e;
+// Counter shard of the calling thread; shared only when threads outnumber the shards
+static cache_stats_shard_t *stats_shard(cache_t *c) {
+    if (stats_slot < 0) {
+        stats_slot = (int)(atomic_fetch_add_explicit(&stats_slot_seq, 1, memory_order_relaxed) % CACHE_STATS_SHARDS);
+    }
+    return &c->stats[stats_slot];
+}
+
+#define STAT_INC(c, field) \
+    atomic_fetch_add_explicit(&stats_shard(c)->field, 1, memory_order_relaxed)
+
+// Return a frame index to the lock-free free list (Treiber stack with ABA tag)
+static void frame_push(cache_t *c, uint32_t idx) {
+    uint64_t old = atomic_load_explicit(&c->free_head, memory_order_relaxed);
+    uint64_t new_head;
+    do {
+        atomic_store_explicit(&c->free_next[idx], (uint32_t)(old & 0xffffffffu), memory_order_relaxed);
+        new_head = (((old >> 32) + 1) << 32) | (uint64_t)(idx + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&c->free_head, &old, new_head,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+// Take a free frame index; returns -1 when the arena is exhausted
+static int frame_pop(cache_t *c, uint32_t *idx) {
+    uint64_t old = atomic_load_explicit(&c->free_head, memory_order_acquire);
+    for (;;) {
+        uint32_t top = (uint32_t)(old & 0xffffffffu);
+        if (top == 0) return -1;
+        uint32_t next = atomic_load_explicit(&c->free_next[top - 1], memory_order_relaxed);
+        uint64_t new_head = (((old >> 32) + 1) << 32) | next;
+        if (atomic_compare_exchange_weak_explicit(&c->free_head, &old, new_head,
+                                                  memory_order_acquire, memory_order_acquire)) {
+            *idx = top - 1;
+            return 0;
+        }
+    }
+}
+
+// Begin a write section on a stripe (caller holds stripe->mutex)
+static void stripe_write_begin(cache_stripe_t *s) {
+    atomic_store_explicit(&s->seq, atomic_load_explicit(&s->seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void stripe_write_end(cache_stripe_t *s) {
+    atomic_store_explicit(&s->seq, atomic_load_explicit(&s->seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+// Walk a bucket chain; caller holds the stripe mutex or validates with the seqlock
+static uint32_t chain_find(cache_t *c, size_t h, uint64_t off) {
+    uint32_t i = atomic_load_explicit(&c->hash[h], memory_order_acquire);
+    size_t steps = 0;
+    while (i != CACHE_NIL && steps++ < c->capacity) {
+        if (atomic_load_explicit(&c->entries[i].offset, memory_order_relaxed) == off) return i;
+        i = atomic_load_explicit(&c->entries[i].hnext, memory_order_acquire);
+    }
+    return CACHE_NIL;
+}
+
+// Lock-free lookup: seqlock read of the bucket chain, retried while a writer is active
+static uint32_t index_lookup(cache_t *c, size_t h, uint64_t off) {
+    cache_stripe_t *s = &c->stripe[mutex_group(c, h)];
+    for (;;) {
+        unsigned seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq & 1) continue;
+        uint32_t i = chain_find(c, h, off);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) == seq) return i;
+    }
+}
+
+// Unlink a frame from its bucket chain (caller holds the stripe mutex)
+static void chain_unlink(cache_t *c, size_t h, uint32_t idx) {
+    cache_stripe_t *s = &c->stripe[mutex_group(c, h)];
+    stripe_write_begin(s);
+    uint32_t i = atomic_load_explicit(&c->hash[h], memory_order_relaxed);
+    uint32_t next = atomic_load_explicit(&c->entries[idx].hnext, memory_order_relaxed);
+    if (i == idx) {
+        atomic_store_explicit(&c->hash[h], next, memory_order_relaxed);
+    } else {
+        while (i != CACHE_NIL) {
+            uint32_t n = atomic_load_explicit(&c->entries[i].hnext, memory_order_relaxed);
+            if (n == idx) {
+                atomic_store_explicit(&c->entries[i].hnext, next, memory_order_relaxed);
+                break;
             }
-            pthread_mutex_unlock(&c->lru_mutex);
-            pthread_mutex_unlock(&c->mutex[mg]);
-            // Increment cache hit counter
-            pthread_mutex_lock(&stats_mutex);
-            cache_hits++;
-            pthread_mutex_unlock(&stats_mutex);
-            // Periodically display stats (every 100 hits for simplicity)
-            if (cache_hits % 100 == 0) {
-                display_cache_stats();
+            i = n;
+        }
+    }
+    stripe_write_end(s);
+}
+
+// Pin a frame found without locks; fails if it is being loaded, evicted or reused
+static int entry_try_pin(cache_entry_t *e, uint64_t off) {
+    atomic_fetch_add(&e->pins, 1);
+    if (atomic_load(&e->state) == CACHE_FRAME_RESIDENT &&
+        atomic_load_explicit(&e->offset, memory_order_relaxed) == off) {
+        return 1;
+    }
+    atomic_fetch_sub_explicit(&e->pins, 1, memory_order_release);
+    return 0;
+}
+
+static void entry_unpin(cache_entry_t *e) {
+    atomic_fetch_sub_explicit(&e->pins, 1, memory_order_release);
+}
+
+// Content access of a pinned frame: copies out of it share it, an in-place change holds it alone
+static int entry_try_read(cache_entry_t *e) {
+    int a = atomic_load_explicit(&e->access, memory_order_relaxed);
+    while (a >= 0) {
+        if (atomic_compare_exchange_weak_explicit(&e->access, &a, a + 1,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void entry_read_end(cache_entry_t *e) {
+    atomic_fetch_sub_explicit(&e->access, 1, memory_order_release);
+}
+
+// Waits out readers and other writers; they hold the frame for one copy, a write or a pipeline pass
+static void entry_write_lock(cache_entry_t *e) {
+    for (;;) {
+        int a = 0;
+        if (atomic_compare_exchange_weak_explicit(&e->access, &a, -1,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            return;
+        }
+        sched_yield();
+    }
+}
+
+static void entry_write_unlock(cache_entry_t *e) {
+    atomic_store_explicit(&e->access, 0, memory_order_release);
+}
+
+// Pin a dirty frame for write-back: skipped while it is being changed in place
+static int entry_try_pin_clean(cache_entry_t *e, uint64_t off) {
+    if (!entry_try_pin(e, off)) return 0;
+    if (entry_try_read(e)) return 1;
+    entry_unpin(e);
+    return 0;
+}
+
+static void entry_unpin_clean(cache_entry_t *e) {
+    entry_read_end(e);
+    entry_unpin(e);
+}
+
+// Wake the flusher once per high-watermark crossing; cheap when it is already awake
+static void flusher_kick(cache_t *c) {
+    if (!atomic_load_explicit(&c->flusher_running, memory_order_relaxed)) return;
+    if (atomic_exchange_explicit(&c->flush_kicked, 1, memory_order_relaxed)) return;
+    pthread_mutex_lock(&c->flush_mutex);
+    pthread_cond_signal(&c->flush_wake);
+    pthread_mutex_unlock(&c->flush_mutex);
+}
+
+// Dirty transitions keep dirty_count in step; caller holds a pin or owns the frame
+static void mark_dirty(cache_t *c, cache_entry_t *e) {
+    if (atomic_load_explicit(&e->dirty, memory_order_relaxed)) return;
+    if (atomic_exchange(&e->dirty, 1) == 0 &&
+        atomic_fetch_add_explicit(&c->dirty_count, 1, memory_order_relaxed) + 1 >= c->dirty_high) {
+        flusher_kick(c);
+    }
+}
+
+static int clear_dirty(cache_t *c, cache_entry_t *e) {
+    if (atomic_exchange(&e->dirty, 0) == 0) return 0;
+    atomic_fetch_sub_explicit(&c->dirty_count, 1, memory_order_relaxed);
+    return 1;
+}
+
+// Page I/O against the backing store: the extent log when attached, the image fd otherwise
+static ssize_t backing_read(cache_t *c, int fd, char *data, uint64_t off) {
+    if (c->store) return extent_read(c->store, off, data);
+    return io_pread(fd, data, PAGE_SIZE, off);
+}
+
+static ssize_t backing_write(cache_t *c, int fd, const char *data, uint64_t off) {
+    if (c->store) return extent_write(c->store, off, data, 0) < 0 ? -1 : PAGE_SIZE;
+    return io_pwrite(fd, data, PAGE_SIZE, off);
+}
+
+// Write a dirty page back to disk; no cache locks are held by the caller
+static void write_back(cache_t *c, cache_entry_t *e, int fd, const char *when) {
+    uint64_t off = atomic_load_explicit(&e->offset, memory_order_relaxed);
+    clear_dirty(c, e); // Reset dirty flag before the write attempt
+    ssize_t write_result = backing_write(c, fd, e->data, off);
+    if (write_result < 0) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Failed to write dirty page at offset %lu%s (errno: %d)", off, when, errno);
+        log_write_error(c, "ERROR", msg);
+        STAT_INC(c, write_errors);
+    } else if (write_result != PAGE_SIZE) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Partial write%s at offset %lu (wrote %zd bytes instead of %d)", when, off, write_result, PAGE_SIZE);
+        log_write_error(c, "WARNING", msg);
+        STAT_INC(c, write_errors);
+    } else {
+        STAT_INC(c, writebacks);
+    }
+}
+
+// Try to evict frame i; on success the frame is unindexed and back on the free list
+static int evict_frame(cache_t *c, int fd, size_t i) {
+    cache_entry_t *e = &c->entries[i];
+    if (atomic_load_explicit(&e->state, memory_order_relaxed) != CACHE_FRAME_RESIDENT) return -1;
+    if (atomic_load_explicit(&e->pins, memory_order_relaxed) != 0) return -1;
+    uint64_t off = atomic_load_explicit(&e->offset, memory_order_relaxed);
+    size_t h = hash_func(c, off);
+    cache_stripe_t *s = &c->stripe[mutex_group(c, h)];
+    pthread_mutex_lock(&s->mutex);
+    int expected = CACHE_FRAME_RESIDENT;
+    if (atomic_load_explicit(&e->offset, memory_order_relaxed) != off ||
+        !atomic_compare_exchange_strong(&e->state, &expected, CACHE_FRAME_EVICTING)) {
+        pthread_mutex_unlock(&s->mutex);
+        return -1;
+    }
+    // Re-check pins after claiming the frame: a concurrent pin either sees EVICTING or is seen here
+    if (atomic_load(&e->pins) != 0) {
+        atomic_store(&e->state, CACHE_FRAME_RESIDENT);
+        pthread_mutex_unlock(&s->mutex);
+        return -1;
+    }
+    int dirty = atomic_load(&e->dirty);
+    if (dirty && atomic_load_explicit(&c->flusher_running, memory_order_relaxed)) {
+        // With a flusher, eviction only takes clean pages; write-back is its job
+        atomic_store(&e->state, CACHE_FRAME_RESIDENT);
+        pthread_mutex_unlock(&s->mutex);
+        flusher_kick(c);
+        return -1;
+    }
+    // Keep the frame indexed (as EVICTING) until the data is on disk and in the victim ring,
+    // so misses wait for it; an untouched readahead page is not worth a ring slot
+    int victim = c->ring_victims && !atomic_load_explicit(&e->prefetched, memory_order_relaxed);
+    if (dirty || victim) {
+        pthread_mutex_unlock(&s->mutex);
+        if (dirty) write_back(c, e, fd, "");
+        if (victim) cache_to_ring(off, e->data);
+        pthread_mutex_lock(&s->mutex);
+    }
+    chain_unlink(c, h, (uint32_t)i);
+    atomic_store(&e->state, CACHE_FRAME_FREE);
+    pthread_mutex_unlock(&s->mutex);
+    atomic_fetch_sub_explicit(&c->entry_count, 1, memory_order_relaxed);
+    frame_push(c, (uint32_t)i);
+    STAT_INC(c, evictions);
+    if (atomic_exchange_explicit(&e->prefetched, 0, memory_order_relaxed)) {
+        STAT_INC(c, prefetch_wasted); // Read ahead but never used
+    }
+    return 0;
+}
+
+// CLOCK sweep: evict one unpinned page whose reference bit is clear
+static int clock_evict(cache_t *c, int fd) {
+    for (size_t n = 0; n < 2 * c->capacity; n++) {
+        size_t i = atomic_fetch_add_explicit(&c->clock_hand, 1, memory_order_relaxed) % c->capacity;
+        cache_entry_t *e = &c->entries[i];
+        // Under 2Q the hand only covers Am; A1in pages leave through their FIFO
+        if (c->policy == CACHE_POLICY_2Q &&
+            atomic_load_explicit(&e->queue, memory_order_relaxed) == CACHE_Q_IN) continue;
+        if (atomic_load_explicit(&e->state, memory_order_relaxed) != CACHE_FRAME_RESIDENT) continue;
+        if (atomic_load_explicit(&e->pins, memory_order_relaxed) != 0) continue;
+        if (atomic_load_explicit(&e->dirty, memory_order_relaxed) &&
+            atomic_load_explicit(&c->flusher_running, memory_order_relaxed)) continue;
+        if (atomic_load_explicit(&c->ref[i], memory_order_relaxed)) {
+            atomic_store_explicit(&c->ref[i], 0, memory_order_relaxed); // Second chance
+            continue;
+        }
+        if (evict_frame(c, fd, i) == 0) return 0;
+    }
+    return -1;
+}
+
+// Ghost (A1out) bucket for an offset; the ring and its chains are guarded by policy_mutex
+static size_t ghost_hash(const cache_t *c, uint64_t off) {
+    return (size_t)(((off / PAGE_SIZE) * 11400714819323198485ULL) >> 32) & c->ghost_mask;
+}
+
+static void ghost_unlink(cache_t *c, uint32_t slot) {
+    if (c->ghost[slot] == UINT64_MAX) return; // Already taken out by a ghost hit
+    uint32_t *link = &c->ghost_bucket[ghost_hash(c, c->ghost[slot])];
+    while (*link != CACHE_NIL && *link != slot) link = &c->ghost_next[*link];
+    if (*link == slot) *link = c->ghost_next[slot];
+    c->ghost[slot] = UINT64_MAX;
+}
+
+// Remember an offset evicted from A1in, dropping the oldest ghost when the ring is full
+static void ghost_add(cache_t *c, uint64_t off) {
+    if (c->ghost_count == c->ghost_max) {
+        ghost_unlink(c, (uint32_t)c->ghost_head);
+        c->ghost_head = (c->ghost_head + 1) % c->ghost_max;
+        c->ghost_count--;
+    }
+    uint32_t slot = (uint32_t)((c->ghost_head + c->ghost_count) % c->ghost_max);
+    size_t b = ghost_hash(c, off);
+    c->ghost[slot] = off;
+    c->ghost_next[slot] = c->ghost_bucket[b];
+    c->ghost_bucket[b] = slot;
+    c->ghost_count++;
+}
+
+// Consume a ghost entry; a hit means the page was re-referenced after leaving A1in
+static int ghost_take(cache_t *c, uint64_t off) {
+    uint32_t slot = c->ghost_bucket[ghost_hash(c, off)];
+    while (slot != CACHE_NIL) {
+        if (c->ghost[slot] == off) {
+            ghost_unlink(c, slot);
+            return 1;
+        }
+        slot = c->ghost_next[slot];
+    }
+    return 0;
+}
+
+// Place a freshly loaded frame: Am if its ghost is remembered, otherwise the tail of A1in
+static void policy_admit(cache_t *c, uint32_t slot, uint64_t off) {
+    cache_entry_t *e = &c->entries[slot];
+    if (c->policy != CACHE_POLICY_2Q) {
+        atomic_store_explicit(&e->queue, CACHE_Q_MAIN, memory_order_relaxed);
+        return;
+    }
+    pthread_mutex_lock(&c->policy_mutex);
+    if (ghost_take(c, off)) {
+        atomic_store_explicit(&e->queue, CACHE_Q_MAIN, memory_order_relaxed);
+    } else {
+        atomic_store_explicit(&e->queue, CACHE_Q_IN, memory_order_relaxed);
+        c->in_fifo[(c->in_head + c->in_count) % c->capacity] = slot;
+        c->in_count++;
+    }
+    pthread_mutex_unlock(&c->policy_mutex);
+}
+
+// Evict from the head of A1in; unless forced, only while A1in exceeds its share
+static int fifo_evict(cache_t *c, int fd, int force) {
+    for (int tries = 0; tries < 8; tries++) {
+        pthread_mutex_lock(&c->policy_mutex);
+        if (c->in_count == 0 || (!force && c->in_count <= c->in_max)) {
+            pthread_mutex_unlock(&c->policy_mutex);
+            return -1;
+        }
+        uint32_t i = c->in_fifo[c->in_head];
+        c->in_head = (c->in_head + 1) % c->capacity;
+        c->in_count--;
+        pthread_mutex_unlock(&c->policy_mutex);
+        uint64_t off = atomic_load_explicit(&c->entries[i].offset, memory_order_relaxed);
+        int evicted = evict_frame(c, fd, i) == 0;
+        pthread_mutex_lock(&c->policy_mutex);
+        if (evicted) {
+            ghost_add(c, off);
+        } else {
+            // Pinned or busy: give it another turn at the tail
+            c->in_fifo[(c->in_head + c->in_count) % c->capacity] = i;
+            c->in_count++;
+        }
+        pthread_mutex_unlock(&c->policy_mutex);
+        if (evicted) return 0;
+    }
+    return -1;
+}
+
+// Evict one page according to the configured policy
+static int policy_evict(cache_t *c, int fd) {
+    if (c->policy != CACHE_POLICY_2Q) return clock_evict(c, fd);
+    if (fifo_evict(c, fd, 0) == 0) return 0;
+    if (clock_evict(c, fd) == 0) return 0;
+    return fifo_evict(c, fd, 1);
+}
+
+static int flush_item_cmp(const void *a, const void *b) {
+    const cache_flush_item_t *x = a, *y = b;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// Pin up to max dirty resident frames, continuing from where the last pass stopped
+static size_t flush_collect(cache_t *c, cache_flush_item_t *items, size_t max) {
+    size_t n = 0;
+    for (size_t scanned = 0; scanned < c->capacity && n < max; scanned++) {
+        size_t i = c->flush_cursor;
+        c->flush_cursor = (c->flush_cursor + 1) % c->capacity;
+        cache_entry_t *e = &c->entries[i];
+        if (!atomic_load_explicit(&e->dirty, memory_order_relaxed)) continue;
+        uint64_t off = atomic_load_explicit(&e->offset, memory_order_relaxed);
+        if (!entry_try_pin_clean(e, off)) continue;
+        items[n].offset = off;
+        items[n].idx = (uint32_t)i;
+        n++;
+    }
+    return n;
+}
+
+// Through the extent store the whole batch is compressed and appended to the log together
+static size_t flush_write_store(cache_t *c, cache_flush_item_t *items, size_t n) {
+    uint64_t offs[CACHE_FLUSH_BATCH];
+    const char *pages[CACHE_FLUSH_BATCH];
+    if (n == 0) return 0;
+    for (size_t k = 0; k < n; k++) {
+        cache_entry_t *e = &c->entries[items[k].idx];
+        clear_dirty(c, e);
+        offs[k] = items[k].offset;
+        pages[k] = e->data;
+    }
+    int written = extent_write_batch(c->store, offs, pages, (int)n, 0);
+    if (written < (int)n) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Failed to flush %zu of %zu dirty pages to extent log (errno: %d)", n - (size_t)written, n, errno);
+        log_write_error(c, "ERROR", msg);
+        STAT_INC(c, write_errors);
+    }
+    for (size_t k = 0; k < n; k++) {
+        cache_entry_t *e = &c->entries[items[k].idx];
+        if ((int)k < written) {
+            ring_cache_invalidate(items[k].offset); // The page stays resident; its ring copy is older
+            STAT_INC(c, writebacks);
+        } else {
+            mark_dirty(c, e);
+        }
+        entry_unpin_clean(e);
+    }
+    return written > 0 ? (size_t)written : 0;
+}
+
+// Write pinned frames sorted by offset, one pwritev per run of adjacent pages; unpins them
+static size_t flush_write(cache_t *c, int fd, cache_flush_item_t *items, size_t n) {
+    struct iovec iov[CACHE_FLUSH_BATCH];
+    qsort(items, n, sizeof(*items), flush_item_cmp);
+    if (c->store) return flush_write_store(c, items, n);
+    size_t run = 0, total = 0;
+    while (run < n) {
+        size_t len = 1;
+        while (run + len < n && items[run + len].offset == items[run].offset + (uint64_t)len * PAGE_SIZE) len++;
+        for (size_t k = 0; k < len; k++) {
+            cache_entry_t *e = &c->entries[items[run + k].idx];
+            clear_dirty(c, e); // Cleared before writing: a store during the write re-dirties the page
+            iov[k].iov_base = e->data;
+            iov[k].iov_len = PAGE_SIZE;
+        }
+        ssize_t write_result = io_pwritev(fd, iov, (int)len, items[run].offset);
+        size_t written = write_result > 0 ? (size_t)write_result / PAGE_SIZE : 0;
+        if (write_result < 0) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Failed to flush %zu dirty pages at offset %lu (errno: %d)", len, items[run].offset, errno);
+            log_write_error(c, "ERROR", msg);
+            STAT_INC(c, write_errors);
+        } else if (written != len) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Partial flush at offset %lu (wrote %zd bytes instead of %zu)", items[run].offset, write_result, len * PAGE_SIZE);
+            log_write_error(c, "WARNING", msg);
+            STAT_INC(c, write_errors);
+        }
+        for (size_t k = 0; k < len; k++) {
+            cache_entry_t *e = &c->entries[items[run + k].idx];
+            if (k < written) {
+                ring_cache_invalidate(items[run + k].offset); // The page stays resident; its ring copy is older
+                STAT_INC(c, writebacks);
+            } else {
+                mark_dirty(c, e); // Not on disk: keep it dirty for the next pass
             }
-            return e->data;
-        }
-        e = e->next;
-    }
-    // Cache miss - load from disk
-    cache_entry_t *ne = malloc(sizeof(*ne));
-    if (!ne) {
-        pthread_mutex_unlock(&c->mutex[mg]);
-        log_cache_message("ERROR", "Failed to allocate memory for cache entry");
-        // Increment cache miss counter
-        pthread_mutex_lock(&stats_mutex);
-        cache_misses++;
-        pthread_mutex_unlock(&stats_mutex);
-        return NULL;
+            entry_unpin_clean(e);
+        }
+        total += written;
+        run += len;
+    }
+    return total;
+}
+
+// Flush batches until the dirty count drops to target or nothing flushable is left;
+// -1 when a batch was not written completely (the store is failing: the caller backs off)
+static int flush_until(cache_t *c, int fd, size_t target) {
+    do {
+        size_t n = flush_collect(c, c->flush_items, CACHE_FLUSH_BATCH);
+        if (n == 0) break;
+        if (flush_write(c, fd, c->flush_items, n) < n) return -1;
+    } while (atomic_load_explicit(&c->dirty_count, memory_order_relaxed) > target);
+    return 0;
+}
+
+static void *flusher_run(void *v) {
+    cache_t *c = v;
+    long backoff_ms = 0;
+    pthread_mutex_lock(&c->flush_mutex);
+    while (atomic_load(&c->flusher_running)) {
+        size_t dirty = atomic_load_explicit(&c->dirty_count, memory_order_relaxed);
+        struct timespec ts;
+        if (backoff_ms) {
+            // The last batch failed and its pages are dirty again: retrying at once would fail
+            // the same way, so the pause is sat out whatever kicks arrive meanwhile
+            deadline_after_ms(&ts, backoff_ms);
+            while (atomic_load(&c->flusher_running) &&
+                   pthread_cond_timedwait(&c->flush_wake, &c->flush_mutex, &ts) == 0) {}
+            atomic_store_explicit(&c->flush_kicked, 0, memory_order_relaxed);
+            if (!atomic_load(&c->flusher_running)) break;
+        } else if (dirty <= c->dirty_low && !c->flush_urgent) {
+            deadline_after_ms(&ts, CACHE_FLUSH_INTERVAL_MS);
+            pthread_cond_timedwait(&c->flush_wake, &c->flush_mutex, &ts);
+            atomic_store_explicit(&c->flush_kicked, 0, memory_order_relaxed);
+            continue;
+        }
+        c->flush_urgent = 0;
+        pthread_mutex_unlock(&c->flush_mutex);
+        // An urgent request (eviction found no clean page) flushes at least one batch
+        int failed = flush_until(c, c->flush_fd, c->dirty_low) != 0;
+        atomic_store_explicit(&c->flush_kicked, 0, memory_order_relaxed);
+        if (!failed) {
+            backoff_ms = 0;
+        } else if (backoff_ms == 0) {
+            backoff_ms = CACHE_FLUSH_INTERVAL_MS;
+        } else {
+            backoff_ms = backoff_ms * 2 < CACHE_FLUSH_BACKOFF_MAX_MS ? backoff_ms * 2 : CACHE_FLUSH_BACKOFF_MAX_MS;
+        }
+        pthread_mutex_lock(&c->flush_mutex);
+        pthread_cond_broadcast(&c->flush_done);
+    }
+    pthread_mutex_unlock(&c->flush_mutex);
+    return NULL;
+}
+
+int cache_start_flusher(cache_t *c, int fd) {
+    c->flush_fd = fd;
+    atomic_store(&c->flusher_running, 1);
+    if (pthread_create(&c->flusher, NULL, flusher_run, c) != 0) {
+        atomic_store(&c->flusher_running, 0);
+        log_cache_message("ERROR", "Failed to start dirty page flusher");
+        return -1;
+    }
+    log_cache_message("INFO", "Dirty page flusher started");
+    return 0;
+}
+
+static void flusher_stop(cache_t *c) {
+    if (!atomic_load(&c->flusher_running)) return;
+    pthread_mutex_lock(&c->flush_mutex);
+    atomic_store(&c->flusher_running, 0);
+    pthread_cond_signal(&c->flush_wake);
+    pthread_mutex_unlock(&c->flush_mutex);
+    pthread_join(c->flusher, NULL);
+}
+
+// Eviction found only dirty pages: ask the flusher for clean ones and wait without cache locks
+static int wait_for_clean(cache_t *c) {
+    if (!atomic_load(&c->flusher_running)) return -1;
+    struct timespec ts;
+    deadline_after_ms(&ts, 10);
+    pthread_mutex_lock(&c->flush_mutex);
+    c->flush_urgent = 1;
+    pthread_cond_signal(&c->flush_wake);
+    pthread_cond_timedwait(&c->flush_done, &c->flush_mutex, &ts);
+    pthread_mutex_unlock(&c->flush_mutex);
+    return 0;
+}
+
+int cache_init(cache_t *c) {
+    return cache_init_policy(c, CACHE_POLICY_CLOCK);
+}
+
+// Allocate the 2Q queues: A1in holds up to 1/4 of the frames, A1out remembers 1/2 as ghosts
+static int policy_init(cache_t *c) {
+    c->in_fifo = NULL;
+    c->ghost = NULL;
+    c->ghost_next = NULL;
+    c->ghost_bucket = NULL;
+    c->in_head = c->in_count = 0;
+    c->ghost_head = c->ghost_count = 0;
+    pthread_mutex_init(&c->policy_mutex, NULL);
+    if (c->policy != CACHE_POLICY_2Q) return 0;
+    c->in_max = c->capacity / 4 ? c->capacity / 4 : 1;
+    c->ghost_max = c->capacity / 2 ? c->capacity / 2 : 1;
+    size_t buckets = 1;
+    while (buckets < c->ghost_max) buckets <<= 1;
+    c->ghost_mask = buckets - 1;
+    c->in_fifo = malloc(c->capacity * sizeof(*c->in_fifo));
+    c->ghost = malloc(c->ghost_max * sizeof(*c->ghost));
+    c->ghost_next = malloc(c->ghost_max * sizeof(*c->ghost_next));
+    c->ghost_bucket = malloc(buckets * sizeof(*c->ghost_bucket));
+    if (!c->in_fifo || !c->ghost || !c->ghost_next || !c->ghost_bucket) return -1;
+    for (size_t i = 0; i < c->ghost_max; i++) c->ghost[i] = UINT64_MAX;
+    for (size_t i = 0; i < buckets; i++) c->ghost_bucket[i] = CACHE_NIL;
+    return 0;
+}
+
+static void policy_destroy(cache_t *c) {
+    free(c->in_fifo);
+    free(c->ghost);
+    free(c->ghost_next);
+    free(c->ghost_bucket);
+    c->in_fifo = NULL;
+    c->ghost = NULL;
+    c->ghost_next = NULL;
+    c->ghost_bucket = NULL;
+    pthread_mutex_destroy(&c->policy_mutex);
+}
+
+int cache_init_policy(cache_t *c, cache_policy_t policy) {
+    return cache_init_frames(c, policy, CACHE_ARENA_PAGES);
+}
+
+static size_t pow2_at_least(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+int cache_init_frames(cache_t *c, cache_policy_t policy, size_t frames) {
+    cache_geometry_t geo = { .frames = frames };
+    return cache_init_geometry(c, policy, &geo);
+}
+
+int cache_init_geometry(cache_t *c, cache_policy_t policy, const cache_geometry_t *geo) {
+    // Preallocate the whole arena up front: memory use is fixed at startup
+    size_t frames = geo->frames ? geo->frames : 1;
+    // At most one frame per bucket on average, and never more stripes than buckets
+    size_t buckets = pow2_at_least(geo->buckets ? geo->buckets : HASH_SIZE ? HASH_SIZE : frames);
+    size_t stripes = pow2_at_least(geo->stripes ? geo->stripes : MUTEX_GROUPS);
+    if (stripes > buckets) stripes = buckets;
+    c->hash = malloc(buckets * sizeof(*c->hash));
+    c->stripe = aligned_alloc(_Alignof(cache_stripe_t), stripes * sizeof(*c->stripe));
+    if (!c->hash || !c->stripe) {
+        free((void*)c->hash);
+        free(c->stripe);
+        log_cache_message("ERROR", "Failed to allocate cache index");
+        return -1;
     }
-    ne->offset = off;
-    ne->dirty = write;
-    ne->last_access = time(NULL);
-    ne->next = c->hash[h];
-    ne->prev = NULL;
-    if (c->hash[h]) c->hash[h]->prev = ne;
-    c->hash[h] = ne;
-    // Read page from disk with detailed error handling
-    ssize_t read_result = pread(fd, ne->data, PAGE_SIZE, off);
+    c->hash_mask = buckets - 1;
+    c->stripe_mask = stripes - 1;
+    c->capacity = frames;
+    c->policy = policy;
+    c->store = NULL;
+    c->ring_victims = CACHE_RING_VICTIMS;
+    if (policy_init(c) != 0) {
+        policy_destroy(c);
+        free((void*)c->hash);
+        free(c->stripe);
+        log_cache_message("ERROR", "Failed to allocate replacement policy state");
+        return -1;
+    }
+    c->arena = mmap(NULL, c->capacity * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (c->arena == MAP_FAILED) {
+        c->arena = NULL;
+        policy_destroy(c);
+        free((void*)c->hash);
+        free(c->stripe);
+        log_cache_message("ERROR", "Failed to map cache arena");
+        return -1;
+    }
+    c->entries = calloc(c->capacity, sizeof(*c->entries));
+    c->free_next = calloc(c->capacity, sizeof(*c->free_next));
+    c->ref = calloc(c->capacity, sizeof(*c->ref));
+    c->flush_items = malloc(CACHE_FLUSH_BATCH * sizeof(*c->flush_items));
+    if (!c->entries || !c->free_next || !c->ref || !c->flush_items) {
+        policy_destroy(c);
+        free(c->flush_items);
+        free(c->entries);
+        free((void*)c->free_next);
+        free((void*)c->ref);
+        munmap(c->arena, c->capacity * PAGE_SIZE);
+        c->arena = NULL;
+        free((void*)c->hash);
+        free(c->stripe);
+        log_cache_message("ERROR", "Failed to allocate cache metadata");
+        return -1;
+    }
+    atomic_init(&c->free_head, 0);
+    for (size_t i = c->capacity; i-- > 0; ) {
+        c->entries[i].data = c->arena + i * PAGE_SIZE;
+        atomic_init(&c->entries[i].offset, UINT64_MAX);
+        atomic_init(&c->entries[i].state, CACHE_FRAME_FREE);
+        atomic_init(&c->entries[i].hnext, CACHE_NIL);
+        atomic_init(&c->entries[i].queue, CACHE_Q_MAIN);
+        atomic_init(&c->entries[i].prefetched, 0);
+        atomic_init(&c->entries[i].access, 0);
+        frame_push(c, (uint32_t)i);
+    }
+    for (size_t i = 0; i <= c->hash_mask; i++) {
+        atomic_init(&c->hash[i], CACHE_NIL);
+    }
+    for (size_t i = 0; i <= c->stripe_mask; i++) {
+        pthread_mutex_init(&c->stripe[i].mutex, NULL);
+        atomic_init(&c->stripe[i].seq, 0);
+    }
+    atomic_init(&c->entry_count, 0);
+    atomic_init(&c->clock_hand, 0);
+    memset(c->stats, 0, sizeof(c->stats));
+    atomic_init(&c->dirty_count, 0);
+    c->dirty_high = c->capacity * CACHE_DIRTY_HIGH_PCT / 100;
+    c->dirty_low = c->capacity * CACHE_DIRTY_LOW_PCT / 100;
+    atomic_init(&c->flusher_running, 0);
+    atomic_init(&c->flush_kicked, 0);
+    c->flush_urgent = 0;
+    c->flush_fd = -1;
+    c->flush_cursor = 0;
+    atomic_init(&c->error_logged_ms, 0);
+    atomic_init(&c->errors_suppressed, 0);
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_mutex_init(&c->flush_mutex, NULL);
+    pthread_cond_init(&c->flush_wake, &ca);
+    pthread_cond_init(&c->flush_done, &ca);
+    pthread_condattr_destroy(&ca);
+    log_cache_message("INFO", "Cache initialized");
+    return 0;
+}
+
+// Hit bookkeeping on a pinned frame: no locks, just the dirty flag and the CLOCK bit;
+// the pin is handed to the caller when keep is set
+static char* cache_hit(cache_t *c, uint32_t i, int write, int keep) {
+    cache_entry_t *e = &c->entries[i];
+    if (write) mark_dirty(c, e);
+    if (atomic_load_explicit(&e->prefetched, memory_order_relaxed) &&
+        atomic_exchange_explicit(&e->prefetched, 0, memory_order_relaxed)) {
+        STAT_INC(c, prefetch_hits);
+    }
+    if (!atomic_load_explicit(&c->ref[i], memory_order_relaxed)) {
+        atomic_store_explicit(&c->ref[i], 1, memory_order_relaxed);
+    }
+    if (!keep) entry_unpin(e);
+    STAT_INC(c, hits);
+    return e->data;
+}
+
+// Get a free frame, evicting as needed; only waits for the flusher when can_wait is set
+static int frame_alloc(cache_t *c, int fd, int can_wait, uint32_t *slot) {
+    int waits = 0;
+    while (frame_pop(c, slot) < 0) {
+        if (policy_evict(c, fd) == 0) continue;
+        if (!can_wait || waits++ >= 100 || wait_for_clean(c) < 0) return -1;
+    }
+    return 0;
+}
+
+// Publish a frame as LOADING so concurrent misses on this offset wait for it
+// (caller holds the stripe mutex and has checked that the offset is not indexed)
+static void index_publish_loading(cache_t *c, size_t h, uint64_t off, uint32_t slot) {
+    cache_stripe_t *s = &c->stripe[mutex_group(c, h)];
+    cache_entry_t *ne = &c->entries[slot];
+    atomic_store_explicit(&ne->offset, off, memory_order_relaxed);
+    atomic_store_explicit(&ne->dirty, 0, memory_order_relaxed);
+    atomic_store_explicit(&ne->prefetched, 0, memory_order_relaxed);
+    atomic_store_explicit(&ne->state, CACHE_FRAME_LOADING, memory_order_relaxed);
+    atomic_store_explicit(&c->ref[slot], 0, memory_order_relaxed);
+    stripe_write_begin(s);
+    atomic_store_explicit(&ne->hnext, atomic_load_explicit(&c->hash[h], memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&c->hash[h], slot, memory_order_release);
+    stripe_write_end(s);
+}
+
+// Loading failed: drop the placeholder and recycle the frame
+static void load_abort(cache_t *c, size_t h, uint32_t slot) {
+    cache_stripe_t *s = &c->stripe[mutex_group(c, h)];
+    pthread_mutex_lock(&s->mutex);
+    chain_unlink(c, h, slot);
+    atomic_store(&c->entries[slot].state, CACHE_FRAME_FREE);
+    pthread_mutex_unlock(&s->mutex);
+    frame_push(c, slot);
+}
+
+// Check a completed read; returns -1 on error, zero-fills a partial page
+static int load_check(cache_t *c, cache_entry_t *ne, uint64_t off, ssize_t read_result, int err) {
     if (read_result < 0) {
         char msg[256];
-        snprintf(msg, sizeof(msg), "Failed to read page from disk at offset %lu (errno: %d)", off, errno);
+        snprintf(msg, sizeof(msg), "Failed to read page from disk at offset %lu (errno: %d)", off, err);
         log_cache_message("ERROR", msg);
-        free(ne);
-        if (c->hash[h] == ne) c->hash[h] = ne->next;
-        if (ne->next) ne->next->prev = NULL;
-        pthread_mutex_unlock(&c->mutex[mg]);
-        // Increment cache miss counter
-        pthread_mutex_lock(&stats_mutex);
-        cache_misses++;
-        pthread_mutex_unlock(&stats_mutex);
-        return NULL;
+        STAT_INC(c, read_errors);
+        return -1;
     } else if (read_result != PAGE_SIZE) {
         char msg[256];
         snprintf(msg, sizeof(msg), "Partial read from disk at offset %lu (read %zd bytes instead of %d)", off, read_result, PAGE_SIZE);
@@ -144,92 +859,592 @@ char* cache_get(cache_t *c, int fd, uint64_t off, int write) {
         // Fill the remaining part of the buffer with zeros to avoid undefined behavior
         memset(ne->data + read_result, 0, PAGE_SIZE - read_result);
     }
-    // Add to LRU list
-    pthread_mutex_lock(&c->lru_mutex);
-    ne->next = c->lru_head;
-    ne->prev = NULL;
-    if (c->lru_head) c->lru_head->prev = ne;
-    c->lru_head = ne;
-    if (!c->lru_tail) c->lru_tail = ne;
-    c->entry_count++;
-    // Check if eviction is needed
-    if (c->entry_count > MAX_CACHE_ENTRIES) {
-        cache_evict(c, fd);
-    }
-    pthread_mutex_unlock(&c->lru_mutex);
-    pthread_mutex_unlock(&c->mutex[mg]);
-    // Increment cache miss counter
-    pthread_mutex_lock(&stats_mutex);
-    cache_misses++;
-    pthread_mutex_unlock(&stats_mutex);
+    return 0;
+}
+
+// Make a loaded frame visible to lookups
+static void load_complete(cache_t *c, uint32_t slot, uint64_t off, int write, int prefetched) {
+    cache_entry_t *ne = &c->entries[slot];
+    if (write) mark_dirty(c, ne);
+    atomic_store_explicit(&ne->prefetched, (uint8_t)prefetched, memory_order_relaxed);
+    policy_admit(c, slot, off);
+    atomic_store_explicit(&ne->state, CACHE_FRAME_RESIDENT, memory_order_release);
+    atomic_fetch_add_explicit(&c->entry_count, 1, memory_order_relaxed);
+}
+
+// Shared lookup/load path of cache_get and cache_pin; *hit tells the latency histogram which path it took
+static char* cache_lookup(cache_t *c, int fd, uint64_t off, int write, int keep, int *hit) {
+    size_t h = hash_func(c, off);
+    cache_stripe_t *s = &c->stripe[mutex_group(c, h)];
+    uint32_t slot = CACHE_NIL;
+    for (;;) {
+        uint32_t i = index_lookup(c, h, off);
+        if (i != CACHE_NIL && entry_try_pin(&c->entries[i], off)) {
+            if (slot != CACHE_NIL) frame_push(c, slot);
+            *hit = 1;
+            return cache_hit(c, i, write, keep);
+        }
+        // Cache miss - take a frame from the arena, evicting when it is exhausted
+        if (slot == CACHE_NIL && frame_alloc(c, fd, 1, &slot) < 0) {
+            log_cache_message("ERROR", "No evictable frame in cache arena");
+            STAT_INC(c, misses);
+            return NULL;
+        }
+        pthread_mutex_lock(&s->mutex);
+        i = chain_find(c, h, off);
+        if (i != CACHE_NIL) {
+            cache_entry_t *e = &c->entries[i];
+            if (atomic_load(&e->state) == CACHE_FRAME_RESIDENT) {
+                // Loaded by another thread meanwhile; the state is stable under the stripe mutex
+                atomic_fetch_add(&e->pins, 1);
+                pthread_mutex_unlock(&s->mutex);
+                frame_push(c, slot);
+                *hit = 1;
+                return cache_hit(c, i, write, keep);
+            }
+            // Still loading or being written back: wait for it without holding the lock
+            pthread_mutex_unlock(&s->mutex);
+            sched_yield();
+            continue;
+        }
+        index_publish_loading(c, h, off, slot);
+        pthread_mutex_unlock(&s->mutex);
+        break;
+    }
+    cache_entry_t *ne = &c->entries[slot];
+    STAT_INC(c, misses);
+    // Pinned while still LOADING, so it cannot be evicted between becoming resident and the return
+    if (keep) atomic_fetch_add(&ne->pins, 1);
+    // Victim tier first: a page evicted recently is still in the ring
+    if (c->ring_victims && ring_cache_lookup(off, ne->data)) {
+        STAT_INC(c, ring_hits);
+        load_complete(c, slot, off, write, 0);
+        return ne->data;
+    }
+    // Read page from disk with detailed error handling (outside any cache lock)
+    ssize_t read_result = backing_read(c, fd, ne->data, off);
+    if (load_check(c, ne, off, read_result, errno) < 0) {
+        if (keep) entry_unpin(ne);
+        load_abort(c, h, slot);
+        return NULL;
+    }
+    load_complete(c, slot, off, write, 0);
     return ne->data;
 }
 
+char* cache_get(cache_t *c, int fd, uint64_t off, int write) {
+    uint64_t t0 = metrics_now();
+    int hit = 0;
+    char *page = cache_lookup(c, fd, off, write, 0, &hit);
+    metrics_record(hit ? METRIC_CACHE_HIT : METRIC_CACHE_MISS, t0);
+    return page;
+}
+
+char* cache_pin(cache_t *c, int fd, uint64_t off, int write) {
+    uint64_t t0 = metrics_now();
+    int hit = 0;
+    char *page = cache_lookup(c, fd, off, write, 1, &hit);
+    metrics_record(hit ? METRIC_CACHE_HIT : METRIC_CACHE_MISS, t0);
+    return page;
+}
+
+// A pinned page pointer always lies inside the arena: its frame is its page index
+static cache_entry_t *page_entry(cache_t *c, const char *page) {
+    return &c->entries[(size_t)(page - c->arena) / PAGE_SIZE];
+}
+
+void cache_unpin(cache_t *c, const char *page) {
+    entry_unpin(page_entry(c, page));
+}
+
+char* cache_pin_exclusive(cache_t *c, int fd, uint64_t off) {
+    char *page = cache_pin(c, fd, off, 0);
+    if (page) entry_write_lock(page_entry(c, page));
+    return page;
+}
+
+void cache_unpin_exclusive(cache_t *c, const char *page) {
+    cache_entry_t *e = page_entry(c, page);
+    entry_write_unlock(e);
+    entry_unpin(e);
+}
+
+void cache_mark_dirty(cache_t *c, const char *page) {
+    mark_dirty(c, page_entry(c, page));
+}
+
+int cache_read(cache_t *c, int fd, uint64_t off, char *out) {
+    char *page = cache_pin(c, fd, off, 0);
+    if (!page) return -1;
+    cache_entry_t *e = page_entry(c, page);
+    while (!entry_try_read(e)) sched_yield(); // Changed in place right now: copy it once that is done
+    memcpy(out, page, PAGE_SIZE);
+    entry_read_end(e);
+    cache_unpin(c, page);
+    return 0;
+}
+
+int cache_update(cache_t *c, uint64_t off, const char *data) {
+    // The copy happens under a pin: with a shared cache another core may be evicting this frame
+    uint32_t i = index_lookup(c, hash_func(c, off), off);
+    if (i == CACHE_NIL || !entry_try_pin(&c->entries[i], off)) return 0;
+    entry_write_lock(&c->entries[i]);
+    memcpy(c->entries[i].data, data, PAGE_SIZE);
+    entry_write_unlock(&c->entries[i]);
+    entry_unpin(&c->entries[i]);
+    return 1;
+}
+
+// Read k LOADING frames in one submission; adjacent offsets share one vectored request
+// (one preadv per run on the sync backend). res[j] gets the bytes read into frame j or -errno
+static void load_batch(cache_t *c, int fd, const uint64_t *offs, const uint32_t *slots, int k, ssize_t *res) {
+    if (c->store) {
+        // Extents are variable-sized records in the log, so the store reads them one by one
+        for (int j = 0; j < k; j++) {
+            ssize_t r = extent_read(c->store, offs[j], c->entries[slots[j]].data);
+            res[j] = r < 0 ? -errno : r;
+        }
+        return;
+    }
+    int order[CACHE_BATCH_MAX];
+    for (int j = 0; j < k; j++) {
+        int q = j;
+        while (q > 0 && offs[order[q - 1]] > offs[j]) { order[q] = order[q - 1]; q--; }
+        order[q] = j;
+    }
+    struct iovec iov[CACHE_BATCH_MAX];
+    io_request_t reqs[CACHE_BATCH_MAX];
+    int first[CACHE_BATCH_MAX];
+    int nreq = 0;
+    for (int r = 0; r < k; ) {
+        int len = 1;
+        while (r + len < k && offs[order[r + len]] == offs[order[r]] + (uint64_t)len * PAGE_SIZE) len++;
+        for (int m = 0; m < len; m++) {
+            iov[r + m].iov_base = c->entries[slots[order[r + m]]].data;
+            iov[r + m].iov_len = PAGE_SIZE;
+        }
+        reqs[nreq] = (io_request_t){ .fd = fd, .iov = &iov[r], .iovcnt = len, .offset = offs[order[r]] };
+        first[nreq++] = r;
+        r += len;
+    }
+    io_submit_batch(reqs, nreq);
+    for (int q = 0; q < nreq; q++) {
+        ssize_t got = reqs[q].result;
+        for (int m = 0; m < reqs[q].iovcnt; m++) {
+            // A short run read leaves the tail pages partial or empty, like a short pread
+            ssize_t rest = got - (ssize_t)m * PAGE_SIZE;
+            res[order[first[q] + m]] = got < 0 ? got : rest <= 0 ? 0 : rest > PAGE_SIZE ? PAGE_SIZE : rest;
+        }
+    }
+}
+
+// Finish a batch load: frames that read fine become resident, the rest are recycled
+static int load_finish(cache_t *c, const uint64_t *offs, const uint32_t *slots, const size_t *hashes,
+                       const ssize_t *res, int k, int write, int prefetched, int keep, char **pages) {
+    int loaded = 0;
+    for (int j = 0; j < k; j++) {
+        cache_entry_t *ne = &c->entries[slots[j]];
+        if (load_check(c, ne, offs[j], res[j] < 0 ? -1 : res[j], res[j] < 0 ? (int)-res[j] : 0) < 0) {
+            if (keep) entry_unpin(ne);
+            load_abort(c, hashes[j], slots[j]);
+            continue;
+        }
+        load_complete(c, slots[j], offs[j], write, prefetched);
+        if (pages) pages[j] = ne->data;
+        loaded++;
+    }
+    return loaded;
+}
+
+int cache_prefetch(cache_t *c, int fd, const uint64_t *offs, int n) {
+    uint64_t loffs[CACHE_PREFETCH_MAX];
+    uint32_t slots[CACHE_PREFETCH_MAX];
+    size_t hashes[CACHE_PREFETCH_MAX];
+    ssize_t res[CACHE_PREFETCH_MAX];
+    int k = 0;
+    if (n > CACHE_PREFETCH_MAX) n = CACHE_PREFETCH_MAX;
+    for (int j = 0; j < n; j++) {
+        uint64_t off = offs[j];
+        size_t h = hash_func(c, off);
+        if (index_lookup(c, h, off) != CACHE_NIL) continue; // Already cached or being loaded
+        uint32_t slot;
+        // Readahead never waits for the flusher: demand misses must not queue behind it
+        if (frame_alloc(c, fd, 0, &slot) < 0) break;
+        cache_stripe_t *s = &c->stripe[mutex_group(c, h)];
+        pthread_mutex_lock(&s->mutex);
+        if (chain_find(c, h, off) != CACHE_NIL) {
+            pthread_mutex_unlock(&s->mutex);
+            frame_push(c, slot);
+            continue;
+        }
+        index_publish_loading(c, h, off, slot);
+        pthread_mutex_unlock(&s->mutex);
+        if (c->ring_victims && ring_cache_lookup(off, c->entries[slot].data)) {
+            load_complete(c, slot, off, 0, 1);
+            atomic_fetch_add_explicit(&stats_shard(c)->prefetch_issued, 1, memory_order_relaxed);
+            continue;
+        }
+        loffs[k] = off;
+        slots[k] = slot;
+        hashes[k] = h;
+        k++;
+    }
+    // One submission for the whole window: queue depth k on the io_uring backend
+    load_batch(c, fd, loffs, slots, k, res);
+    int loaded = load_finish(c, loffs, slots, hashes, res, k, 0, 1, 0, NULL);
+    atomic_fetch_add_explicit(&stats_shard(c)->prefetch_issued, (uint64_t)loaded, memory_order_relaxed);
+    return loaded;
+}
+
+// One pass of cache_get_batch over at most CACHE_BATCH_MAX offsets
+static int get_batch_pass(cache_t *c, int fd, const uint64_t *offs, int n, char **pages, int write) {
+    size_t hashes[CACHE_BATCH_MAX];
+    int miss[CACHE_BATCH_MAX], retry[CACHE_BATCH_MAX];
+    uint32_t slots[CACHE_BATCH_MAX];
+    int nmiss = 0, nretry = 0, got = 0;
+    // Hits first, without locks
+    for (int i = 0; i < n; i++) {
+        pages[i] = NULL;
+        hashes[i] = hash_func(c, offs[i]);
+        uint32_t idx = index_lookup(c, hashes[i], offs[i]);
+        if (idx != CACHE_NIL && entry_try_pin(&c->entries[idx], offs[i])) {
+            pages[i] = cache_hit(c, idx, write, 1);
+            got++;
+        } else {
+            miss[nmiss++] = i;
+        }
+    }
+    if (nmiss == 0) return got;
+    // Frames for every miss before any stripe lock is taken: allocation may evict
+    int nalloc = 0;
+    while (nalloc < nmiss && frame_alloc(c, fd, 1, &slots[nalloc]) == 0) nalloc++;
+    for (int a = nalloc; a < nmiss; a++) retry[nretry++] = miss[a];
+    // Misses ordered by stripe, so each stripe mutex is taken once for the whole batch
+    for (int a = 1; a < nalloc; a++) {
+        int i = miss[a], q = a;
+        while (q > 0 && mutex_group(c, hashes[miss[q - 1]]) > mutex_group(c, hashes[i])) { miss[q] = miss[q - 1]; q--; }
+        miss[q] = i;
+    }
+    uint64_t loffs[CACHE_BATCH_MAX];
+    uint32_t lslots[CACHE_BATCH_MAX];
+    size_t lhashes[CACHE_BATCH_MAX];
+    int lidx[CACHE_BATCH_MAX];
+    int nload = 0, used = 0;
+    for (int a = 0; a < nalloc; ) {
+        size_t g = mutex_group(c, hashes[miss[a]]);
+        cache_stripe_t *s = &c->stripe[g];
+        pthread_mutex_lock(&s->mutex);
+        for (; a < nalloc && mutex_group(c, hashes[miss[a]]) == g; a++) {
+            int i = miss[a];
+            uint32_t idx = chain_find(c, hashes[i], offs[i]);
+            if (idx == CACHE_NIL) {
+                index_publish_loading(c, hashes[i], offs[i], slots[used]);
+                loffs[nload] = offs[i];
+                lslots[nload] = slots[used++];
+                lhashes[nload] = hashes[i];
+                lidx[nload++] = i;
+            } else if (atomic_load(&c->entries[idx].state) == CACHE_FRAME_RESIDENT) {
+                // Loaded by another thread meanwhile; the state is stable under the stripe mutex
+                atomic_fetch_add(&c->entries[idx].pins, 1);
+                pages[i] = cache_hit(c, idx, write, 1);
+                got++;
+            } else {
+                retry[nretry++] = i; // Loading elsewhere (or a duplicate in this batch)
+            }
+        }
+        pthread_mutex_unlock(&s->mutex);
+    }
+    for (int a = used; a < nalloc; a++) frame_push(c, slots[a]);
+    // Victim tier first, then one submission for what is left
+    uint64_t roffs[CACHE_BATCH_MAX];
+    uint32_t rslots[CACHE_BATCH_MAX];
+    size_t rhashes[CACHE_BATCH_MAX];
+    int ridx[CACHE_BATCH_MAX];
+    ssize_t res[CACHE_BATCH_MAX];
+    char *rpages[CACHE_BATCH_MAX];
+    int nread = 0;
+    for (int j = 0; j < nload; j++) {
+        cache_entry_t *ne = &c->entries[lslots[j]];
+        STAT_INC(c, misses);
+        atomic_fetch_add(&ne->pins, 1);
+        if (c->ring_victims && ring_cache_lookup(loffs[j], ne->data)) {
+            STAT_INC(c, ring_hits);
+            load_complete(c, lslots[j], loffs[j], write, 0);
+            pages[lidx[j]] = ne->data;
+            got++;
+            continue;
+        }
+        roffs[nread] = loffs[j];
+        rslots[nread] = lslots[j];
+        rhashes[nread] = lhashes[j];
+        rpages[nread] = NULL;
+        ridx[nread++] = lidx[j];
+    }
+    load_batch(c, fd, roffs, rslots, nread, res);
+    got += load_finish(c, roffs, rslots, rhashes, res, nread, write, 0, 1, rpages);
+    for (int j = 0; j < nread; j++) pages[ridx[j]] = rpages[j];
+    // Pages another thread was loading, and misses that found no frame, go one by one
+    for (int j = 0; j < nretry; j++) {
+        pages[retry[j]] = cache_pin(c, fd, offs[retry[j]], write);
+        if (pages[retry[j]]) got++;
+    }
+    return got;
+}
+
+int cache_get_batch(cache_t *c, int fd, const uint64_t *offs, int n, char **pages, int write) {
+    int got = 0;
+    for (int base = 0; base < n; base += CACHE_BATCH_MAX) {
+        int m = n - base < CACHE_BATCH_MAX ? n - base : CACHE_BATCH_MAX;
+        got += get_batch_pass(c, fd, offs + base, m, pages + base, write);
+    }
+    return got;
+}
+
+void cache_unpin_batch(cache_t *c, char *const *pages, int n) {
+    for (int i = 0; i < n; i++) {
+        if (pages[i]) cache_unpin(c, pages[i]);
+    }
+}
+
+int cache_warm_batch(cache_t *c, int fd, const uint64_t *offs, int n, int main_queue) {
+    char *pages[CACHE_BATCH_MAX];
+    int got = 0;
+    for (int base = 0; base < n; base += CACHE_BATCH_MAX) {
+        int m = n - base < CACHE_BATCH_MAX ? n - base : CACHE_BATCH_MAX;
+        if (main_queue && c->policy == CACHE_POLICY_2Q) {
+            // A remembered ghost sends the page straight to Am (policy_admit)
+            pthread_mutex_lock(&c->policy_mutex);
+            for (int i = 0; i < m; i++) ghost_add(c, offs[base + i]);
+            pthread_mutex_unlock(&c->policy_mutex);
+        }
+        got += get_batch_pass(c, fd, offs + base, m, pages, 0);
+        cache_unpin_batch(c, pages, m);
+    }
+    return got;
+}
+
+int cache_prefetch_range(cache_t *c, int fd, uint64_t start, int npages) {
+    uint64_t offs[CACHE_PREFETCH_MAX];
+    int loaded = 0;
+    for (int base = 0; base < npages; base += CACHE_PREFETCH_MAX) {
+        int m = npages - base < CACHE_PREFETCH_MAX ? npages - base : CACHE_PREFETCH_MAX;
+        for (int j = 0; j < m; j++) offs[j] = start + (uint64_t)(base + j) * PAGE_SIZE;
+        loaded += cache_prefetch(c, fd, offs, m);
+    }
+    return loaded;
+}
+
+int cache_flush_range(cache_t *c, int fd, uint64_t start, int npages) {
+    cache_flush_item_t items[CACHE_FLUSH_BATCH];
+    size_t n = 0, total = 0;
+    for (int p = 0; p < npages; p++) {
+        uint64_t off = start + (uint64_t)p * PAGE_SIZE;
+        uint32_t i = index_lookup(c, hash_func(c, off), off);
+        if (i == CACHE_NIL || !atomic_load_explicit(&c->entries[i].dirty, memory_order_relaxed)) continue;
+        if (!entry_try_pin_clean(&c->entries[i], off)) continue;
+        items[n].offset = off;
+        items[n].idx = i;
+        if (++n == CACHE_FLUSH_BATCH) {
+            total += flush_write(c, fd, items, n);
+            n = 0;
+        }
+    }
+    if (n) total += flush_write(c, fd, items, n);
+    return (int)total;
+}
+
+void cache_attach_store(cache_t *c, extent_store_t *store) {
+    c->store = store;
+}
+
 void cache_evict(cache_t *c, int fd) {
-    // Evict the least recently used entry
-    if (!c->lru_tail) return;
-    cache_entry_t *evict = c->lru_tail;
-    size_t h = hash_func(evict->offset);
-    size_t mg = mutex_group(h);
-    pthread_mutex_lock(&c->mutex[mg]);
-    // Remove from hash table
-    if (evict->prev) evict->prev->next = evict->next;
-    if (evict->next) evict->next->prev = evict->prev;
-    if (c->hash[h] == evict) c->hash[h] = evict->next;
-    // If entry is dirty, write back to disk with detailed error handling
-    if (evict->dirty) {
-        ssize_t write_result = pwrite(fd, evict->data, PAGE_SIZE, evict->offset);
-        if (write_result < 0) {
-            char msg[256];
-            snprintf(msg, sizeof(msg), "Failed to write dirty page at offset %lu (errno: %d)", evict->offset, errno);
-            log_cache_message("ERROR", msg);
-        } else if (write_result != PAGE_SIZE) {
-            char msg[256];
-            snprintf(msg, sizeof(msg), "Partial write to disk at offset %lu (wrote %zd bytes instead of %d)", evict->offset, write_result, PAGE_SIZE);
-            log_cache_message("WARNING", msg);
+    // Evict one page chosen by the replacement policy
+    policy_evict(c, fd);
+}
+
+// Sum the per-thread shards; counters are read relaxed, so the totals are approximate while running
+void cache_stats_snapshot(const cache_t *c, cache_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < CACHE_STATS_SHARDS; i++) {
+        const cache_stats_shard_t *sh = &c->stats[i];
+        out->hits += atomic_load_explicit(&sh->hits, memory_order_relaxed);
+        out->misses += atomic_load_explicit(&sh->misses, memory_order_relaxed);
+        out->evictions += atomic_load_explicit(&sh->evictions, memory_order_relaxed);
+        out->writebacks += atomic_load_explicit(&sh->writebacks, memory_order_relaxed);
+        out->read_errors += atomic_load_explicit(&sh->read_errors, memory_order_relaxed);
+        out->write_errors += atomic_load_explicit(&sh->write_errors, memory_order_relaxed);
+        out->prefetch_issued += atomic_load_explicit(&sh->prefetch_issued, memory_order_relaxed);
+        out->prefetch_hits += atomic_load_explicit(&sh->prefetch_hits, memory_order_relaxed);
+        out->prefetch_wasted += atomic_load_explicit(&sh->prefetch_wasted, memory_order_relaxed);
+        out->ring_hits += atomic_load_explicit(&sh->ring_hits, memory_order_relaxed);
+    }
+}
+
+void cache_stats_reset(cache_t *c) {
+    memset(c->stats, 0, sizeof(c->stats));
+}
+
+size_t cache_resident_offsets(const cache_t *c, uint64_t *offs, size_t max) {
+    size_t n = 0;
+    for (size_t i = 0; i < c->capacity && n < max; i++) {
+        const cache_entry_t *e = &c->entries[i];
+        if (atomic_load_explicit(&e->state, memory_order_acquire) == CACHE_FRAME_RESIDENT) {
+            offs[n++] = atomic_load_explicit(&e->offset, memory_order_relaxed);
         }
-        evict->dirty = 0; // Reset dirty flag after write attempt
     }
-    free(evict);
-    c->entry_count--;
-    // Update LRU tail
-    c->lru_tail = c->lru_tail->prev;
-    if (c->lru_tail) c->lru_tail->next = NULL;
-    pthread_mutex_unlock(&c->mutex[mg]);
+    return n;
 }
 
 void cache_destroy(cache_t *c, int fd) {
-    for (int i = 0; i < HASH_SIZE; i++) {
-        size_t mg = mutex_group(i);
-        pthread_mutex_lock(&c->mutex[mg]);
-        cache_entry_t *e = c->hash[i];
-        while (e) {
-            cache_entry_t *n = e->next;
-            if (e->dirty) {
-                ssize_t write_result = pwrite(fd, e->data, PAGE_SIZE, e->offset);
-                if (write_result < 0) {
-                    char msg[256];
-                    snprintf(msg, sizeof(msg), "Failed to write dirty page at offset %lu during shutdown (errno: %d)", e->offset, errno);
-                    log_cache_message("ERROR", msg);
-                } else if (write_result != PAGE_SIZE) {
-                    char msg[256];
-                    snprintf(msg, sizeof(msg), "Partial write during shutdown at offset %lu (wrote %zd bytes instead of %d)", e->offset, write_result, PAGE_SIZE);
-                    log_cache_message("WARNING", msg);
-                }
-                e->dirty = 0; // Reset dirty flag after write attempt
+    flusher_stop(c);
+    // Final write-back in offset order, merged into pwritev runs
+    flush_until(c, fd, 0);
+    for (size_t i = 0; i < c->capacity; i++) {
+        atomic_store(&c->entries[i].state, CACHE_FRAME_FREE);
+    }
+    for (size_t i = 0; i <= c->stripe_mask; i++) {
+        pthread_mutex_destroy(&c->stripe[i].mutex);
+    }
+    atomic_store(&c->entry_count, 0);
+    free(c->entries);
+    free((void*)c->free_next);
+    free((void*)c->ref);
+    free(c->flush_items);
+    free((void*)c->hash);
+    free(c->stripe);
+    policy_destroy(c);
+    pthread_mutex_destroy(&c->flush_mutex);
+    pthread_cond_destroy(&c->flush_wake);
+    pthread_cond_destroy(&c->flush_done);
+    munmap(c->arena, c->capacity * PAGE_SIZE);
+    c->entries = NULL;
+    c->free_next = NULL;
+    c->ref = NULL;
+    c->flush_items = NULL;
+    c->arena = NULL;
+    c->hash = NULL;
+    c->stripe = NULL;
+    log_cache_message("INFO", "Cache destroyed");
+}
+
+int cache_shared_init(cache_shared_t *sc, int nshards, uint64_t shard_span, cache_policy_t policy) {
+    if (nshards < 1) nshards = 1;
+    if (nshards > CACHE_SHARDS_MAX) nshards = CACHE_SHARDS_MAX;
+    cache_geometry_t geo = { .frames = CACHE_SHARD_PAGES(nshards) };
+    return cache_shared_init_geometry(sc, nshards, shard_span, policy, &geo);
+}
+
+int cache_shared_init_geometry(cache_shared_t *sc, int nshards, uint64_t shard_span, cache_policy_t policy,
+                               const cache_geometry_t *geo) {
+    if (nshards < 1) nshards = 1;
+    if (nshards > CACHE_SHARDS_MAX) nshards = CACHE_SHARDS_MAX;
+    sc->shard = calloc((size_t)nshards, sizeof(*sc->shard));
+    if (!sc->shard) {
+        log_cache_message("ERROR", "Failed to allocate cache shards");
+        return -1;
+    }
+    sc->nshards = nshards;
+    sc->shard_span = shard_span >= PAGE_SIZE ? shard_span : PAGE_SIZE;
+    for (int i = 0; i < nshards; i++) {
+        if (cache_init_geometry(&sc->shard[i], policy, geo) != 0) {
+            for (int j = 0; j < i; j++) cache_destroy(&sc->shard[j], -1);
+            free(sc->shard);
+            sc->shard = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void cache_shared_attach_store(cache_shared_t *sc, extent_store_t *store) {
+    for (int i = 0; i < sc->nshards; i++) cache_attach_store(&sc->shard[i], store);
+}
+
+int cache_shared_start_flusher(cache_shared_t *sc, int fd) {
+    int rc = 0;
+    for (int i = 0; i < sc->nshards; i++) {
+        if (cache_start_flusher(&sc->shard[i], fd) != 0) rc = -1;
+    }
+    return rc;
+}
+
+void cache_shared_destroy(cache_shared_t *sc, int fd) {
+    for (int i = 0; i < sc->nshards; i++) cache_destroy(&sc->shard[i], fd);
+    free(sc->shard);
+    sc->shard = NULL;
+    sc->nshards = 0;
+}
+
+int cache_shared_prefetch(cache_shared_t *sc, int fd, const uint64_t *offs, int n) {
+    // Consecutive offsets of one shard go in one call; a window crosses shards only at span edges
+    int loaded = 0;
+    for (int i = 0; i < n; ) {
+        cache_t *c = cache_shard(sc, offs[i]);
+        int j = i + 1;
+        while (j < n && cache_shard(sc, offs[j]) == c) j++;
+        loaded += cache_prefetch(c, fd, offs + i, j - i);
+        i = j;
+    }
+    return loaded;
+}
+
+int cache_shared_get_batch(cache_shared_t *sc, int fd, const uint64_t *offs, int n, char **pages, int write) {
+    // Gather each shard's offsets (keeping their order) and fetch them with one cache_get_batch
+    uint64_t soffs[CACHE_BATCH_MAX];
+    char *spages[CACHE_BATCH_MAX];
+    int sidx[CACHE_BATCH_MAX];
+    char done[CACHE_BATCH_MAX];
+    int got = 0;
+    for (int base = 0; base < n; base += CACHE_BATCH_MAX) {
+        int m = n - base < CACHE_BATCH_MAX ? n - base : CACHE_BATCH_MAX;
+        memset(done, 0, (size_t)m);
+        for (int i = 0; i < m; i++) {
+            if (done[i]) continue;
+            cache_t *c = cache_shard(sc, offs[base + i]);
+            int k = 0;
+            for (int j = i; j < m; j++) {
+                if (done[j] || cache_shard(sc, offs[base + j]) != c) continue;
+                done[j] = 1;
+                soffs[k] = offs[base + j];
+                sidx[k++] = base + j;
             }
-            free(e);
-            e = n;
+            got += cache_get_batch(c, fd, soffs, k, spages, write);
+            for (int j = 0; j < k; j++) pages[sidx[j]] = spages[j];
         }
-        c->hash[i] = NULL;
-        pthread_mutex_unlock(&c->mutex[mg]);
     }
-    for (int i = 0; i < MUTEX_GROUPS; i++) {
-        pthread_mutex_destroy(&c->mutex[i]);
+    return got;
+}
+
+void cache_shared_unpin_batch(cache_shared_t *sc, const uint64_t *offs, char *const *pages, int n) {
+    for (int i = 0; i < n; i++) {
+        if (pages[i]) cache_unpin(cache_shard(sc, offs[i]), pages[i]);
     }
-    pthread_mutex_destroy(&c->lru_mutex);
-    c->lru_head = NULL;
-    c->lru_tail = NULL;
-    c->entry_count = 0;
-    log_cache_message("INFO", "Cache destroyed");
+}
+
+// Split [start, start + npages pages) at shard span edges
+static int shard_run(const cache_shared_t *sc, uint64_t off, int npages) {
+    uint64_t left = (sc->shard_span - off % sc->shard_span + PAGE_SIZE - 1) / PAGE_SIZE;
+    return left < (uint64_t)npages ? (int)left : npages;
+}
+
+int cache_shared_prefetch_range(cache_shared_t *sc, int fd, uint64_t start, int npages) {
+    int loaded = 0;
+    while (npages > 0) {
+        int m = shard_run(sc, start, npages);
+        loaded += cache_prefetch_range(cache_shard(sc, start), fd, start, m);
+        start += (uint64_t)m * PAGE_SIZE;
+        npages -= m;
+    }
+    return loaded;
+}
+
+int cache_shared_flush_range(cache_shared_t *sc, int fd, uint64_t start, int npages) {
+    int written = 0;
+    while (npages > 0) {
+        int m = shard_run(sc, start, npages);
+        written += cache_flush_range(cache_shard(sc, start), fd, start, m);
+        start += (uint64_t)m * PAGE_SIZE;
+        npages -= m;
+    }
+    return written;
 }
@@ -1,51 +1,288 @@
-#ifndef CACHE_H
-#define CACHE_H
-
-#include <stdint.h>
-#include <stddef.h>
-#include <unistd.h>
-#include <stdlib.h>
-#include <string.h>
-#include <fcntl.h>
-#include <pthread.h>
-
-// Константы
-#include "config.h"
-
-#ifndef PAGE_SIZE
-#define PAGE_SIZE BLOCK_SIZE
-#endif
-#ifndef HASH_SIZE
-#define HASH_SIZE 2048
-#endif
-#ifndef MUTEX_GROUPS
-#define MUTEX_GROUPS 16
-#endif
-#ifndef MAX_CACHE_ENTRIES
-#define MAX_CACHE_ENTRIES 1024
-#endif
-
-typedef struct cache_entry {
-    uint64_t offset;
-    char data[PAGE_SIZE];
-    int dirty;
-    time_t last_access;
-    struct cache_entry *next;
-    struct cache_entry *prev;
-} cache_entry_t;
-
-typedef struct {
-    cache_entry_t *hash[HASH_SIZE];
-    pthread_mutex_t mutex[MUTEX_GROUPS];
-    pthread_mutex_t lru_mutex;
-    cache_entry_t *lru_head;
-    cache_entry_t *lru_tail;
-    size_t entry_count;
-} cache_t;
-
-void cache_init(cache_t *c);
-char* cache_get(cache_t *c, int fd, uint64_t offset, int write);
-void cache_evict(cache_t *c, int fd);
-void cache_destroy(cache_t *c, int fd);
-
-#endif // CACHE_H
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Константы
+#include "config.h"
+#include "extent.h"
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE BLOCK_SIZE
+#endif
+#ifndef HASH_SIZE
+#define HASH_SIZE 0                 // бакетов индекса на кэш; 0 — степень двойки не меньше числа кадров
+#endif
+#ifndef MUTEX_GROUPS
+#define MUTEX_GROUPS 16             // полос блокировок на кэш (округляется до степени двойки)
+#endif
+#ifndef MAX_CACHE_ENTRIES
+#define MAX_CACHE_ENTRIES 1024
+#endif
+
+// Число кадров арены: ограничено и MAX_CACHE_ENTRIES, и бюджетом CACHE_MB
+#define CACHE_ARENA_PAGES \
+    ((size_t)MAX_CACHE_ENTRIES < ((size_t)CACHE_MB * 1024 * 1024) / PAGE_SIZE ? \
+     (size_t)MAX_CACHE_ENTRIES : ((size_t)CACHE_MB * 1024 * 1024) / PAGE_SIZE)
+
+#ifndef CACHE_SHARDS_MAX
+#define CACHE_SHARDS_MAX 64
+#endif
+// Кадров на шард общего кэша: бюджет CACHE_MB делится между шардами, а не умножается на них
+#define CACHE_SHARD_PAGES(n) \
+    ((size_t)MAX_CACHE_ENTRIES < ((size_t)CACHE_MB * 1024 * 1024) / PAGE_SIZE / (size_t)(n) ? \
+     (size_t)MAX_CACHE_ENTRIES : ((size_t)CACHE_MB * 1024 * 1024) / PAGE_SIZE / (size_t)(n))
+
+#define CACHE_NIL UINT32_MAX   // конец цепочки бакета
+
+// Политика вытеснения, выбирается при инициализации
+typedef enum {
+    CACHE_POLICY_CLOCK = 0,     // CLOCK (приближение LRU)
+    CACHE_POLICY_2Q             // 2Q: FIFO A1in + призраки A1out + CLOCK для Am, устойчив к сканам
+} cache_policy_t;
+
+// Очередь кадра в 2Q
+enum {
+    CACHE_Q_MAIN = 0,           // Am (и все кадры при CLOCK)
+    CACHE_Q_IN                  // A1in: страницы, увиденные впервые
+};
+
+// Состояние кадра: FREE -> LOADING -> RESIDENT -> EVICTING -> FREE
+enum {
+    CACHE_FRAME_FREE = 0,
+    CACHE_FRAME_LOADING,
+    CACHE_FRAME_RESIDENT,
+    CACHE_FRAME_EVICTING
+};
+
+// Метаданные страницы; сами данные лежат в кадре арены (entries[i] <-> кадр i)
+typedef struct cache_entry {
+    _Atomic uint64_t offset;
+    char *data;
+    atomic_int dirty;
+    atomic_int state;
+    atomic_int pins;            // удержания; кадр с pins > 0 не вытесняется
+    atomic_int access;          // доступ к содержимому закреплённого кадра: > 0 — читают, -1 — меняют на месте
+    _Atomic uint32_t hnext;     // следующий кадр в цепочке бакета (только индекс)
+    _Atomic uint8_t queue;      // CACHE_Q_*
+    _Atomic uint8_t prefetched; // загружен упреждающим чтением и ещё не запрошен
+} cache_entry_t;
+
+#ifndef CACHE_PREFETCH_MAX
+#define CACHE_PREFETCH_MAX 32       // страниц за один вызов cache_prefetch
+#endif
+#ifndef CACHE_BATCH_MAX
+#define CACHE_BATCH_MAX 64          // страниц за один проход cache_get_batch (не меньше CACHE_PREFETCH_MAX)
+#endif
+
+// Фоновый сброс грязных страниц: будим флашер на верхней отметке, сбрасываем до нижней
+#ifndef CACHE_DIRTY_HIGH_PCT
+#define CACHE_DIRTY_HIGH_PCT 50
+#endif
+#ifndef CACHE_DIRTY_LOW_PCT
+#define CACHE_DIRTY_LOW_PCT 25
+#endif
+#ifndef CACHE_FLUSH_BATCH
+#define CACHE_FLUSH_BATCH 256       // страниц за один проход (не больше IOV_MAX)
+#endif
+#ifndef CACHE_FLUSH_INTERVAL_MS
+#define CACHE_FLUSH_INTERVAL_MS 100
+#endif
+// После неудачного пакета флашер ждёт, удваивая паузу от CACHE_FLUSH_INTERVAL_MS до этого предела
+#ifndef CACHE_FLUSH_BACKOFF_MAX_MS
+#define CACHE_FLUSH_BACKOFF_MAX_MS 5000
+#endif
+#ifndef CACHE_ERROR_LOG_MS
+#define CACHE_ERROR_LOG_MS 1000     // не больше одного сообщения об ошибке записи за интервал, остальные считаются
+#endif
+
+// Копировать вытесненные страницы в кольцо ring_cache (и искать в нём при промахе);
+// 0 — без кольца: вытеснение не делает последней копии страницы
+#ifndef CACHE_RING_VICTIMS
+#define CACHE_RING_VICTIMS 1
+#endif
+
+// Грязная страница, отобранная для сброса (сортируется по смещению)
+typedef struct {
+    uint64_t offset;
+    uint32_t idx;
+} cache_flush_item_t;
+
+#ifndef CACHE_STATS_SHARDS
+#define CACHE_STATS_SHARDS 64   // слотов счётчиков; поток получает свой слот при первом обращении
+#endif
+
+// Сводная статистика кэша (результат cache_stats_snapshot)
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t writebacks;        // грязные страницы, записанные на диск
+    uint64_t read_errors;
+    uint64_t write_errors;
+    uint64_t prefetch_issued;   // страниц загружено упреждающим чтением
+    uint64_t prefetch_hits;     // из них запрошено до вытеснения
+    uint64_t prefetch_wasted;   // вытеснено без единого обращения
+    uint64_t ring_hits;         // промахи, обслуженные кольцом вытесненных страниц (ring_cache)
+} cache_stats_t;
+
+// Счётчики одного потока, по строке кэша на слот, чтобы ядра не делили линию
+typedef struct {
+    _Alignas(64) _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+    _Atomic uint64_t evictions;
+    _Atomic uint64_t writebacks;
+    _Atomic uint64_t read_errors;
+    _Atomic uint64_t write_errors;
+    _Atomic uint64_t prefetch_issued;
+    _Atomic uint64_t prefetch_hits;
+    _Atomic uint64_t prefetch_wasted;
+    _Atomic uint64_t ring_hits;
+} cache_stats_shard_t;
+
+// Полоса блокировок: мьютекс для писателей + seqlock для читателей без блокировок
+typedef struct {
+    _Alignas(64) pthread_mutex_t mutex;
+    atomic_uint seq;
+} cache_stripe_t;
+
+// Размеры одного кэша (шарда), задаются при инициализации; нули — по умолчанию
+typedef struct {
+    size_t frames;              // кадров арены
+    size_t buckets;             // бакетов индекса; 0 — HASH_SIZE, если и он 0 — по frames
+    size_t stripes;             // полос блокировок; 0 — MUTEX_GROUPS
+} cache_geometry_t;
+
+typedef struct {
+    _Atomic uint32_t *hash;
+    size_t hash_mask;           // бакетов — степень двойки
+    cache_stripe_t *stripe;
+    size_t stripe_mask;
+    atomic_size_t entry_count;
+    // Арена: выровненные по странице кадры одним блоком + компактный массив метаданных
+    char *arena;
+    cache_entry_t *entries;
+    size_t capacity;
+    // CLOCK: биты обращений отдельно от индекса, попадание ставит бит без блокировок
+    _Atomic uint8_t *ref;
+    atomic_size_t clock_hand;
+    // 2Q: очередь A1in и кольцо призраков A1out (смещения недавно вытесненных из A1in)
+    cache_policy_t policy;
+    pthread_mutex_t policy_mutex;   // только промах/вытеснение, попадания его не берут
+    uint32_t *in_fifo;
+    size_t in_head, in_count, in_max;
+    uint64_t *ghost;
+    uint32_t *ghost_next;
+    uint32_t *ghost_bucket;
+    size_t ghost_head, ghost_count, ghost_max, ghost_mask;
+    // Флашер: пишет грязные страницы вне критических секций поиска
+    atomic_size_t dirty_count;
+    size_t dirty_high, dirty_low;
+    atomic_int flusher_running;
+    atomic_int flush_kicked;
+    int flush_urgent;
+    int flush_fd;
+    size_t flush_cursor;
+    cache_flush_item_t *flush_items;
+    pthread_t flusher;
+    pthread_mutex_t flush_mutex;
+    pthread_cond_t flush_wake;
+    pthread_cond_t flush_done;
+    _Atomic uint64_t error_logged_ms;   // когда выведено последнее сообщение об ошибке записи
+    atomic_uint errors_suppressed;      // ошибок записи с тех пор, не выведенных
+    cache_stats_shard_t stats[CACHE_STATS_SHARDS];
+    // Хранилище экстентов: промахи читаются, грязные страницы пишутся через него (NULL — прямо в fd)
+    extent_store_t *store;
+    int ring_victims;               // CACHE_RING_VICTIMS; можно сменить до первого cache_get
+    // Lock-free стек свободных кадров: индекс+1 в младших 32 битах, счётчик ABA в старших
+    _Atomic uint64_t free_head;
+    _Atomic uint32_t *free_next;
+} cache_t;
+
+// Общий кэш процесса: шарды по смещению, каждый со своей ареной, полосами и флашером.
+// Шард i обслуживает смещения [k * span, (k + 1) * span) с k % nshards == i
+typedef struct {
+    cache_t *shard;
+    int nshards;
+    uint64_t shard_span;
+} cache_shared_t;
+
+int cache_init(cache_t *c);
+int cache_init_policy(cache_t *c, cache_policy_t policy);
+// Кэш на frames кадров (cache_init_policy берёт CACHE_ARENA_PAGES)
+int cache_init_frames(cache_t *c, cache_policy_t policy, size_t frames);
+int cache_init_geometry(cache_t *c, cache_policy_t policy, const cache_geometry_t *geo);
+// Указатель без гарантии времени жизни: в общем кэше кадр может вытеснить другое ядро
+char* cache_get(cache_t *c, int fd, uint64_t offset, int write);
+// Закреплённая страница: не вытесняется до cache_unpin, её можно менять на месте.
+// Закрепления считаются, каждому cache_pin — свой cache_unpin; NULL при ошибке чтения
+char* cache_pin(cache_t *c, int fd, uint64_t offset, int write);
+void cache_unpin(cache_t *c, const char *page);
+// Закрепление для изменения на месте: ждёт, пока страницу читают (флашер, cache_read) или меняют другие,
+// и не пускает их до cache_unpin_exclusive; флашер такую страницу пропускает
+char* cache_pin_exclusive(cache_t *c, int fd, uint64_t offset);
+void cache_unpin_exclusive(cache_t *c, const char *page);
+// Страница изменена на месте и должна попасть в хранилище; вызывать после записи, до cache_unpin
+void cache_mark_dirty(cache_t *c, const char *page);
+// Копирует страницу в out (загружая при промахе) под закреплением; 0 или -1 при ошибке чтения
+int cache_read(cache_t *c, int fd, uint64_t offset, char *out);
+// Заменяет содержимое страницы, если она в кэше, не помечая её грязной (копия уже в хранилище);
+// возвращает 1, если страница была обновлена
+int cache_update(cache_t *c, uint64_t offset, const char *data);
+void cache_evict(cache_t *c, int fd);
+int cache_start_flusher(cache_t *c, int fd);
+// Подключает хранилище экстентов; вызывать до первого cache_get
+void cache_attach_store(cache_t *c, extent_store_t *store);
+// Загружает отсутствующие страницы одним пакетом чтений; возвращает число загруженных
+int cache_prefetch(cache_t *c, int fd, const uint64_t *offs, int n);
+// Пакет страниц: попадания без блокировок, промахи публикуются под каждым мьютексом полосы
+// один раз, соседние промахи читаются одним векторным запросом (preadv / пакет io_uring).
+// pages[i] — закреплённая страница offs[i] или NULL при ошибке; возвращает число полученных
+int cache_get_batch(cache_t *c, int fd, const uint64_t *offs, int n, char **pages, int write);
+// Снимает закрепления cache_get_batch (NULL пропускаются)
+void cache_unpin_batch(cache_t *c, char *const *pages, int n);
+// Прогрев: загружает страницы пакетами cache_get_batch без удержаний; main_queue — страницы
+// с повторными обращениями, под 2Q они попадают сразу в Am, а не в A1in. Возвращает число загруженных
+int cache_warm_batch(cache_t *c, int fd, const uint64_t *offs, int n, int main_queue);
+// Упреждающее чтение npages подряд с start
+int cache_prefetch_range(cache_t *c, int fd, uint64_t start, int npages);
+// Сбрасывает грязные страницы диапазона: один pwritev на непрерывный участок
+// (или одна дозапись пакета в журнал экстентов); возвращает число записанных
+int cache_flush_range(cache_t *c, int fd, uint64_t start, int npages);
+void cache_destroy(cache_t *c, int fd);
+void cache_stats_snapshot(const cache_t *c, cache_stats_t *out);
+// Обнуляет статистику (после прогрева: она снова описывает только рабочую нагрузку)
+void cache_stats_reset(cache_t *c);
+// Смещения страниц, находящихся в кэше, не больше max; возвращает их число.
+// Для снимка тёплого кэша: вызывать, когда потоки ядер остановлены
+size_t cache_resident_offsets(const cache_t *c, uint64_t *offs, size_t max);
+
+int cache_shared_init(cache_shared_t *sc, int nshards, uint64_t shard_span, cache_policy_t policy);
+// Шарды заданного размера (geo — на один шард) вместо CACHE_SHARD_PAGES
+int cache_shared_init_geometry(cache_shared_t *sc, int nshards, uint64_t shard_span, cache_policy_t policy,
+                               const cache_geometry_t *geo);
+void cache_shared_attach_store(cache_shared_t *sc, extent_store_t *store);
+int cache_shared_start_flusher(cache_shared_t *sc, int fd);
+// Упреждающее чтение: каждое смещение загружается в свой шард
+int cache_shared_prefetch(cache_shared_t *sc, int fd, const uint64_t *offs, int n);
+// Пакетные варианты общего кэша: смещения группируются по шардам, каждый шард — один вызов
+int cache_shared_get_batch(cache_shared_t *sc, int fd, const uint64_t *offs, int n, char **pages, int write);
+void cache_shared_unpin_batch(cache_shared_t *sc, const uint64_t *offs, char *const *pages, int n);
+int cache_shared_prefetch_range(cache_shared_t *sc, int fd, uint64_t start, int npages);
+int cache_shared_flush_range(cache_shared_t *sc, int fd, uint64_t start, int npages);
+// Останавливает флашеры и записывает грязные страницы всех шардов
+void cache_shared_destroy(cache_shared_t *sc, int fd);
+
+// Шард, которому принадлежит смещение
+static inline cache_t *cache_shard(cache_shared_t *sc, uint64_t offset) {
+    return &sc->shard[(offset / sc->shard_span) % (uint64_t)sc->nshards];
+}
+
+#endif // CACHE_H
@@ -1,52 +1,468 @@
 #include "compress.h"
+#include "config.h"
+#include "metrics.h"
 #include <zstd.h>
+#include <zstd_errors.h>
+#include <zdict.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-// Calculate Shannon entropy of the input data to determine compressibility
-static double calculate_entropy(const char *data, size_t sz) {
-    if (sz == 0) return 0.0;
-    unsigned int freq[256] = {0};
-    for (size_t i = 0; i < sz; i++) {
-        freq[(unsigned char)data[i]]++;
-    }
-    double entropy = 0.0;
-    for (int i = 0; i < 256; i++) {
-        if (freq[i] > 0) {
-            double p = (double)freq[i] / sz;
-            entropy -= p * log2(p);
+#ifdef PSEUDO_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#define COMPRESS_LEVELS 23 // уровни ZSTD 1..22; индекс 0 не используется
+
+// Контексты потока: создаются один раз и переиспользуются для каждой страницы
+typedef struct {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    int level;              // уровень, уже выставленный в cctx
+    void *lz4_state;        // состояние LZ4_compress_fast_extState
+    double ratio[COMPRESS_CODECS]; // сглаженный коэффициент сжатия по кодекам (0 — нет истории)
+    unsigned hot_skipped;   // горячих страниц подряд, сохранённых без попытки сжатия
+} compress_ctx_t;
+
+static _Thread_local compress_ctx_t *tctx;
+static pthread_key_t ctx_key;
+static pthread_once_t ctx_key_once = PTHREAD_ONCE_INIT;
+
+// Словарь процесса; CDict строится лениво на каждый используемый уровень
+static void *dict_buf;
+static size_t dict_len;
+static ZSTD_DDict *ddict;
+static _Atomic(ZSTD_CDict*) cdicts[COMPRESS_LEVELS];
+static pthread_mutex_t dict_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void ctx_free(void *v) {
+    compress_ctx_t *t = v;
+    if (!t) return;
+    ZSTD_freeCCtx(t->cctx);
+    ZSTD_freeDCtx(t->dctx);
+    free(t->lz4_state);
+    free(t);
+}
+
+static void ctx_key_create(void) {
+    pthread_key_create(&ctx_key, ctx_free);
+}
+
+static compress_ctx_t *ctx_get(void) {
+    if (tctx) return tctx;
+    pthread_once(&ctx_key_once, ctx_key_create);
+    compress_ctx_t *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->cctx = ZSTD_createCCtx();
+    t->dctx = ZSTD_createDCtx();
+    if (!t->cctx || !t->dctx) {
+        fprintf(stderr, "Failed to allocate ZSTD contexts\n");
+        ctx_free(t);
+        return NULL;
+    }
+#ifdef PSEUDO_HAVE_LZ4
+    t->lz4_state = malloc((size_t)LZ4_sizeofState());
+    if (!t->lz4_state) {
+        ctx_free(t);
+        return NULL;
+    }
+#endif
+    // Frame settings are fixed for every page; only the level changes between calls
+    ZSTD_CCtx_setParameter(t->cctx, ZSTD_c_checksumFlag, 0);
+    ZSTD_CCtx_setParameter(t->cctx, ZSTD_c_contentSizeFlag, 1);
+    pthread_setspecific(ctx_key, t);
+    tctx = t;
+    return t;
+}
+
+_Static_assert(COMPRESS_PROBE_SAMPLE / 4 < 65536, "probe histogram banks are 16-bit");
+
+static float clog_table[COMPRESS_PROBE_SAMPLE + 1]; // c * log2(c)
+static pthread_once_t clog_once = PTHREAD_ONCE_INIT;
+
+static void clog_table_init(void) {
+    for (int c = 1; c <= COMPRESS_PROBE_SAMPLE; c++) clog_table[c] = (float)(c * log2((double)c));
+}
+
+static int page_constant(const char *in, size_t sz) {
+    if (sz == 0) return 1;
+    uint64_t pattern;
+    memset(&pattern, (unsigned char)in[0], sizeof(pattern));
+    // Branch once per 64 bytes so the inner loop vectorizes
+    size_t i = 0;
+    for (; i + 64 <= sz; i += 64) {
+        uint64_t diff = 0;
+        for (int k = 0; k < 8; k++) {
+            uint64_t w;
+            memcpy(&w, in + i + k * 8, sizeof(w));
+            diff |= w ^ pattern;
         }
+        if (diff) return 0;
     }
-    return entropy;
+    for (; i < sz; i++) {
+        if (in[i] != in[0]) return 0;
+    }
+    return 1;
 }
 
-// Determine adaptive compression level based on data entropy
-static int determine_compression_level(double entropy) {
-    // Entropy range: 0 (highly compressible) to 8 (random data)
-    if (entropy < 4.0) return 1; // Low level for highly ordered data
-    else if (entropy < 6.0) return 3; // Medium level for moderately ordered data
-    else return 5; // High level for random or high-entropy data
+// Histogram of evenly spaced chunks; four banks so consecutive bytes do not stall on one counter
+static size_t sample_histogram(const char *in, size_t sz, uint32_t freq[256]) {
+    uint16_t bank[4][256];
+    memset(bank, 0, sizeof(bank));
+    size_t chunks = COMPRESS_PROBE_SAMPLE / COMPRESS_PROBE_CHUNK;
+    size_t stride = sz / chunks;
+    size_t chunk = COMPRESS_PROBE_CHUNK;
+    if (sz <= COMPRESS_PROBE_SAMPLE) {
+        chunks = 1;
+        stride = 0;
+        chunk = sz & ~(size_t)3;
+    }
+    size_t n = 0;
+    for (size_t k = 0; k < chunks; k++) {
+        const char *p = in + k * stride;
+        for (size_t i = 0; i < chunk; i += 4) {
+            uint32_t w;
+            memcpy(&w, p + i, sizeof(w));
+            bank[0][w & 0xff]++;
+            bank[1][(w >> 8) & 0xff]++;
+            bank[2][(w >> 16) & 0xff]++;
+            bank[3][w >> 24]++;
+        }
+        n += chunk;
+    }
+    for (int i = 0; i < 256; i++) freq[i] = bank[0][i] + bank[1][i] + bank[2][i] + bank[3][i];
+    return n;
 }
 
-int compress_page(const char *in, size_t sz, char *out, int lvl) {
-    // If lvl is 0, calculate adaptive level based on entropy
-    if (lvl == 0) {
-        double entropy = calculate_entropy(in, sz);
-        lvl = determine_compression_level(entropy);
+void compress_probe(const char *in, size_t sz, compress_probe_t *p) {
+    if (page_constant(in, sz)) {
+        p->kind = COMPRESS_PROBE_CONSTANT;
+        p->entropy = 0.0;
+        return;
+    }
+    pthread_once(&clog_once, clog_table_init);
+    uint32_t freq[256];
+    size_t n = sample_histogram(in, sz, freq);
+    if (n == 0) {
+        p->kind = COMPRESS_PROBE_COMPRESSIBLE;
+        p->entropy = 8.0;
+        return;
+    }
+    // H = log2(n) - sum(c * log2 c) / n, both terms from the table
+    float sum = 0.0f;
+    for (int i = 0; i < 256; i++) sum += clog_table[freq[i]];
+    p->entropy = (clog_table[n] - sum) / (double)n;
+    p->kind = p->entropy >= COMPRESS_RAW_ENTROPY ? COMPRESS_PROBE_INCOMPRESSIBLE : COMPRESS_PROBE_COMPRESSIBLE;
+}
+
+int compress_choose_level(const compress_probe_t *p) {
+    if (p->kind == COMPRESS_PROBE_INCOMPRESSIBLE) return 0;
+    if (p->kind == COMPRESS_PROBE_CONSTANT) return COMPRESSION_MIN_LVL;
+    // Entropy bands: ordered data compresses well at the lowest level, denser data needs more effort
+    int band = p->entropy < 4.0 ? 0 : p->entropy < 6.0 ? 1 : 2;
+    // Recent pages of this thread compressed poorly: try one band harder
+    compress_ctx_t *t = ctx_get();
+    if (t && t->ratio[COMPRESS_CODEC_ZSTD] > COMPRESSION_ADAPTIVE_THRESHOLD && band < 2) band++;
+    if (band == 0) return COMPRESSION_MIN_LVL;
+    if (band == 1) return (COMPRESSION_MIN_LVL + COMPRESSION_MAX_LVL) / 2;
+    return COMPRESSION_MAX_LVL;
+}
+
+// Smoothed compressed/original ratio of the thread's recent pages for one codec
+static void ratio_update(compress_ctx_t *t, compress_codec_t codec, double ratio) {
+    double *r = &t->ratio[codec];
+    *r = *r == 0.0 ? ratio : *r * 0.875 + ratio * 0.125;
+}
+
+// CDict for one level, built on first use; the dictionary must already be loaded
+static const ZSTD_CDict *cdict_for_level(int lvl) {
+    ZSTD_CDict *cd = atomic_load_explicit(&cdicts[lvl], memory_order_acquire);
+    if (cd) return cd;
+    pthread_mutex_lock(&dict_mutex);
+    cd = atomic_load_explicit(&cdicts[lvl], memory_order_relaxed);
+    if (!cd && dict_buf) {
+        cd = ZSTD_createCDict(dict_buf, dict_len, lvl);
+        atomic_store_explicit(&cdicts[lvl], cd, memory_order_release);
+    }
+    pthread_mutex_unlock(&dict_mutex);
+    return cd;
+}
+
+static int zstd_compress(compress_ctx_t *t, const char *in, size_t sz, char *out, int lvl) {
+    if (lvl < ZSTD_minCLevel()) lvl = ZSTD_minCLevel();
+    if (lvl >= COMPRESS_LEVELS) lvl = COMPRESS_LEVELS - 1;
+    size_t c;
+    // Negative (fast) levels are too cheap to benefit from a dictionary
+    const ZSTD_CDict *cd = ddict && lvl >= 1 ? cdict_for_level(lvl) : NULL;
+    if (cd) {
+        c = ZSTD_compress_usingCDict(t->cctx, out, sz, in, sz, cd);
+    } else {
+        if (t->level != lvl) {
+            ZSTD_CCtx_setParameter(t->cctx, ZSTD_c_compressionLevel, lvl);
+            t->level = lvl;
+        }
+        c = ZSTD_compress2(t->cctx, out, sz, in, sz);
     }
-    size_t c = ZSTD_compress(out, ZSTD_compressBound(sz), in, sz, lvl);
     if (ZSTD_isError(c)) {
+        // Output capacity is the page size: a page that does not shrink is not an error
+        if (ZSTD_getErrorCode(c) == ZSTD_error_dstSize_tooSmall) return 0;
         fprintf(stderr, "ZSTD compression error: %s\n", ZSTD_getErrorName(c));
         return -1;
     }
     return (int)c;
 }
 
-int decompress_page(const char *in, size_t sz, char *out) {
-    size_t d = ZSTD_decompress(out, sz, in, sz);
+static int lz4_compress(compress_ctx_t *t, const char *in, size_t sz, char *out, int lvl) {
+#ifdef PSEUDO_HAVE_LZ4
+    // lvl is the LZ4 acceleration factor; a zero return means the page did not fit into sz bytes
+    return LZ4_compress_fast_extState(t->lz4_state, in, out, (int)sz, (int)sz, lvl > 0 ? lvl : 1);
+#else
+    (void)t; (void)in; (void)sz; (void)out; (void)lvl;
+    return -1;
+#endif
+}
+
+int compress_codec_available(compress_codec_t codec) {
+    switch (codec) {
+    case COMPRESS_CODEC_NONE:
+    case COMPRESS_CODEC_ZSTD:
+        return 1;
+    case COMPRESS_CODEC_LZ4:
+#ifdef PSEUDO_HAVE_LZ4
+        return 1;
+#else
+        return 0;
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char *compress_codec_name(compress_codec_t codec) {
+    switch (codec) {
+    case COMPRESS_CODEC_NONE: return "none";
+    case COMPRESS_CODEC_ZSTD: return "zstd";
+    case COMPRESS_CODEC_LZ4: return "lz4";
+    default: return "unknown";
+    }
+}
+
+int compress_page_codec(compress_codec_t codec, const char *in, size_t sz, char *out, int lvl) {
+    compress_ctx_t *t = ctx_get();
+    if (!t) return -1;
+    uint64_t t0 = metrics_now();
+    int c;
+    switch (codec) {
+    case COMPRESS_CODEC_NONE:
+        return 0;
+    case COMPRESS_CODEC_ZSTD:
+        // If lvl is 0, the probe picks the level or decides to keep the page raw
+        if (lvl == 0) {
+            compress_probe_t probe;
+            compress_probe(in, sz, &probe);
+            lvl = compress_choose_level(&probe);
+            if (lvl == 0) {
+                ratio_update(t, codec, 1.0);
+                return 0;
+            }
+        }
+        c = zstd_compress(t, in, sz, out, lvl);
+        break;
+    case COMPRESS_CODEC_LZ4:
+        c = lz4_compress(t, in, sz, out, lvl);
+        break;
+    default:
+        return -1;
+    }
+    metrics_record(METRIC_COMPRESS, t0);
+    if (c >= 0) ratio_update(t, codec, c > 0 ? (double)c / (double)sz : 1.0);
+    return c;
+}
+
+int compress_page(const char *in, size_t sz, char *out, int lvl) {
+    return compress_page_codec(COMPRESS_CODEC_ZSTD, in, sz, out, lvl);
+}
+
+compress_codec_t compress_choose_codec(const compress_probe_t *p, int hotness) {
+    if (p->kind == COMPRESS_PROBE_INCOMPRESSIBLE) return COMPRESS_CODEC_NONE;
+    if (hotness < COMPRESS_HOT_THRESHOLD || p->kind == COMPRESS_PROBE_CONSTANT) return COMPRESS_CODEC_ZSTD;
+    // Hot pages get the fast codec, unless it has recently been saving too little to pay for itself;
+    // every COMPRESS_HOT_RETRY-th such page is still tried so the estimate can recover
+    compress_codec_t fast = compress_codec_available(COMPRESS_CODEC_LZ4) ? COMPRESS_CODEC_LZ4 : COMPRESS_CODEC_ZSTD;
+    compress_ctx_t *t = ctx_get();
+    if (t && t->ratio[fast] > COMPRESS_HOT_RAW_RATIO && ++t->hot_skipped % COMPRESS_HOT_RETRY != 0) {
+        return COMPRESS_CODEC_NONE;
+    }
+    return fast;
+}
+
+int compress_page_auto(const char *in, size_t sz, char *out, int hotness, compress_codec_t *codec, int *level) {
+    compress_probe_t probe;
+    compress_probe(in, sz, &probe);
+    compress_codec_t cc = compress_choose_codec(&probe, hotness);
+    int lvl = 0;
+    if (cc == COMPRESS_CODEC_ZSTD) {
+        lvl = hotness >= COMPRESS_HOT_THRESHOLD && probe.kind != COMPRESS_PROBE_CONSTANT ?
+              COMPRESS_FAST_ZSTD_LEVEL : compress_choose_level(&probe);
+        if (lvl == 0) cc = COMPRESS_CODEC_NONE;
+    } else if (cc == COMPRESS_CODEC_LZ4) {
+        lvl = 1;
+    }
+    int c = compress_page_codec(cc, in, sz, out, lvl);
+    if (c <= 0) {
+        cc = COMPRESS_CODEC_NONE;
+        lvl = 0;
+    }
+    *codec = cc;
+    *level = lvl;
+    return c;
+}
+
+int decompress_page_codec(compress_codec_t codec, const char *in, size_t sz, char *out, size_t out_cap) {
+    compress_ctx_t *t = ctx_get();
+    if (!t) return -1;
+    if (codec == COMPRESS_CODEC_NONE) {
+        if (sz > out_cap) return -1;
+        memcpy(out, in, sz);
+        return (int)sz;
+    }
+    if (codec == COMPRESS_CODEC_LZ4) {
+#ifdef PSEUDO_HAVE_LZ4
+        int d = LZ4_decompress_safe(in, out, (int)sz, (int)out_cap);
+        if (d < 0) fprintf(stderr, "LZ4 decompression error (%d)\n", d);
+        return d < 0 ? -1 : d;
+#else
+        fprintf(stderr, "LZ4 page found but LZ4 is not built in (make WITH_LZ4=1)\n");
+        return -1;
+#endif
+    }
+    if (codec != COMPRESS_CODEC_ZSTD) return -1;
+    uint64_t t0 = metrics_now();
+    size_t d = ddict ? ZSTD_decompress_usingDDict(t->dctx, out, out_cap, in, sz, ddict)
+                     : ZSTD_decompressDCtx(t->dctx, out, out_cap, in, sz);
+    metrics_record(METRIC_DECOMPRESS, t0);
     if (ZSTD_isError(d)) {
         fprintf(stderr, "ZSTD decompression error: %s\n", ZSTD_getErrorName(d));
         return -1;
     }
     return (int)d;
 }
+
+int decompress_page(const char *in, size_t sz, char *out, size_t out_cap) {
+    return decompress_page_codec(COMPRESS_CODEC_ZSTD, in, sz, out, out_cap);
+}
+
+int compress_has_dictionary(void) {
+    return ddict != NULL;
+}
+
+void compress_unload_dictionary(void) {
+    pthread_mutex_lock(&dict_mutex);
+    for (int i = 0; i < COMPRESS_LEVELS; i++) {
+        ZSTD_freeCDict(atomic_exchange(&cdicts[i], NULL));
+    }
+    ZSTD_freeDDict(ddict);
+    ddict = NULL;
+    free(dict_buf);
+    dict_buf = NULL;
+    dict_len = 0;
+    pthread_mutex_unlock(&dict_mutex);
+}
+
+int compress_load_dictionary(const void *dict, size_t len) {
+    if (!dict || len == 0) return -1;
+    compress_unload_dictionary();
+    void *copy = malloc(len);
+    if (!copy) return -1;
+    memcpy(copy, dict, len);
+    ZSTD_DDict *dd = ZSTD_createDDict(copy, len);
+    if (!dd) {
+        fprintf(stderr, "Failed to load ZSTD dictionary (%zu bytes)\n", len);
+        free(copy);
+        return -1;
+    }
+    pthread_mutex_lock(&dict_mutex);
+    dict_buf = copy;
+    dict_len = len;
+    ddict = dd;
+    pthread_mutex_unlock(&dict_mutex);
+    return 0;
+}
+
+int compress_load_dictionary_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    long sz = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    rewind(f);
+    char *buf = sz > 0 ? malloc((size_t)sz) : NULL;
+    size_t len = buf ? fread(buf, 1, (size_t)sz, f) : 0;
+    fclose(f);
+    int ret = len > 0 ? compress_load_dictionary(buf, len) : -1;
+    free(buf);
+    return ret;
+}
+
+int compress_save_dictionary(const char *path) {
+    if (!dict_buf) return -1;
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror("Error opening dictionary file");
+        return -1;
+    }
+    size_t w = fwrite(dict_buf, 1, dict_len, f);
+    if (fclose(f) != 0 || w != dict_len) {
+        fprintf(stderr, "Failed to write dictionary to %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int compress_train_dictionary(int fd, uint64_t size, size_t sample_pages, size_t dict_size) {
+    uint64_t pages = size / BLOCK_SIZE;
+    if (pages == 0 || sample_pages == 0) return -1;
+    if (sample_pages > pages) sample_pages = pages;
+    char *samples = malloc(sample_pages * BLOCK_SIZE);
+    size_t *sizes = malloc(sample_pages * sizeof(size_t));
+    void *dict = malloc(dict_size);
+    if (!samples || !sizes || !dict) {
+        free(samples);
+        free(sizes);
+        free(dict);
+        return -1;
+    }
+    // Evenly spaced pages across the image; empty and constant pages teach the dictionary nothing
+    unsigned n = 0;
+    uint64_t step = pages / sample_pages;
+    for (size_t i = 0; i < sample_pages; i++) {
+        char *dst = samples + (size_t)n * BLOCK_SIZE;
+        ssize_t r = pread(fd, dst, BLOCK_SIZE, (off_t)(i * step * BLOCK_SIZE));
+        if (r != BLOCK_SIZE || page_constant(dst, BLOCK_SIZE)) continue;
+        sizes[n++] = BLOCK_SIZE;
+    }
+    int ret = -1;
+    if (n < 8) {
+        fprintf(stderr, "Not enough non-empty pages to train a dictionary (%u)\n", n);
+    } else {
+        size_t len = ZDICT_trainFromBuffer(dict, dict_size, samples, sizes, n);
+        if (ZDICT_isError(len)) {
+            fprintf(stderr, "ZSTD dictionary training failed: %s\n", ZDICT_getErrorName(len));
+        } else {
+            ret = compress_load_dictionary(dict, len);
+        }
+    }
+    free(samples);
+    free(sizes);
+    free(dict);
+    return ret;
+}
+
+int compress_setup_dictionary(const char *path, int fd, uint64_t size) {
+    if (compress_load_dictionary_file(path) == 0) return 0;
+    if (compress_train_dictionary(fd, size, COMPRESS_DICT_SAMPLES, COMPRESS_DICT_SIZE) != 0) return -1;
+    compress_save_dictionary(path);
+    return 0;
+}
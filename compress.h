@@ -2,8 +2,91 @@
 #define COMPRESS_H
 
 #include <stddef.h>
+#include <stdint.h>
 
+#ifndef COMPRESS_DICT_SIZE
+#define COMPRESS_DICT_SIZE (16 * 1024)  // размер обучаемого словаря
+#endif
+#ifndef COMPRESS_DICT_SAMPLES
+#define COMPRESS_DICT_SAMPLES 2048      // страниц образца для обучения
+#endif
+
+#ifndef COMPRESS_PROBE_SAMPLE
+#define COMPRESS_PROBE_SAMPLE 1024      // байт страницы, по которым строится гистограмма пробы
+#endif
+#ifndef COMPRESS_PROBE_CHUNK
+#define COMPRESS_PROBE_CHUNK 64         // выборка берётся кусками, равномерно по странице
+#endif
+#ifndef COMPRESS_RAW_ENTROPY
+#define COMPRESS_RAW_ENTROPY 7.2        // бит/байт выборки, начиная с которых страница не сжимается
+#endif
+
+#ifndef COMPRESS_HOT_THRESHOLD
+#define COMPRESS_HOT_THRESHOLD 4        // обращений, после которых страница считается горячей
+#endif
+#ifndef COMPRESS_FAST_ZSTD_LEVEL
+#define COMPRESS_FAST_ZSTD_LEVEL (-3)   // быстрый уровень ZSTD для горячих страниц без LZ4
+#endif
+#ifndef COMPRESS_HOT_RAW_RATIO
+#define COMPRESS_HOT_RAW_RATIO 0.9      // быстрый кодек экономит меньше — горячие страницы хранятся как есть
+#endif
+#ifndef COMPRESS_HOT_RETRY
+#define COMPRESS_HOT_RETRY 16           // каждая N-я такая страница всё же сжимается для пересчёта
+#endif
+
+// Кодек страницы; значения записываются в заголовок экстента на диске
+typedef enum {
+    COMPRESS_CODEC_NONE = 0,
+    COMPRESS_CODEC_ZSTD = 1,
+    COMPRESS_CODEC_LZ4 = 2,             // сборка с WITH_LZ4=1
+    COMPRESS_CODECS
+} compress_codec_t;
+
+// Класс страницы по результату быстрой пробы
+enum {
+    COMPRESS_PROBE_CONSTANT = 0,        // все байты одинаковы, в том числе нулевая страница
+    COMPRESS_PROBE_COMPRESSIBLE,
+    COMPRESS_PROBE_INCOMPRESSIBLE       // хранить как есть, ZSTD не вызывается
+};
+
+typedef struct {
+    int kind;                           // COMPRESS_PROBE_*
+    double entropy;                     // оценка бит/байт по выборке
+} compress_probe_t;
+
+// Быстрая проба: ранний выход для постоянных страниц, иначе выборочная гистограмма
+void compress_probe(const char *in, size_t sz, compress_probe_t *p);
+// Единая политика уровня (COMPRESSION_MIN_LVL..COMPRESSION_MAX_LVL): проба и недавний
+// коэффициент сжатия потока; 0 — страницу хранить несжатой
+int compress_choose_level(const compress_probe_t *p);
+
+// Выбор кодека: несжимаемые — NONE, горячие (hotness — число обращений) — быстрый кодек, холодные — ZSTD
+compress_codec_t compress_choose_codec(const compress_probe_t *p, int hotness);
+int compress_codec_available(compress_codec_t codec);
+const char *compress_codec_name(compress_codec_t codec);
+
+// Сжатие страницы контекстом текущего потока; out вмещает sz байт.
+// Возвращает размер сжатых данных, 0 если страница не сжимается в sz байт, -1 при ошибке.
+// Для ZSTD lvl 0 — уровень по политике, для LZ4 lvl — коэффициент ускорения
+int compress_page_codec(compress_codec_t codec, const char *in, size_t sz, char *out, int lvl);
+// Кодек и уровень по пробе и горячести; при 0 страница хранится как есть (codec = NONE)
+int compress_page_auto(const char *in, size_t sz, char *out, int hotness, compress_codec_t *codec, int *level);
+// Распаковка sz сжатых байт в out ёмкостью out_cap; возвращает размер или -1
+int decompress_page_codec(compress_codec_t codec, const char *in, size_t sz, char *out, size_t out_cap);
+
+// Страница в ZSTD; lvl 0 — уровень по политике
 int compress_page(const char *in, size_t sz, char *out, int lvl);
-int decompress_page(const char *in, size_t sz, char *out);
+int decompress_page(const char *in, size_t sz, char *out, size_t out_cap);
+
+// Словарь ZSTD для мелких похожих страниц; загружать до запуска рабочих потоков
+int compress_load_dictionary(const void *dict, size_t len);
+int compress_load_dictionary_file(const char *path);
+int compress_save_dictionary(const char *path);
+// Обучение на sample_pages страницах, равномерно взятых из [0, size) файла fd
+int compress_train_dictionary(int fd, uint64_t size, size_t sample_pages, size_t dict_size);
+// Загрузить словарь из path, а если его нет — обучить на образе и сохранить
+int compress_setup_dictionary(const char *path, int fd, uint64_t size);
+int compress_has_dictionary(void);
+void compress_unload_dictionary(void);
 
 #endif // COMPRESS_H
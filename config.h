@@ -10,7 +10,15 @@
 #define COMPRESSION_MIN_LVL 1  // Минимальный уровень сжатия
 #define COMPRESSION_MAX_LVL 9  // Максимальный уровень сжатия
 #define COMPRESSION_ADAPTIVE_THRESHOLD 0.5 // Порог для адаптивного сжатия (коэффициент сжатия)
+#define CORE_CPUS    ""        // CPU для потоков ядер, например "0-3" или "0,2,4,6"; пусто — без привязки
+#define CORE_TRANSFORM "xor"   // преобразование блока в ядре (transform_register добавляет свои)
+#define CORE_WORKLOAD "seq"    // шаблон обращений: seq, uniform, zipf,theta=0.99, hotspot,hot=0.1,prob=0.9, replay,trace=путь; см. workload.h
+#define CORE_TRACE_RECORD ""   // файл для записи трассы обращений ядер; пусто — не записывать
 
 #define SWAP_IMG_PATH "./storage_swap.img"
+#define SWAP_LOG_PATH "./storage_swap.log"   // журнал сжатых экстентов
+#define SWAP_DICT_PATH "./storage_swap.dict" // словарь ZSTD, обученный на образе
+#define SWAP_WARM_PATH "./storage_swap.warm" // снимок тёплого кэша для быстрого перезапуска; пусто — без снимка
+#define DIRECT_IO 0            // 1 — образ и журнал через O_DIRECT: страницы только в cache_t, без копии в page cache ядра
 
 #endif // CONFIG_H
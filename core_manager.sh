@@ -13,13 +13,7 @@ if swapon --show | grep -q "$SWAP_IMG_PATH"; then
   rm -f "$LOG"; touch "$LOG"
 
   echo "[*] Compiling modules with LFS support..."
-  gcc -O3 -D_FILE_OFFSET_BITS=64 -pthread \
-      pseudo_core.c \
-          cache.c \
-              compress.c \
-                  ring_cache.c \
-                      scheduler.c \
-                          -o pseudo_core -lzstd
+  make pseudo_core
 
                           if [[ $? -ne 0 ]]; then
                               echo "[!] Compilation failed"
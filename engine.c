@@ -0,0 +1,592 @@
+// Движок PseudoCore: общий для основного бинарника и демона
+#include "engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <syslog.h>
+
+#include "compress.h"
+#include "ring_cache.h"
+#include "scheduler.h"
+#include "io_backend.h"
+#include "prefetch.h"
+#include "load_ctl.h"
+#include "affinity.h"
+#include "transform.h"
+#include "metrics.h"
+#include "warm.h"
+
+static void engine_logf(const engine_t *e, int prio, int core, const char *fmt, ...) {
+    char msg[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    e->log(prio, core, msg);
+}
+
+// Display system-wide performance statistics
+static void display_system_stats(const engine_t *e) {
+    char buf[512];
+    int n = snprintf(buf, sizeof(buf), "[SYSTEM STATS] Operations per Core: ");
+    for (int i = 0; i < e->cfg.cores && n > 0 && (size_t)n < sizeof(buf); i++) {
+        n += snprintf(buf + n, sizeof(buf) - (size_t)n, "Core %d: %lu ", i,
+                      atomic_load_explicit(&e->cores[i].ops, memory_order_relaxed));
+    }
+    e->log(LOG_INFO, -1, buf);
+}
+
+// Display cache statistics of the shard owned by one core (its segment, migrated or not)
+static void display_cache_stats(const engine_t *e, int core_id, const cache_t *cache) {
+    cache_stats_t st;
+    cache_stats_snapshot(cache, &st);
+    uint64_t total_requests = st.hits + st.misses;
+    double hit_ratio = total_requests > 0 ? (double)st.hits / total_requests * 100.0 : 0.0;
+    engine_logf(e, LOG_INFO, -1, "[CACHE STATS] Core %d: Hits: %lu, Misses: %lu, Hit Ratio: %.2f%%, "
+                "Ring hits: %lu, Evictions: %lu, Writebacks: %lu, Read errors: %lu, Write errors: %lu",
+                core_id, st.hits, st.misses, hit_ratio, st.ring_hits, st.evictions, st.writebacks,
+                st.read_errors, st.write_errors);
+    // Accuracy: share of read-ahead pages that were used; coverage: share of would-be misses they absorbed
+    double accuracy = st.prefetch_issued > 0 ? (double)st.prefetch_hits / st.prefetch_issued * 100.0 : 0.0;
+    double coverage = st.prefetch_hits + st.misses > 0 ?
+                      (double)st.prefetch_hits / (st.prefetch_hits + st.misses) * 100.0 : 0.0;
+    engine_logf(e, LOG_INFO, -1, "[PREFETCH STATS] Core %d: Issued: %lu, Used: %lu, Wasted: %lu, "
+                "Accuracy: %.2f%%, Coverage: %.2f%%",
+                core_id, st.prefetch_issued, st.prefetch_hits, st.prefetch_wasted, accuracy, coverage);
+}
+
+// Display the load controller verdict of the last window
+static void display_load_stats(const engine_t *e, int core_id, const loadctl_t *load) {
+    engine_logf(e, LOG_INFO, -1, "[LOAD STATS] Core %d: Mode: %s, Duty: %.0f%%, Ops/s: %.0f, p50: %lu us, p99: %lu us, "
+                "Backlog: %.0f%%, Pressure: %.1f%%, Queue: %d, Congested windows: %lu/%lu, Slept: %lu ms",
+                core_id, loadctl_mode_name(load->mode), load->duty * 100.0, load->ops_per_sec,
+                load->p50_ns / 1000, load->p99_ns / 1000, load->backlog * 100.0, load->pressure,
+                load->queue_depth, load->congested_windows, load->windows, load->slept_ns / 1000000);
+}
+
+// Display hit rate of the shared victim ring
+static void display_ring_stats(const engine_t *e) {
+    ring_cache_stats_t st;
+    ring_cache_stats(&st);
+    double hit_ratio = st.lookups > 0 ? (double)st.hits / st.lookups * 100.0 : 0.0;
+    double avg_size = st.inserts > 0 ? (double)st.bytes_inserted / st.inserts : 0.0;
+    // Capacity gain: pages held per page worth of ring memory
+    double gain = st.size > 0 ? (double)st.live_pages * BLOCK_SIZE / st.size : 0.0;
+    engine_logf(e, LOG_INFO, -1, "[RING STATS] Lookups: %lu, Hits: %lu, Hit Ratio: %.2f%%, Inserts: %lu, "
+                "Updates: %lu, Overwritten: %lu, Invalidated: %lu, Bypassed: %lu, "
+                "Avg stored: %.0f B, Live: %lu pages in %lu KB (%.2fx ring size)",
+                st.lookups, st.hits, hit_ratio, st.inserts, st.updates, st.overwritten, st.invalidations,
+                st.bypassed, avg_size, st.live_pages, st.live_bytes / 1024, gain);
+}
+
+// Display pipeline queue depths: the fullest queue sits in front of the slowest stage
+static void display_pipeline_stats(const engine_t *e) {
+    pipeline_stats_t st;
+    pipeline_stats(e->pipe_ptr, &st);
+    engine_logf(e, LOG_INFO, -1, "[PIPELINE STATS] Queues: free %zu, compress %zu, write %zu; Submitted: %lu, Compressed: %lu, "
+                "Written: %lu in %lu batches, Errors: %lu, Producer stalls: %lu, Shard stalls: %lu, In-flight waits: %lu, "
+                "Workers: %d compress, %d write",
+                st.free_items, st.compress_depth, st.write_depth, st.submitted, st.compressed, st.written,
+                st.write_batches, st.write_errors, st.producer_stalls, st.shard_stalls, st.inflight_waits, st.compress_workers, st.writers);
+}
+
+// Display latency percentiles of every instrumented operation, all threads together
+static void display_latency_stats(const engine_t *e) {
+    const metrics_shm_t *m = metrics_local();
+    if (!m) return;
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        metrics_summary_t s;
+        metrics_summarize(m, (metric_id_t)i, &s);
+        if (s.count == 0) continue;
+        engine_logf(e, LOG_INFO, -1, "[LATENCY STATS] %s: Count: %lu, Mean: %lu ns, p50: %lu ns, p99: %lu ns, "
+                    "p999: %lu ns, Max: %lu ns",
+                    metrics_name((metric_id_t)i), s.count, s.sum_ns / s.count, metrics_percentile(&s, 0.50),
+                    metrics_percentile(&s, 0.99), metrics_percentile(&s, 0.999), s.max_ns);
+    }
+}
+
+// Display space accounting of the extent store
+static void display_extent_stats(engine_t *e) {
+    extent_stats_t st;
+    extent_stats(&e->store, &st);
+    double ratio = st.bytes_stored > 0 ? (double)st.bytes_logical / st.bytes_stored : 0.0;
+    engine_logf(e, LOG_INFO, -1, "[EXTENT STATS] Pages written: %lu, Logical: %lu KB, Stored: %lu KB, Ratio: %.2f, "
+                "Raw: %lu, ZSTD: %lu, LZ4: %lu, Elided: %lu unchanged, %lu zero, %lu duplicate, "
+                "Segments used: %lu, free: %lu, cleaned: %lu, Live: %lu KB, Relocated: %lu KB",
+                st.pages_written, st.bytes_logical / 1024, st.bytes_stored / 1024, ratio,
+                st.pages_by_codec[COMPRESS_CODEC_NONE], st.pages_by_codec[COMPRESS_CODEC_ZSTD],
+                st.pages_by_codec[COMPRESS_CODEC_LZ4], st.pages_unchanged, st.pages_zero, st.pages_deduped,
+                st.segments_used, st.segments_free, st.segments_cleaned, st.live_bytes / 1024,
+                st.bytes_relocated / 1024);
+}
+
+// A task in a core's deque: the block offset with its hotness and the operation in the low bits
+#define TASK_HOT_MAX ((BLOCK_SIZE >> 1) - 1)
+#define TASK_MAKE(off, op, hot) ((off) | (uint64_t)((hot) < TASK_HOT_MAX ? (hot) : TASK_HOT_MAX) << 1 | (uint64_t)(op))
+#define TASK_OFFSET(t) ((t) & ~(uint64_t)(BLOCK_SIZE - 1))
+#define TASK_HOT(t) ((int)(((t) & (BLOCK_SIZE - 1)) >> 1))
+#define TASK_OP(t) ((workload_op_t)((t) & 1))
+
+// The next SCHED_REFILL accesses of the core's own stream into its deque, ordered by hotness:
+// cold blocks go in first, toward the top thieves steal from, hot ones last, so the owner pops them
+// first while they are cached. Each group is pushed newest first and pops in stream order;
+// returns how many (0: trace over)
+static int core_refill(engine_core_t *c, uint64_t seg_start, uint64_t seg_blocks) {
+    uint64_t tasks[SCHED_REFILL];
+    int n = 0;
+    while (n < SCHED_REFILL) {
+        uint64_t offset;
+        workload_op_t op;
+        if (workload_next(&c->gen, seg_start, seg_blocks, &offset, &op) != 0) break;
+        int hotness = scheduler_report_access(c->id, offset);
+        tasks[n++] = TASK_MAKE(offset, op, hotness);
+    }
+    int pushed = 0;
+    for (int hot = 0; hot < 2; hot++) {
+        for (int i = n; i-- > 0;) {
+            if ((TASK_HOT(tasks[i]) >= SCHED_KEEP_HOT) != hot) continue;
+            if (scheduler_push_task(c->id, tasks[i]) != 0) return pushed; // Deque full: the rest is dropped
+            pushed++;
+        }
+    }
+    return pushed;
+}
+
+// Core execution function running in a separate thread
+static void *core_run(void *v) {
+    engine_core_t *c = v;
+    engine_t *e = c->e;
+    const settings_t *cfg = &e->cfg;
+    uint64_t seg_size = e->seg_bytes;
+    // The shard holding this core's segment; migrated blocks are served by their own shard
+    cache_t *own = cache_shard(&e->cache, (uint64_t)c->id * seg_size);
+    // Owned shard's arena and scheduler state on the node of this core's CPU (the arena is populated at init)
+    if (c->node >= 0) {
+        if (affinity_bind_memory(own->arena, own->capacity * PAGE_SIZE, c->node) != 0) {
+            e->log(LOG_WARNING, c->id, "Cache arena not bound to NUMA node");
+        }
+        scheduler_bind_core(c->id, c->node);
+    }
+    // Per-core I/O ring with the cache arena as its registered buffer
+    if (io_thread_init() != 0 || io_register_buffers(own->arena, own->capacity * PAGE_SIZE) != 0) {
+        e->log(LOG_WARNING, c->id, "I/O ring setup incomplete, using unregistered buffers");
+    }
+    prefetch_stream_t prefetcher;
+    prefetch_init(&prefetcher);
+    loadctl_t load;
+    loadctl_init(&load, cfg->load_mode, cfg->cpu_budget, cfg->load_threshold);
+    int halved = 0;
+    workload_gen_t *gen = &c->gen;
+    workload_gen_init(gen, &e->workload, c->id, seg_size / BLOCK_SIZE, e->trace_ptr, e->recorder_ptr);
+
+    e->log(LOG_INFO, c->id, "Started core execution");
+
+    while (e->running) {
+        loadctl_begin(&load);
+        // Adjust segment size dynamically based on system load
+        uint64_t adaptive_seg_size = seg_size;
+        int current_load = load.queue_depth;
+        if (load.overloaded && current_load > cfg->load_threshold) {
+            adaptive_seg_size = seg_size / 2; // Reduce segment size under high load to lower I/O latency
+        }
+        if ((adaptive_seg_size != seg_size) != halved) {
+            halved = adaptive_seg_size != seg_size;
+            engine_logf(e, LOG_INFO, c->id, halved ?
+                        "Reduced segment size to %lu due to high load: %d tasks, p99 %lu us" :
+                        "Restored segment size to %lu: %d tasks, p99 %lu us",
+                        adaptive_seg_size, current_load, load.p99_ns / 1000);
+        }
+        // Own work first; with the deque empty, steal from a core whose deque is much longer,
+        // otherwise take the next blocks from the configured generator (or the trace) in the adaptive segment
+        uint64_t task;
+        int migrated = 0;
+        if (!scheduler_pop_task(c->id, &task)) {
+            if (scheduler_should_migrate(c->id) && scheduler_get_migrated_task(c->id, &task)) {
+                migrated = 1;
+                prefetch_note_migrated(&prefetcher, TASK_OFFSET(task));
+            } else {
+                if (core_refill(c, (uint64_t)c->id * adaptive_seg_size, adaptive_seg_size / BLOCK_SIZE) == 0) {
+                    e->log(LOG_INFO, c->id, "Trace replay finished");
+                    break;
+                }
+                if (!scheduler_pop_task(c->id, &task)) continue; // Stolen meanwhile, all of it
+            }
+        }
+        uint64_t offset = TASK_OFFSET(task);
+        workload_op_t op = TASK_OP(task);
+        int hotness = TASK_HOT(task);
+
+        // Zero-copy: the page is pinned, transformed in place and written through the extent store,
+        // so the cached copy stays clean and equal to what was stored
+        cache_t *shard = cache_shard(&e->cache, offset);
+        // Pipelined: take the request first, it waits out back-pressure and an earlier version in flight
+        pipeline_item_t *item = e->pipe_ptr && op == WORKLOAD_WRITE ? pipeline_begin(e->pipe_ptr, offset) : NULL;
+        // A write changes the frame in place: no other core, nor the flusher, touches it meanwhile
+        char *page = op == WORKLOAD_WRITE ? cache_pin_exclusive(shard, e->fd, offset) : cache_pin(shard, e->fd, offset, 0);
+        if (!page) {
+            if (item) pipeline_cancel(e->pipe_ptr, item);
+            e->log(LOG_ERR, c->id, "Failed to get cache page");
+            if (cfg->fail_delay_ms > 0) {
+                struct timespec delay = { cfg->fail_delay_ms / 1000, (long)(cfg->fail_delay_ms % 1000) * 1000000L };
+                nanosleep(&delay, NULL);
+            }
+            continue;
+        }
+        if (op == WORKLOAD_WRITE) {
+            // Simulated workload: the block transform, on the widest vector unit this CPU has
+            transform_apply(e->transform, page, BLOCK_SIZE, (uint64_t)c->id, cfg->transform_passes);
+
+            // Adaptive compression and write: hot blocks get the fast codec, cold ones ZSTD at a
+            // level picked by the compressibility probe (or raw storage); the store appends the extent.
+            // In the pipeline the workers do both and unpin the page once it is in the log
+            int cs = item ? 0 : extent_write(&e->store, offset, page, hotness);
+            if (item) {
+                pipeline_submit(e->pipe_ptr, item, shard, page, hotness);
+            } else if (cs >= 0) {
+                ring_cache_invalidate(offset); // The ring gets the new copy when the page is evicted
+            } else {
+                engine_logf(e, LOG_ERR, c->id, "Failed to write compressed extent at offset %lu (errno: %d)", offset, errno);
+                cache_mark_dirty(shard, page); // Changed in place: the flusher retries the write
+            }
+        }
+        // Reads only bring the block into the cache: no transform, nothing to write
+        if (op == WORKLOAD_WRITE && !item) {
+            cache_unpin_exclusive(shard, page);
+        } else if (!item) {
+            cache_unpin(shard, page);
+        }
+
+        // Read ahead along this core's own stream (migrated blocks do not move it), within its segment;
+        // done after the write above because readahead may evict the page just used
+        if (e->running && !migrated) {
+            uint64_t seg_lo = (uint64_t)c->id * adaptive_seg_size;
+            uint64_t seg_hi = seg_lo + adaptive_seg_size < e->image_bytes ? seg_lo + adaptive_seg_size : e->image_bytes;
+            prefetch_access(&prefetcher, &e->cache, e->fd, offset, hotness, seg_lo, seg_hi);
+        }
+
+        atomic_fetch_add_explicit(&c->ops, 1, memory_order_relaxed);
+
+        // Load control on real signals: operation latency, dirty backlog, pending work (own tasks and
+        // pages still waiting in the pipeline) and CPU pressure; the controller sleeps off its duty
+        // cycle unless the mode is no-throttle
+        double backlog = (double)atomic_load_explicit(&own->dirty_count, memory_order_relaxed) / own->capacity;
+        int pending = scheduler_queue_depth(c->id) + (e->pipe_ptr ? (int)pipeline_backlog(e->pipe_ptr) : 0);
+        int was_overloaded = load.overloaded;
+        if (loadctl_end(&load, pending, backlog)) {
+            if (load.overloaded && !was_overloaded && load.mode != LOADCTL_NO_THROTTLE) {
+                engine_logf(e, LOG_WARNING, c->id, "Throttling core due to extreme load: p99 %lu us, backlog %.0f%%, queue %d, pressure %.1f%%, duty %.0f%%",
+                            load.p99_ns / 1000, load.backlog * 100.0, load.queue_depth, load.pressure, load.duty * 100.0);
+            }
+            // Display system stats periodically
+            if (cfg->stats_windows > 0 && load.windows % (uint64_t)cfg->stats_windows == 0) {
+                display_system_stats(e);
+                if (e->pipe_ptr && c->id == 0) display_pipeline_stats(e);
+                if (c->id == 0) display_latency_stats(e);
+                display_cache_stats(e, c->id, own);
+                display_load_stats(e, c->id, &load);
+            }
+        }
+    }
+
+    workload_gen_destroy(gen);
+    display_load_stats(e, c->id, &load);
+    display_cache_stats(e, c->id, own);
+    io_thread_destroy();
+    e->log(LOG_INFO, c->id, "Core execution terminated");
+    return NULL;
+}
+
+// O_DIRECT for the image and the log once the buffered scans (dictionary, recovery) are done;
+// a file system that refuses it keeps that file in the page cache
+static void open_direct(engine_t *e) {
+    size_t align;
+    int fd = io_open_direct(e->cfg.swap_img_path, O_RDWR, &align);
+    if (fd >= 0) {
+        posix_fadvise(e->fd, 0, 0, POSIX_FADV_DONTNEED); // Pages the dictionary scan left behind
+        // Same descriptor number: the store and the cache already hold it
+        if (dup2(fd, e->fd) >= 0) {
+            engine_logf(e, LOG_INFO, -1, "Direct I/O: image %s, %zu-byte alignment", e->cfg.swap_img_path, align);
+        }
+        close(fd);
+    } else {
+        engine_logf(e, LOG_WARNING, -1, "Direct I/O not available for %s (%s), using the page cache",
+                    e->cfg.swap_img_path, strerror(errno));
+    }
+    if (extent_set_direct(&e->store, e->cfg.swap_log_path) == 0) {
+        engine_logf(e, LOG_INFO, -1, "Direct I/O: log %s, %zu-byte alignment", e->cfg.swap_log_path, e->store.dio_align);
+    } else {
+        engine_logf(e, LOG_WARNING, -1, "Direct I/O not available for %s (%s), using the page cache",
+                    e->cfg.swap_log_path, strerror(errno));
+    }
+}
+
+// Access pattern, trace to replay; the recorder is opened at start so both clocks agree
+static int open_workload(engine_t *e) {
+    if (workload_parse(e->cfg.workload, &e->workload) != 0) {
+        engine_logf(e, LOG_WARNING, -1, "Invalid workload \"%s\", using seq", e->cfg.workload);
+        workload_parse("seq", &e->workload);
+    }
+    if (e->workload.kind != WORKLOAD_REPLAY) return 0;
+    const workload_trace_header_t *h = &e->trace.header;
+    if (workload_trace_open(&e->trace, e->workload.trace) != 0) {
+        engine_logf(e, LOG_ERR, -1, "Error opening trace %s: %s", e->workload.trace, strerror(errno));
+        return -1;
+    }
+    uint64_t image = (uint64_t)e->cfg.cores * e->seg_bytes;
+    if (h->cores != (uint32_t)e->cfg.cores || h->seg_bytes != e->seg_bytes) {
+        // Offsets stay as recorded; cores missing here leave their records unplayed
+        engine_logf(e, LOG_WARNING, -1, "Trace recorded with %u cores of %lu MB, replaying on %d cores of %zu MB",
+                    h->cores, h->seg_bytes >> 20, e->cfg.cores, e->cfg.segment_mb);
+    }
+    if ((uint64_t)h->cores * h->seg_bytes > image) {
+        engine_logf(e, LOG_ERR, -1, "Trace %s addresses beyond the image", e->workload.trace);
+        workload_trace_close(&e->trace);
+        return -1;
+    }
+    e->trace_ptr = &e->trace;
+    return 0;
+}
+
+int engine_open(engine_t *e, const settings_t *cfg, engine_log_fn log) {
+    memset(e, 0, sizeof(*e));
+    e->cfg = *cfg;
+    e->log = log;
+    e->fd = -1;
+    settings_autosize(&e->cfg);
+    cfg = &e->cfg;
+    e->seg_bytes = (uint64_t)cfg->segment_mb * 1024 * 1024;
+    uint64_t image = (uint64_t)cfg->cores * e->seg_bytes;
+    char desc[512];
+    settings_describe(cfg, desc, sizeof(desc));
+    engine_logf(e, LOG_INFO, -1, "Configuration: %s", desc);
+
+    // Histograms first: every module records into them from its first operation on
+    if (metrics_init(cfg->metrics_shm) == 0 && *cfg->metrics_shm) {
+        engine_logf(e, LOG_INFO, -1, "Latency metrics: /dev/shm%s", cfg->metrics_shm);
+    }
+
+    e->fd = open(cfg->swap_img_path, O_RDWR);
+    if (e->fd < 0) {
+        engine_logf(e, LOG_ERR, -1, "Error opening swap file %s: %s", cfg->swap_img_path, strerror(errno));
+        metrics_destroy();
+        return -1;
+    }
+    struct stat img_st;
+    e->image_bytes = image;
+    if (fstat(e->fd, &img_st) == 0 && (uint64_t)img_st.st_size < image) {
+        e->image_bytes = (uint64_t)img_st.st_size;
+        engine_logf(e, LOG_WARNING, -1, "Swap file %s is %lu MB, shorter than %d cores x %zu MB segments",
+                    cfg->swap_img_path, e->image_bytes >> 20, cfg->cores, cfg->segment_mb);
+    }
+
+    if (io_backend_init(IO_BACKEND_DEFAULT) != 0) {
+        engine_logf(e, LOG_WARNING, -1, "Requested I/O backend unavailable");
+    }
+    engine_logf(e, LOG_INFO, -1, "I/O backend: %s", io_backend_name());
+
+    // Словарь обучается один раз на содержимом образа и переиспользуется между запусками
+    if (compress_setup_dictionary(cfg->swap_dict_path, e->fd, image) == 0) {
+        engine_logf(e, LOG_INFO, -1, "Compression dictionary: %s", cfg->swap_dict_path);
+    }
+
+    // Extent log: compressed pages of the whole image, index rebuilt from the log on open
+    if (extent_open(&e->store, cfg->swap_log_path, e->fd, image) != 0) {
+        engine_logf(e, LOG_ERR, -1, "Error opening extent store %s", cfg->swap_log_path);
+        goto fail_fd;
+    }
+    if (cfg->direct_io) open_direct(e);
+
+    transform_init();
+    e->transform = transform_find(cfg->transform);
+    if (e->transform < 0) {
+        engine_logf(e, LOG_WARNING, -1, "Unknown block transform \"%s\", using xor", cfg->transform);
+        e->transform = transform_find("xor");
+    }
+    engine_logf(e, LOG_INFO, -1, "Block transform: %s (%s kernel, %d passes)", transform_name(e->transform),
+                transform_isa_name(transform_kernel_isa(e->transform)), cfg->transform_passes);
+
+    if (open_workload(e) != 0) goto fail_store;
+
+    // Scheduler tables for this many cores, sized to the blocks a shard holds
+    if (scheduler_init(cfg->cores, cfg->sched_hot_sets) != 0) {
+        e->log(LOG_ERR, -1, "Error allocating scheduler tables");
+        goto fail_trace;
+    }
+
+    // Victim ring shared by all cores: pages evicted from the cache stay readable there
+    ring_cache_init((size_t)cfg->ring_mb * 1024 * 1024);
+
+    // One page cache for the process, sharded by segment: CACHE_MB is split between the shards
+    cache_geometry_t geo = { .frames = cfg->shard_frames, .buckets = cfg->hash_size, .stripes = cfg->mutex_groups };
+    if (cache_shared_init_geometry(&e->cache, cfg->cores, e->seg_bytes, CACHE_POLICY_2Q, &geo) != 0) {
+        e->log(LOG_ERR, -1, "Error initializing shared cache");
+        goto fail_ring;
+    }
+    cache_shared_attach_store(&e->cache, &e->store);
+    if (cache_shared_start_flusher(&e->cache, e->fd) != 0) {
+        e->log(LOG_WARNING, -1, "Dirty page flusher not started for every shard, eviction writes synchronously");
+    }
+    engine_logf(e, LOG_INFO, -1, "Shared cache: %d shards of %zu pages", e->cache.nshards, e->cache.shard[0].capacity);
+
+    // Compression and log appends off the core threads, sized on their own
+    if (cfg->pipeline) {
+        if (pipeline_init(&e->pipe, &e->store, &e->cache, cfg->compress_workers, cfg->write_threads) == 0) {
+            e->pipe_ptr = &e->pipe;
+        } else {
+            e->log(LOG_WARNING, -1, "Pipeline not started, cores compress and write synchronously");
+        }
+    }
+
+    e->cores = calloc((size_t)cfg->cores, sizeof(*e->cores));
+    if (!e->cores) {
+        e->log(LOG_ERR, -1, "Error allocating core state");
+        if (e->pipe_ptr) pipeline_destroy(e->pipe_ptr);
+        cache_shared_destroy(&e->cache, e->fd);
+        goto fail_ring;
+    }
+    e->running = 1;
+    return 0;
+
+fail_ring:
+    ring_cache_destroy();
+    scheduler_destroy();
+fail_trace:
+    if (e->trace_ptr) workload_trace_close(&e->trace);
+fail_store:
+    extent_close(&e->store);
+fail_fd:
+    close(e->fd);
+    e->fd = -1;
+    metrics_destroy();
+    return -1;
+}
+
+// Warm restart: the pages and hot blocks of the last run are back before the first access
+static void prewarm(engine_t *e) {
+    warm_stats_t st;
+    int rc = warm_load(e->cfg.warm_path, &e->cache, e->fd, e->cfg.cores, e->seg_bytes, &st);
+    if (rc == 0) {
+        engine_logf(e, LOG_INFO, -1, "Prewarm: %lu of %lu pages from %s in %.0f ms", st.loaded, st.entries,
+                    e->cfg.warm_path, st.ms);
+    } else if (rc < 0) {
+        engine_logf(e, LOG_WARNING, -1, "Warm snapshot %s not used: %s", e->cfg.warm_path,
+                    errno == EPROTO ? "other geometry or corrupt" : strerror(errno));
+    }
+}
+
+static void join_cores(engine_t *e) {
+    for (int i = 0; i < e->cfg.cores; i++) {
+        if (e->cores[i].started) pthread_join(e->cores[i].thread, NULL);
+        e->cores[i].started = 0;
+    }
+}
+
+int engine_start(engine_t *e) {
+    const settings_t *cfg = &e->cfg;
+    if (*cfg->warm_path) prewarm(e);
+    // Both trace clocks start here, after the slow setup
+    if (*cfg->trace_record) {
+        if (workload_recorder_open(&e->recorder, cfg->trace_record, cfg->cores, e->seg_bytes) == 0) {
+            e->recorder_ptr = &e->recorder;
+        } else {
+            engine_logf(e, LOG_WARNING, -1, "Error creating trace %s: %s, not recording", cfg->trace_record, strerror(errno));
+        }
+    }
+    char workload_desc[WORKLOAD_PATH_MAX + 64];
+    workload_describe(&e->workload, workload_desc, sizeof(workload_desc));
+    engine_logf(e, LOG_INFO, -1, "Workload: %s%s%s", workload_desc, e->recorder_ptr ? ", recording to " : "",
+                e->recorder_ptr ? cfg->trace_record : "");
+    if (e->trace_ptr) workload_trace_start(&e->trace);
+
+    // Optional pinning: core i runs on the i-th CPU of the list, its memory on that CPU's node
+    int *cpus = malloc(AFFINITY_MAX_CPUS * sizeof(*cpus));
+    int ncpus = cpus ? affinity_load_cpus(cfg->cpus, cpus, AFFINITY_MAX_CPUS) : 0;
+    for (int i = 0; i < cfg->cores; i++) {
+        engine_core_t *c = &e->cores[i];
+        c->e = e;
+        c->id = i;
+        c->cpu = ncpus > 0 ? cpus[i % ncpus] : -1;
+        c->node = c->cpu >= 0 ? affinity_cpu_node(c->cpu) : -1;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        int rc = -1;
+        if (c->cpu >= 0 && affinity_attr_set_cpu(&attr, c->cpu) == 0) {
+            rc = pthread_create(&c->thread, &attr, core_run, c);
+        }
+        pthread_attr_destroy(&attr);
+        if (rc != 0 && c->cpu >= 0) {
+            // CPU outside this process's allowed set (or offline)
+            engine_logf(e, LOG_WARNING, -1, "Cannot pin core %d to CPU %d, running unpinned", i, c->cpu);
+            c->cpu = c->node = -1;
+        }
+        if (rc != 0) rc = pthread_create(&c->thread, NULL, core_run, c);
+        if (rc != 0) {
+            engine_logf(e, LOG_ERR, -1, "Error creating thread for core %d", i);
+            free(cpus);
+            engine_stop(e);
+            join_cores(e);
+            return -1;
+        }
+        c->started = 1;
+        engine_logf(e, LOG_INFO, -1, "Core %d: segment %lu-%lu MB, CPU %d, NUMA node %d", i,
+                    (uint64_t)i * cfg->segment_mb, (uint64_t)(i + 1) * cfg->segment_mb, c->cpu, c->node);
+    }
+    free(cpus);
+    return 0;
+}
+
+void engine_stop(engine_t *e) {
+    e->running = 0;
+}
+
+void engine_wait(engine_t *e) {
+    join_cores(e);
+}
+
+void engine_close(engine_t *e) {
+    engine_stop(e);
+    join_cores(e);
+    if (e->recorder_ptr) {
+        engine_logf(e, LOG_INFO, -1, "Trace %s: %lu accesses recorded, %lu write errors", e->cfg.trace_record,
+                    e->recorder.records, e->recorder.write_errors);
+        workload_recorder_close(&e->recorder);
+        e->recorder_ptr = NULL;
+    }
+    if (e->trace_ptr) workload_trace_close(&e->trace);
+    e->trace_ptr = NULL;
+    display_system_stats(e);
+
+    // Snapshot for the next start while the cache and the hot tables still hold this run's state
+    if (*e->cfg.warm_path) {
+        long n = warm_save(e->cfg.warm_path, &e->cache, e->cfg.cores, e->seg_bytes);
+        if (n >= 0) {
+            engine_logf(e, LOG_INFO, -1, "Warm snapshot: %ld pages to %s", n, e->cfg.warm_path);
+        } else {
+            engine_logf(e, LOG_WARNING, -1, "Error writing warm snapshot %s: %s", e->cfg.warm_path, strerror(errno));
+        }
+    }
+    scheduler_destroy();
+    if (e->pipe_ptr) {
+        pipeline_destroy(e->pipe_ptr); // Drains every submitted page into the log first
+        display_pipeline_stats(e);
+        e->pipe_ptr = NULL;
+    }
+    cache_shared_destroy(&e->cache, e->fd); // Pass fd to write dirty pages
+
+    display_ring_stats(e);
+    ring_cache_destroy();
+    display_extent_stats(e);
+    extent_close(&e->store);
+    close(e->fd);
+    e->fd = -1;
+    display_latency_stats(e);
+    metrics_destroy();
+    free(e->cores);
+    e->cores = NULL;
+}
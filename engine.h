@@ -0,0 +1,70 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "config.h"
+#include "settings.h"
+#include "cache.h"
+#include "extent.h"
+#include "pipeline.h"
+#include "workload.h"
+
+// Движок PseudoCore, общий для pseudo_core и демона: образ, журнал экстентов, общий кэш,
+// кольцо, планировщик, конвейер и потоки ядер, размеры — из settings_t.
+// Фронтенд выбирает настройки и куда писать журнал, остальное делает движок
+
+// Получатель сообщений движка: prio — LOG_ERR, LOG_WARNING, LOG_INFO (syslog.h),
+// core — номер ядра или -1 для сообщений процесса и статистики
+typedef void (*engine_log_fn)(int prio, int core, const char *msg);
+
+struct engine;
+
+// Состояние одного ядра
+typedef struct {
+    struct engine *e;
+    int id;
+    int cpu;                    // CPU, к которому привязан поток, -1 — без привязки
+    int node;                   // NUMA-узел этого CPU, -1 — неизвестен
+    pthread_t thread;
+    int started;
+    _Atomic uint64_t ops;
+    workload_gen_t gen;
+} engine_core_t;
+
+typedef struct engine {
+    settings_t cfg;
+    engine_log_fn log;
+    int fd;
+    uint64_t seg_bytes;
+    uint64_t image_bytes;       // размер файла образа, не больше cores * seg_bytes: за концом читать нечего
+    int transform;
+    extent_store_t store;
+    cache_shared_t cache;
+    pipeline_t pipe;
+    pipeline_t *pipe_ptr;       // NULL — ядра пишут сами
+    workload_config_t workload;
+    workload_trace_t trace;
+    const workload_trace_t *trace_ptr;
+    workload_recorder_t recorder;
+    workload_recorder_t *recorder_ptr;
+    engine_core_t *cores;
+    volatile sig_atomic_t running;
+} engine_t;
+
+// Открывает образ и журнал, создаёт кэш, кольцо, планировщик и конвейер; 0 или -1
+int engine_open(engine_t *e, const settings_t *cfg, engine_log_fn log);
+// Запускает потоки ядер; 0 или -1 (тогда уже запущенные остановлены)
+int engine_start(engine_t *e);
+// Просит ядра остановиться; можно звать из обработчика сигнала
+void engine_stop(engine_t *e);
+// Ждёт выхода ядер: после engine_stop или когда воспроизведение трассы закончилось
+void engine_wait(engine_t *e);
+// Дописывает всё в журнал, выводит итоговую статистику и освобождает ресурсы
+void engine_close(engine_t *e);
+
+#endif // ENGINE_H
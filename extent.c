@@ -0,0 +1,965 @@
+// Хранилище экстентов для PseudoCore: журнал сжатых страниц и индекс блок -> запись
+#include "extent.h"
+#include "compress.h"
+#include "io_backend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <stdalign.h>
+
+#define REC_HDR_SIZE sizeof(extent_rec_hdr_t)
+#define SEG_DATA_START ((sizeof(extent_seg_hdr_t) + 7) & ~(size_t)7)
+
+#define LOC_MAKE(pos, len) (((uint64_t)(pos) << 16) | (uint64_t)(len))
+#define LOC_POS(l) ((l) >> 16)
+#define LOC_LEN(l) ((uint32_t)((l) & 0x3fff))
+#define LOC_SHARED 0x4000ull            // the record belongs to another block (a reference points here)
+#define LOC_ZERO 0x8000ull              // hole record: the page reads back as zeros
+#define SUM_P1 0x9E3779B185EBCA87ull
+#define SUM_P2 0xC2B2AE3D27D4EB4Full
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~(uint64_t)((a) - 1))
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static uint64_t zero_sum;
+
+// CRC32C (Castagnoli), reflected table form
+static void crc_table_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+        crc_table[i] = c;
+    }
+}
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Content hash of a page, xxh64-style rounds on four lanes; *zero tells whether every byte is zero.
+// Never 0: that value marks a block whose content is not known
+static uint64_t page_sum(const char *page, int *zero) {
+    uint64_t a0 = SUM_P1 + SUM_P2, a1 = SUM_P2, a2 = 0, a3 = 0 - SUM_P1;
+    uint64_t any = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; i += 32) {
+        uint64_t v[4];
+        memcpy(v, page + i, sizeof(v));
+        any |= v[0] | v[1] | v[2] | v[3];
+        a0 = rotl64(a0 + v[0] * SUM_P2, 31) * SUM_P1;
+        a1 = rotl64(a1 + v[1] * SUM_P2, 31) * SUM_P1;
+        a2 = rotl64(a2 + v[2] * SUM_P2, 31) * SUM_P1;
+        a3 = rotl64(a3 + v[3] * SUM_P2, 31) * SUM_P1;
+    }
+    uint64_t h = rotl64(a0, 1) + rotl64(a1, 7) + rotl64(a2, 12) + rotl64(a3, 18);
+    h ^= h >> 33;
+    h *= SUM_P2;
+    h ^= h >> 29;
+    h *= 0x165667B19E3779F9ull;
+    h ^= h >> 32;
+    if (zero) *zero = any == 0;
+    return h ? h : 1;
+}
+
+static void store_once(void) {
+    crc_table_init();
+    static const char zeros[BLOCK_SIZE];
+    zero_sum = page_sum(zeros, NULL);
+}
+
+static uint32_t crc32c(uint32_t crc, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    crc = ~crc;
+    while (len--) crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t record_hdr_crc(const extent_rec_hdr_t *h) {
+    extent_rec_hdr_t tmp = *h;
+    tmp.crc = 0;
+    return crc32c(0, &tmp, sizeof(tmp));
+}
+
+static uint32_t record_crc(const extent_rec_hdr_t *h, const char *payload) {
+    return crc32c(record_hdr_crc(h), payload, h->clen);
+}
+
+static size_t record_size(uint32_t clen) {
+    return (REC_HDR_SIZE + clen + 7) & ~(size_t)7;
+}
+
+static void log_extent_message(const char *level, const char *message) {
+    fprintf(stderr, "[%s] Extent: %s\n", level, message);
+}
+
+static uint32_t loc_segment(uint64_t l) {
+    return (uint32_t)(LOC_POS(l) / EXTENT_SEG_SIZE);
+}
+
+// Caller holds es->mutex
+static void segment_free_locked(extent_store_t *es, uint32_t s) {
+    if (s == es->active || s == es->victim || es->segs[s].seq == 0) return;
+    if (atomic_load_explicit(&es->segs[s].live, memory_order_relaxed) != 0) return;
+    es->segs[s].seq = 0;
+    es->free_segs[es->nfree++] = s;
+}
+
+static pthread_mutex_t *index_stripe(extent_store_t *es, uint64_t block) {
+    return &es->stripes[block & (EXTENT_INDEX_STRIPES - 1)].mutex;
+}
+
+// Drop a reference to a superseded record; the segment is reused once nothing points into it
+static void record_release(extent_store_t *es, uint64_t l) {
+    if (l == 0) return;
+    uint32_t s = loc_segment(l);
+    int64_t len = LOC_LEN(l);
+    if (l & LOC_SHARED) atomic_fetch_sub_explicit(&es->shared_bytes, len, memory_order_relaxed);
+    if (atomic_fetch_sub_explicit(&es->segs[s].live, len, memory_order_acq_rel) == len) {
+        pthread_mutex_lock(&es->mutex);
+        segment_free_locked(es, s);
+        pthread_mutex_unlock(&es->mutex);
+    }
+}
+
+// Segments that can still be started: free ones and the part of the log never used
+static uint32_t segments_available_locked(const extent_store_t *es) {
+    return es->nfree + (es->max_segs - es->nseg);
+}
+
+// Start appending to a fresh segment unless only keep segments would be left; caller holds es->mutex
+static int segment_roll_locked(extent_store_t *es, uint32_t keep) {
+    uint32_t s;
+    if (segments_available_locked(es) <= keep) {
+        return -1;
+    } else if (es->nfree > 0) {
+        s = es->free_segs[--es->nfree];
+    } else if (es->nseg < es->max_segs) {
+        s = es->nseg++;
+    } else {
+        return -1;
+    }
+    extent_seg_hdr_t hdr = { .magic = EXTENT_SEG_MAGIC, .version = EXTENT_VERSION, .seq = es->next_seq++ };
+    // Direct I/O writes the header as a whole zero-padded block; records start on the next one
+    alignas(IO_DIRECT_MAX_ALIGN) char block[IO_DIRECT_MAX_ALIGN];
+    size_t hdr_len = es->dio_align ? es->dio_align : sizeof(hdr);
+    memset(block, 0, hdr_len);
+    memcpy(block, &hdr, sizeof(hdr));
+    if (io_pwrite(es->log_fd, block, hdr_len, (uint64_t)s * EXTENT_SEG_SIZE) != (ssize_t)hdr_len) {
+        es->free_segs[es->nfree++] = s;
+        return -1;
+    }
+    uint32_t old = es->active;
+    es->segs[s].seq = hdr.seq;
+    es->active = s;
+    es->active_pos = es->dio_align ? es->dio_align : SEG_DATA_START;
+    if (old != UINT32_MAX) segment_free_locked(es, old);
+    return 0;
+}
+
+// Replay one segment in record order; stops at the first record that does not verify (torn tail)
+static void segment_replay(extent_store_t *es, uint32_t s, const char *seg) {
+    uint64_t seq = es->segs[s].seq;
+    size_t pos = SEG_DATA_START;
+    while (pos + REC_HDR_SIZE <= EXTENT_SEG_SIZE) {
+        extent_rec_hdr_t h;
+        memcpy(&h, seg + pos, sizeof(h));
+        if (h.magic == 0) {
+            // Zero padding behind a direct-I/O append: the next record starts on a sector boundary
+            pos = ALIGN_UP(pos + 1, EXTENT_PAD_ALIGN);
+            continue;
+        }
+        if (h.magic == EXTENT_REC_MAGIC && (h.flags & EXTENT_FLAG_FILL)) {
+            // A failed append: records reserved behind it go on after the span it covers
+            if (h.seg_seq != seq || record_hdr_crc(&h) != h.crc || pos + record_size(h.clen) > EXTENT_SEG_SIZE) break;
+            pos += record_size(h.clen);
+            continue;
+        }
+        if (h.magic != EXTENT_REC_MAGIC || h.seg_seq != seq || h.clen > BLOCK_SIZE) break;
+        size_t rs = record_size(h.clen);
+        if (pos + rs > EXTENT_SEG_SIZE || record_crc(&h, seg + pos + REC_HDR_SIZE) != h.crc) break;
+        if (h.block < es->blocks) {
+            uint64_t l = LOC_MAKE((uint64_t)s * EXTENT_SEG_SIZE + pos, rs), ref = 0, sum = 0;
+            if (h.flags & EXTENT_FLAG_REF) {
+                extent_ref_t r;
+                memcpy(&r, seg + pos + REC_HDR_SIZE, sizeof(r));
+                uint64_t ts = r.pos / EXTENT_SEG_SIZE;
+                // A target segment reused since means a later record superseded this reference
+                if (h.clen != sizeof(r) || ts >= es->nseg || es->segs[ts].seq != r.seg_seq || r.len > EXTENT_REC_MAX) {
+                    pos += rs;
+                    continue;
+                }
+                ref = l;
+                l = LOC_MAKE(r.pos, r.len) | LOC_SHARED;
+                atomic_fetch_add_explicit(&es->segs[ts].live, (int64_t)r.len, memory_order_relaxed);
+                atomic_fetch_add_explicit(&es->shared_bytes, (int64_t)r.len, memory_order_relaxed);
+            } else if (h.flags & EXTENT_FLAG_ZERO) {
+                l |= LOC_ZERO;
+                sum = zero_sum;
+            }
+            uint64_t old = atomic_exchange_explicit(&es->loc[h.block], l, memory_order_relaxed);
+            if (old) atomic_fetch_sub_explicit(&es->segs[loc_segment(old)].live, LOC_LEN(old), memory_order_relaxed);
+            if (old & LOC_SHARED) atomic_fetch_sub_explicit(&es->shared_bytes, LOC_LEN(old), memory_order_relaxed);
+            if (es->ref[h.block]) {
+                uint64_t oref = es->ref[h.block];
+                atomic_fetch_sub_explicit(&es->segs[loc_segment(oref)].live, LOC_LEN(oref), memory_order_relaxed);
+            }
+            es->ref[h.block] = ref;
+            atomic_store_explicit(&es->sum[h.block], sum, memory_order_relaxed);
+            atomic_fetch_add_explicit(&es->segs[s].live, (int64_t)rs, memory_order_relaxed);
+        }
+        pos += rs;
+    }
+}
+
+typedef struct {
+    uint64_t seq;
+    uint32_t seg;
+} seg_order_t;
+
+static int seg_order_cmp(const void *a, const void *b) {
+    uint64_t x = ((const seg_order_t*)a)->seq, y = ((const seg_order_t*)b)->seq;
+    return (x > y) - (x < y);
+}
+
+// Rebuild the index by replaying segments oldest first, so later records win
+static int store_recover(extent_store_t *es) {
+    off_t size = lseek(es->log_fd, 0, SEEK_END);
+    if (size < 0) return -1;
+    uint64_t nseg = ((uint64_t)size + EXTENT_SEG_SIZE - 1) / EXTENT_SEG_SIZE;
+    if (nseg > es->max_segs) nseg = es->max_segs;
+    es->nseg = (uint32_t)nseg;
+    seg_order_t *order = malloc((nseg + 1) * sizeof(*order));
+    char *seg = malloc(EXTENT_SEG_SIZE);
+    if (!order || !seg) {
+        free(order);
+        free(seg);
+        return -1;
+    }
+    uint32_t used = 0;
+    for (uint32_t s = 0; s < es->nseg; s++) {
+        extent_seg_hdr_t hdr;
+        ssize_t r = pread(es->log_fd, &hdr, sizeof(hdr), (off_t)((uint64_t)s * EXTENT_SEG_SIZE));
+        if (r == (ssize_t)sizeof(hdr) && hdr.magic == EXTENT_SEG_MAGIC &&
+            hdr.version >= 1 && hdr.version <= EXTENT_VERSION && hdr.seq) {
+            es->segs[s].seq = hdr.seq;
+            if (hdr.seq >= es->next_seq) es->next_seq = hdr.seq + 1;
+            order[used].seq = hdr.seq;
+            order[used++].seg = s;
+        }
+    }
+    qsort(order, used, sizeof(*order), seg_order_cmp);
+    for (uint32_t i = 0; i < used; i++) {
+        uint32_t s = order[i].seg;
+        ssize_t r = pread(es->log_fd, seg, EXTENT_SEG_SIZE, (off_t)((uint64_t)s * EXTENT_SEG_SIZE));
+        if (r < 0) {
+            free(order);
+            free(seg);
+            return -1;
+        }
+        if ((size_t)r < EXTENT_SEG_SIZE) memset(seg + r, 0, EXTENT_SEG_SIZE - (size_t)r);
+        segment_replay(es, s, seg);
+    }
+    for (uint32_t s = 0; s < es->nseg; s++) {
+        if (atomic_load_explicit(&es->segs[s].live, memory_order_relaxed) == 0) {
+            es->segs[s].seq = 0;
+            es->free_segs[es->nfree++] = s;
+        }
+    }
+    free(order);
+    free(seg);
+    return 0;
+}
+
+int extent_open(extent_store_t *es, const char *log_path, int image_fd, uint64_t logical_bytes) {
+    pthread_once(&crc_once, store_once);
+    memset(es, 0, sizeof(*es));
+    es->image_fd = image_fd;
+    es->blocks = logical_bytes / BLOCK_SIZE;
+    uint64_t log_bytes = EXTENT_LOG_MB ? (uint64_t)EXTENT_LOG_MB * 1024 * 1024 : 2 * logical_bytes;
+    es->max_segs = (uint32_t)(log_bytes / EXTENT_SEG_SIZE);
+    // Room for every block's largest record (padded for direct I/O) plus the active segment and the
+    // cleaner's reserve: below that the cleaner cannot always make progress
+    uint64_t per_seg = (EXTENT_SEG_SIZE - IO_DIRECT_MAX_ALIGN) / (EXTENT_REC_MAX + IO_DIRECT_MAX_ALIGN / 8);
+    uint32_t need = (uint32_t)((es->blocks + per_seg - 1) / per_seg) + 2;
+    if (es->max_segs < need) {
+        if (EXTENT_LOG_MB) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "EXTENT_LOG_MB %d holds less than the image, using %lu MB",
+                     EXTENT_LOG_MB, (uint64_t)need * EXTENT_SEG_SIZE >> 20);
+            log_extent_message("WARNING", msg);
+        }
+        es->max_segs = need;
+    }
+    es->active = UINT32_MAX;
+    es->victim = UINT32_MAX;
+    es->next_seq = 1;
+    es->log_fd = open(log_path, O_RDWR | O_CREAT, 0644);
+    if (es->log_fd < 0) {
+        perror("Error opening extent log");
+        return -1;
+    }
+    size_t nblocks = es->blocks ? es->blocks : 1;
+    es->loc = calloc(nblocks, sizeof(*es->loc));
+    es->ref = calloc(nblocks, sizeof(*es->ref));
+    es->sum = calloc(nblocks, sizeof(*es->sum));
+    es->stripes = aligned_alloc(_Alignof(extent_stripe_t), EXTENT_INDEX_STRIPES * sizeof(*es->stripes));
+    es->segs = calloc(es->max_segs, sizeof(*es->segs));
+    es->free_segs = malloc(es->max_segs * sizeof(*es->free_segs));
+    if (EXTENT_DEDUP) {
+        size_t want = EXTENT_DEDUP_ENTRIES ? EXTENT_DEDUP_ENTRIES : es->blocks / 8, entries = 1024;
+        while (entries < want) entries <<= 1;
+        es->dedup = calloc(entries, sizeof(*es->dedup));
+        es->dedup_mask = entries - 1;
+    }
+    if (!es->loc || !es->ref || !es->sum || !es->stripes || !es->segs || !es->free_segs ||
+        (EXTENT_DEDUP && !es->dedup) || pthread_mutex_init(&es->mutex, NULL) != 0) {
+        log_extent_message("ERROR", "Failed to allocate extent index");
+        free(es->stripes);
+        es->stripes = NULL;
+        goto fail;
+    }
+    pthread_cond_init(&es->clean_cond, NULL);
+    for (int i = 0; i < EXTENT_INDEX_STRIPES; i++) pthread_mutex_init(&es->stripes[i].mutex, NULL);
+    if (store_recover(es) != 0) {
+        log_extent_message("ERROR", "Failed to scan extent log");
+        pthread_cond_destroy(&es->clean_cond);
+        pthread_mutex_destroy(&es->mutex);
+        goto fail;
+    }
+    return 0;
+fail:
+    if (es->stripes) {
+        for (int i = 0; i < EXTENT_INDEX_STRIPES; i++) pthread_mutex_destroy(&es->stripes[i].mutex);
+    }
+    free((void*)es->loc);
+    free(es->ref);
+    free((void*)es->sum);
+    free(es->stripes);
+    free(es->dedup);
+    free(es->segs);
+    free(es->free_segs);
+    close(es->log_fd);
+    es->loc = NULL;
+    es->ref = NULL;
+    es->sum = NULL;
+    es->stripes = NULL;
+    es->dedup = NULL;
+    es->segs = NULL;
+    es->free_segs = NULL;
+    return -1;
+}
+
+int extent_set_direct(extent_store_t *es, const char *log_path) {
+    size_t align;
+    int fd = io_open_direct(log_path, O_RDWR, &align);
+    if (fd < 0) return -1;
+    // Appends roll to a fresh segment first (recovery leaves none active), so no block is shared
+    // with records written through the page cache; drop the copies the recovery scan left there
+    posix_fadvise(es->log_fd, 0, 0, POSIX_FADV_DONTNEED);
+    if (dup2(fd, es->log_fd) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+    es->dio_align = align;
+    return 0;
+}
+
+void extent_close(extent_store_t *es) {
+    if (!es->loc) return;
+    fdatasync(es->log_fd);
+    close(es->log_fd);
+    pthread_cond_destroy(&es->clean_cond);
+    pthread_mutex_destroy(&es->mutex);
+    for (int i = 0; i < EXTENT_INDEX_STRIPES; i++) pthread_mutex_destroy(&es->stripes[i].mutex);
+    free((void*)es->loc);
+    free(es->ref);
+    free((void*)es->sum);
+    free(es->stripes);
+    free(es->dedup);
+    free(es->segs);
+    free(es->free_segs);
+    es->loc = NULL;
+    es->ref = NULL;
+    es->sum = NULL;
+    es->stripes = NULL;
+    es->dedup = NULL;
+    es->segs = NULL;
+    es->free_segs = NULL;
+}
+
+// Decode a record read from the log; -1 if it no longer belongs to this block
+// (block UINT64_MAX: a shared record, whichever block it was written for)
+static int record_decode(const char *rec, uint32_t len, uint64_t block, char *page) {
+    extent_rec_hdr_t h;
+    memcpy(&h, rec, sizeof(h));
+    if (h.magic != EXTENT_REC_MAGIC || (block != UINT64_MAX && h.block != block) || record_size(h.clen) != len) return -1;
+    if (h.flags & (EXTENT_FLAG_ZERO | EXTENT_FLAG_REF)) return -1;
+    const char *payload = rec + REC_HDR_SIZE;
+    if (record_crc(&h, payload) != h.crc) return -1;
+    if (h.codec >= COMPRESS_CODECS || ((h.flags & EXTENT_FLAG_DICT) && !compress_has_dictionary())) return -1;
+    return decompress_page_codec((compress_codec_t)h.codec, payload, h.clen, page, BLOCK_SIZE) == BLOCK_SIZE ? 0 : -1;
+}
+
+#define RECORD_BUF_SIZE (EXTENT_REC_MAX + 2 * IO_DIRECT_MAX_ALIGN)
+
+// Read the raw record at l into buf (RECORD_BUF_SIZE bytes, aligned for direct I/O) and point rec at it;
+// 0, 1 if the log ends before the record, -1 on a read error
+static int record_load(extent_store_t *es, uint64_t l, char *buf, const char **rec) {
+    // Direct I/O reads the whole aligned window around the record
+    uint32_t len = LOC_LEN(l);
+    uint64_t pos = LOC_POS(l);
+    uint64_t start = es->dio_align ? pos & ~(uint64_t)(es->dio_align - 1) : pos;
+    size_t span = es->dio_align ? (size_t)(ALIGN_UP(pos + len, es->dio_align) - start) : len;
+    ssize_t r = io_pread(es->log_fd, buf, span, start);
+    if (r < 0) return -1;
+    if (r < (ssize_t)(pos - start + len)) return 1;
+    *rec = buf + (pos - start);
+    return 0;
+}
+
+// Read and decode the data record at l; 0, 1 if it does not decode (reused or corrupt), -1 on a read error
+static int record_fetch(extent_store_t *es, uint64_t l, uint64_t block, char *page) {
+    alignas(IO_DIRECT_MAX_ALIGN) char buf[RECORD_BUF_SIZE];
+    const char *rec;
+    int rc = record_load(es, l, buf, &rec);
+    if (rc != 0) return rc;
+    return record_decode(rec, LOC_LEN(l), (l & LOC_SHARED) ? UINT64_MAX : block, page) == 0 ? 0 : 1;
+}
+
+// Content hash of what was just read for the block, unless a write replaced it meanwhile
+static void sum_note(extent_store_t *es, uint64_t block, uint64_t l, uint64_t sum) {
+    if (atomic_load_explicit(&es->sum[block], memory_order_relaxed) == sum) return;
+    pthread_mutex_t *m = index_stripe(es, block);
+    pthread_mutex_lock(m);
+    if (atomic_load_explicit(&es->loc[block], memory_order_relaxed) == l) {
+        atomic_store_explicit(&es->sum[block], sum, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(m);
+}
+
+ssize_t extent_read(extent_store_t *es, uint64_t off, char *page) {
+    uint64_t block = off / BLOCK_SIZE;
+    if (block >= es->blocks) return io_pread(es->image_fd, page, BLOCK_SIZE, off);
+    for (;;) {
+        uint64_t l = atomic_load_explicit(&es->loc[block], memory_order_acquire);
+        if (l == 0) {
+            ssize_t r = io_pread(es->image_fd, page, BLOCK_SIZE, off);
+            if (r != BLOCK_SIZE) return r;
+        } else if (l & LOC_ZERO) {
+            memset(page, 0, BLOCK_SIZE); // Hole: nothing to read
+        } else {
+            int rc = record_fetch(es, l, block, page);
+            if (rc < 0) return -1;
+            // A shared record carries another block's header, so only the index vouches for it: the
+            // cleaner may have moved this block and its segment been reused while the read was on its way
+            if (rc == 0 && (l & LOC_SHARED) && atomic_load_explicit(&es->loc[block], memory_order_acquire) != l) continue;
+            if (rc > 0) {
+                // The segment may have been reused under us after a newer write: retry on the new location
+                if (atomic_load_explicit(&es->loc[block], memory_order_acquire) != l) continue;
+                char msg[256];
+                snprintf(msg, sizeof(msg), "Corrupt extent for offset %lu at log offset %lu", off, LOC_POS(l));
+                log_extent_message("ERROR", msg);
+                errno = EIO;
+                return -1;
+            }
+        }
+        // Hash taken at load time: writing the same bytes back is then elided
+        sum_note(es, block, l, (l & LOC_ZERO) ? zero_sum : page_sum(page, NULL));
+        return BLOCK_SIZE;
+    }
+}
+
+// Slot of a content hash in the dedup table; the hash is already mixed
+static size_t dedup_slot(const extent_store_t *es, uint64_t sum) {
+    return (size_t)sum & es->dedup_mask;
+}
+
+// Remember a freshly written data record as the candidate for its content
+static void dedup_note(extent_store_t *es, uint64_t sum, uint64_t l, uint64_t seq) {
+    if (!es->dedup) return;
+    size_t slot = dedup_slot(es, sum);
+    pthread_mutex_t *m = index_stripe(es, slot);
+    pthread_mutex_lock(m);
+    es->dedup[slot] = (extent_dedup_t){ .sum = sum, .loc = l, .seq = seq };
+    pthread_mutex_unlock(m);
+}
+
+// A stored record with the same bytes as page: its bytes are counted live on behalf of the
+// reference (released when the reference is superseded) and described in ref; 0 if there is none
+static int dedup_find(extent_store_t *es, uint64_t sum, const char *page, extent_ref_t *ref) {
+    if (!es->dedup) return 0;
+    size_t slot = dedup_slot(es, sum);
+    pthread_mutex_t *m = index_stripe(es, slot);
+    pthread_mutex_lock(m);
+    extent_dedup_t d = es->dedup[slot];
+    pthread_mutex_unlock(m);
+    if (d.sum != sum) return 0;
+    // Pinned only while the segment still holds the generation the candidate was written in
+    uint32_t s = loc_segment(d.loc);
+    pthread_mutex_lock(&es->mutex);
+    int pinned = s < es->nseg && es->segs[s].seq == d.seq &&
+                 atomic_load_explicit(&es->segs[s].live, memory_order_relaxed) > 0;
+    if (pinned) atomic_fetch_add_explicit(&es->segs[s].live, (int64_t)LOC_LEN(d.loc), memory_order_relaxed);
+    pthread_mutex_unlock(&es->mutex);
+    if (!pinned) return 0;
+    atomic_fetch_add_explicit(&es->shared_bytes, (int64_t)LOC_LEN(d.loc), memory_order_relaxed);
+    // The hash only nominates the candidate, the bytes decide
+    char cand[BLOCK_SIZE];
+    if (record_fetch(es, d.loc | LOC_SHARED, 0, cand) != 0 || memcmp(cand, page, BLOCK_SIZE) != 0) {
+        record_release(es, d.loc | LOC_SHARED);
+        return 0;
+    }
+    memset(ref, 0, sizeof(*ref));
+    ref->pos = LOC_POS(d.loc);
+    ref->seg_seq = d.seq;
+    ref->len = LOC_LEN(d.loc);
+    return 1;
+}
+
+// Build the record for one page in slot (header filled except seg_seq/crc); returns its size,
+// 0 when the store already returns these bytes for the block
+size_t extent_encode(extent_store_t *es, uint64_t off, const char *page, int hotness, char *slot, uint64_t *sum) {
+    extent_rec_hdr_t *h = (extent_rec_hdr_t*)slot;
+    char *payload = slot + REC_HDR_SIZE;
+    uint64_t block = off / BLOCK_SIZE;
+    int zero;
+    *sum = page_sum(page, &zero);
+    int known = block < es->blocks;
+    if (known && atomic_load_explicit(&es->sum[block], memory_order_relaxed) == *sum) return 0;
+    memset(h, 0, sizeof(*h));
+    h->magic = EXTENT_REC_MAGIC;
+    h->block = block;
+    h->codec = COMPRESS_CODEC_NONE;
+    if (zero) {
+        h->flags = EXTENT_FLAG_ZERO; // Header only
+        return record_size(0);
+    }
+    extent_ref_t ref;
+    if (known && dedup_find(es, *sum, page, &ref)) {
+        h->flags = EXTENT_FLAG_REF;
+        h->clen = sizeof(ref);
+        memcpy(payload, &ref, sizeof(ref));
+        return record_size(h->clen);
+    }
+    compress_codec_t codec;
+    int lvl;
+    int cs = compress_page_auto(page, BLOCK_SIZE, payload, hotness, &codec, &lvl);
+    if (cs > 0) {
+        h->codec = (uint8_t)codec;
+        h->level = (int8_t)lvl;
+        // compress.c uses the dictionary for every positive ZSTD level once it is loaded
+        h->flags = codec == COMPRESS_CODEC_ZSTD && lvl >= 1 && compress_has_dictionary() ? EXTENT_FLAG_DICT : 0;
+        h->clen = (uint32_t)cs;
+    } else {
+        // Does not shrink (or the codec failed): keep the page raw
+        h->clen = BLOCK_SIZE;
+        memcpy(payload, page, BLOCK_SIZE);
+    }
+    size_t rs = record_size(h->clen);
+    memset(payload + h->clen, 0, rs - REC_HDR_SIZE - h->clen);
+    return rs;
+}
+
+// Point the block at a record just written at pos, then drop what it superseded
+static void record_publish(extent_store_t *es, uint64_t block, const char *rec, size_t size, uint64_t sum,
+                           uint64_t pos, uint64_t seq) {
+    const extent_rec_hdr_t *h = (const extent_rec_hdr_t*)rec;
+    uint64_t l = LOC_MAKE(pos, size), ref = 0;
+    if (h->flags & EXTENT_FLAG_REF) {
+        // Readers go straight to the shared record; ref keeps the reference itself alive
+        extent_ref_t r;
+        memcpy(&r, rec + REC_HDR_SIZE, sizeof(r));
+        ref = l;
+        l = LOC_MAKE(r.pos, r.len) | LOC_SHARED;
+    } else if (h->flags & EXTENT_FLAG_ZERO) {
+        l |= LOC_ZERO;
+    } else if (sum) {
+        dedup_note(es, sum, l, seq); // Relocated records of blocks never hashed have no sum to note
+    }
+    pthread_mutex_t *m = index_stripe(es, block);
+    pthread_mutex_lock(m);
+    uint64_t old = atomic_exchange_explicit(&es->loc[block], l, memory_order_acq_rel);
+    uint64_t old_ref = es->ref[block];
+    es->ref[block] = ref;
+    atomic_store_explicit(&es->sum[block], sum, memory_order_relaxed);
+    pthread_mutex_unlock(m);
+    record_release(es, old);
+    record_release(es, old_ref);
+}
+
+static void log_clean_locked(extent_store_t *es);
+
+// Cover the span of a failed append with a filler record, so replay steps over it to the runs
+// reserved behind it (they may already be published); 0 or -1
+static int span_fill(extent_store_t *es, uint64_t pos, size_t span, uint64_t seq) {
+    extent_rec_hdr_t h = { .magic = EXTENT_REC_MAGIC, .flags = EXTENT_FLAG_FILL,
+                           .clen = (uint32_t)(span - REC_HDR_SIZE), .block = UINT64_MAX, .seg_seq = seq };
+    h.crc = record_hdr_crc(&h);
+    // Direct I/O writes the header as a whole zero-padded block, like the segment header
+    alignas(IO_DIRECT_MAX_ALIGN) char block[IO_DIRECT_MAX_ALIGN];
+    size_t len = es->dio_align ? es->dio_align : REC_HDR_SIZE;
+    memset(block, 0, len);
+    memcpy(block, &h, sizeof(h));
+    return io_pwrite(es->log_fd, block, len, pos) == (ssize_t)len ? 0 : -1;
+}
+
+// One run finished (published or failed): the cleaner may be waiting for the last of them
+static void append_done(extent_store_t *es) {
+    pthread_mutex_lock(&es->mutex);
+    if (--es->appending == 0 && es->cleaning) pthread_cond_broadcast(&es->clean_cond);
+    pthread_mutex_unlock(&es->mutex);
+}
+
+// Append the records idx[0..m), one pwritev per run that fits the active segment; returns how many
+// of them were written. When no segment is left the log is cleaned first; the cleaner's own
+// relocations (relocating) do not wait for it and may take the segment kept in reserve
+static int append_runs(extent_store_t *es, const uint64_t *offs, char *const *recs, const size_t *size,
+                       const uint64_t *sums, const int *idx, int m, int relocating) {
+    struct iovec *iov = malloc((size_t)m * sizeof(struct iovec));
+    if (!iov) return 0;
+    int k = 0;
+    while (k < m) {
+        // Reserve the longest run of records that fits into the active segment
+        pthread_mutex_lock(&es->mutex);
+        size_t align = es->dio_align ? es->dio_align : 1;
+        int cleaned = 0, full = 0;
+        for (;;) {
+            while (!relocating && es->cleaning) pthread_cond_wait(&es->clean_cond, &es->mutex);
+            if (es->active != UINT32_MAX && es->active_pos + ALIGN_UP(size[idx[k]], align) <= EXTENT_SEG_SIZE) break;
+            if (segment_roll_locked(es, relocating ? 0 : 1) == 0) break;
+            if (relocating || (cleaned && segment_roll_locked(es, 0) != 0)) {
+                full = 1;
+                break;
+            }
+            if (cleaned) break; // Nothing more to clean: the reserve goes to live data after all
+            log_clean_locked(es);
+            cleaned = 1;
+        }
+        if (full) {
+            pthread_mutex_unlock(&es->mutex);
+            log_extent_message("ERROR", "Extent log is full");
+            errno = ENOSPC;
+            break;
+        }
+        // O_DIRECT: the run is padded to whole device blocks, the next one starts aligned
+        int end = k;
+        size_t run = 0;
+        while (end < m && es->active_pos + ALIGN_UP(run + size[idx[end]], align) <= EXTENT_SEG_SIZE) run += size[idx[end++]];
+        size_t span = (size_t)ALIGN_UP(run, align);
+        uint32_t s = es->active;
+        uint64_t seq = es->segs[s].seq;
+        uint64_t pos = (uint64_t)s * EXTENT_SEG_SIZE + es->active_pos;
+        es->active_pos += span;
+        es->appending++;
+        atomic_fetch_add_explicit(&es->segs[s].live, (int64_t)run, memory_order_relaxed);
+        pthread_mutex_unlock(&es->mutex);
+
+        for (int j = k; j < end; j++) {
+            int i = idx[j];
+            extent_rec_hdr_t *h = (extent_rec_hdr_t*)recs[i];
+            h->seg_seq = seq;
+            h->crc = record_crc(h, recs[i] + REC_HDR_SIZE);
+            iov[j - k].iov_base = recs[i];
+            iov[j - k].iov_len = size[i];
+        }
+        ssize_t w;
+        if (es->dio_align) {
+            // Direct I/O wants aligned buffers and lengths: gather the run into one
+            w = -1;
+            char *stage = aligned_alloc(align, span);
+            if (stage) {
+                size_t at = 0;
+                for (int j = 0; j < end - k; j++) {
+                    memcpy(stage + at, iov[j].iov_base, iov[j].iov_len);
+                    at += iov[j].iov_len;
+                }
+                memset(stage + at, 0, span - at);
+                w = io_pwrite(es->log_fd, stage, span, pos);
+                free(stage);
+            }
+        } else {
+            w = io_pwritev(es->log_fd, iov, end - k, pos);
+        }
+        if (w != (ssize_t)span) {
+            // Nothing of the run is referenced: give the reserved bytes back and mark the span for replay.
+            // Should even the filler fail, replay ends the segment here: stop appending behind it
+            int err = w >= 0 ? EIO : errno;
+            int filled = span_fill(es, pos, span, seq) == 0;
+            if (!filled) {
+                char msg[256];
+                snprintf(msg, sizeof(msg), "Failed append at log offset %lu not marked: records behind it in its segment "
+                         "do not survive a restart", pos);
+                log_extent_message("ERROR", msg);
+            }
+            pthread_mutex_lock(&es->mutex);
+            if (!filled && es->active == s) es->active_pos = EXTENT_SEG_SIZE;
+            atomic_fetch_sub_explicit(&es->segs[s].live, (int64_t)run, memory_order_acq_rel);
+            segment_free_locked(es, s);
+            pthread_mutex_unlock(&es->mutex);
+            append_done(es);
+            errno = err;
+            break;
+        }
+        // Publish the new locations, then drop the records they supersede
+        for (int j = k; j < end; j++) {
+            int i = idx[j];
+            record_publish(es, offs[i] / BLOCK_SIZE, recs[i], size[i], sums[i], pos, seq);
+            pos += size[i];
+        }
+        append_done(es);
+        k = end;
+    }
+    free(iov);
+    return k;
+}
+
+// Records not appended: a reference gives back the bytes it holds on its shared record
+static void records_drop(extent_store_t *es, char *const *recs, const size_t *size, int from, int n) {
+    for (int i = from; i < n; i++) {
+        const extent_rec_hdr_t *h = (const extent_rec_hdr_t*)recs[i];
+        if (size[i] && (h->flags & EXTENT_FLAG_REF)) {
+            extent_ref_t r;
+            memcpy(&r, recs[i] + REC_HDR_SIZE, sizeof(r));
+            record_release(es, LOC_MAKE(r.pos, r.len) | LOC_SHARED);
+        }
+    }
+}
+
+// Does the raw record rec of length len still verify as written in a segment of generation seq
+static int record_intact(const char *rec, uint32_t len, uint64_t seq) {
+    extent_rec_hdr_t h;
+    memcpy(&h, rec, sizeof(h));
+    return h.magic == EXTENT_REC_MAGIC && h.seg_seq == seq && h.clen <= BLOCK_SIZE &&
+           record_size(h.clen) == len && record_crc(&h, rec + REC_HDR_SIZE) == h.crc;
+}
+
+static int relocate_batch(extent_store_t *es, const uint64_t *offs, char *const *recs, const size_t *size,
+                          const uint64_t *sums, const int *idx, int n) {
+    int done = append_runs(es, offs, recs, size, sums, idx, n, 1);
+    records_drop(es, recs, size, done, n);
+    for (int i = 0; i < done; i++) atomic_fetch_add_explicit(&es->bytes_relocated, size[i], memory_order_relaxed);
+    return done == n ? 0 : -1;
+}
+
+// Rewrite every live record of segment v at the end of the log: own records as they are, references
+// held in v with their target pinned again, and blocks sharing a record in v get their own copy of it.
+// Appends are stopped meanwhile, so the index only changes here; v is not reused before the scan
+// is over (es->victim). 0, or -1 when the log ran out of room or could not be read
+static int segment_relocate(extent_store_t *es, uint32_t v, uint64_t seq) {
+    char *stage = malloc((size_t)EXTENT_CLEAN_BATCH * EXTENT_REC_MAX);
+    if (!stage) return -1;
+    alignas(IO_DIRECT_MAX_ALIGN) char buf[RECORD_BUF_SIZE];
+    char *recs[EXTENT_CLEAN_BATCH];
+    uint64_t offs[EXTENT_CLEAN_BATCH], sums[EXTENT_CLEAN_BATCH];
+    size_t size[EXTENT_CLEAN_BATCH];
+    int idx[EXTENT_CLEAN_BATCH];
+    int n = 0, rc = 0, corrupt = 0;
+    for (int i = 0; i < EXTENT_CLEAN_BATCH; i++) {
+        recs[i] = stage + (size_t)i * EXTENT_REC_MAX;
+        idx[i] = i;
+    }
+    for (uint64_t b = 0; b < es->blocks && rc == 0; b++) {
+        pthread_mutex_t *m = index_stripe(es, b);
+        pthread_mutex_lock(m);
+        uint64_t l = atomic_load_explicit(&es->loc[b], memory_order_relaxed), r = es->ref[b];
+        uint64_t sum = atomic_load_explicit(&es->sum[b], memory_order_relaxed);
+        pthread_mutex_unlock(m);
+        int data_in = l && loc_segment(l) == v, ref_in = r && loc_segment(r) == v;
+        if (!data_in && !ref_in) continue;
+        // The record to copy: the data the block reads, or the reference when only that is in v
+        uint64_t src = data_in ? l : r;
+        const char *rec;
+        if (record_load(es, src, buf, &rec) != 0 || !record_intact(rec, LOC_LEN(src), seq)) {
+            corrupt++; // Left where it is: v stays in use
+            continue;
+        }
+        memcpy(recs[n], rec, LOC_LEN(src));
+        extent_rec_hdr_t *h = (extent_rec_hdr_t*)recs[n];
+        if (data_in) {
+            h->block = b; // A shared record becomes this block's own copy
+        } else {
+            // The new reference holds its target like the one it replaces
+            atomic_fetch_add_explicit(&es->segs[loc_segment(l)].live, (int64_t)LOC_LEN(l), memory_order_relaxed);
+            atomic_fetch_add_explicit(&es->shared_bytes, (int64_t)LOC_LEN(l), memory_order_relaxed);
+        }
+        offs[n] = b * BLOCK_SIZE;
+        size[n] = LOC_LEN(src);
+        sums[n] = sum;
+        if (++n < EXTENT_CLEAN_BATCH && b + 1 < es->blocks) continue;
+        rc = relocate_batch(es, offs, recs, size, sums, idx, n);
+        n = 0;
+    }
+    if (n > 0 && rc == 0) rc = relocate_batch(es, offs, recs, size, sums, idx, n);
+    if (corrupt) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Cleaner left %d unreadable records in segment %u", corrupt, v);
+        log_extent_message("ERROR", msg);
+        rc = -1;
+    }
+    free(stage);
+    return rc;
+}
+
+// Free segments by relocating the live data of the emptiest ones until a segment beyond the
+// reserve can be started again. Caller holds es->mutex; it is dropped while records are copied
+static void log_clean_locked(extent_store_t *es) {
+    if (es->cleaning) {
+        // Another appender is cleaning already: its result serves this one too
+        while (es->cleaning) pthread_cond_wait(&es->clean_cond, &es->mutex);
+        return;
+    }
+    es->cleaning = 1;
+    while (es->appending > 0) pthread_cond_wait(&es->clean_cond, &es->mutex);
+    uint8_t *tried = calloc(es->max_segs, 1);
+    while (tried && segments_available_locked(es) < 2) {
+        uint32_t v = UINT32_MAX;
+        int64_t least = 0;
+        for (uint32_t s = 0; s < es->nseg; s++) {
+            if (s == es->active || es->segs[s].seq == 0 || tried[s]) continue;
+            int64_t live = atomic_load_explicit(&es->segs[s].live, memory_order_relaxed);
+            if (v == UINT32_MAX || live < least) {
+                v = s;
+                least = live;
+            }
+        }
+        if (v == UINT32_MAX) break;
+        tried[v] = 1;
+        // Its live records must fit into what is left: the active segment's tail and the reserve
+        uint64_t room = (uint64_t)segments_available_locked(es) * (EXTENT_SEG_SIZE - IO_DIRECT_MAX_ALIGN - EXTENT_REC_MAX);
+        if (es->active != UINT32_MAX) room += EXTENT_SEG_SIZE - es->active_pos;
+        if ((uint64_t)least + EXTENT_REC_MAX > room) break; // The emptiest one does not fit: neither will the others
+        uint64_t seq = es->segs[v].seq;
+        es->victim = v;
+        pthread_mutex_unlock(&es->mutex);
+        int rc = segment_relocate(es, v, seq);
+        pthread_mutex_lock(&es->mutex);
+        es->victim = UINT32_MAX;
+        segment_free_locked(es, v);
+        if (es->segs[v].seq == 0) atomic_fetch_add_explicit(&es->segments_cleaned, 1, memory_order_relaxed);
+        if (rc != 0) break;
+    }
+    free(tried);
+    es->cleaning = 0;
+    pthread_cond_broadcast(&es->clean_cond);
+}
+
+// Append records built by extent_encode; returns how many were written (or elided) from the start of the array
+static int append_records(extent_store_t *es, const uint64_t *offs, char *const *recs, const size_t *size,
+                          const uint64_t *sums, int n, int *clen) {
+    int total = n, done = 0;
+    int *idx = NULL;
+    for (int i = 0; i < n; i++) {
+        if (offs[i] / BLOCK_SIZE >= es->blocks) {
+            n = i; // Outside the logical space of the store
+            break;
+        }
+    }
+    if (n <= 0) {
+        errno = EINVAL;
+        goto out;
+    }
+    idx = malloc((size_t)n * sizeof(int));
+    if (!idx) goto out;
+    // Unchanged pages take no log space: only the rest is appended
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (size[i]) idx[m++] = i;
+    }
+    int k = m ? append_runs(es, offs, recs, size, sums, idx, m, 0) : 0;
+    done = k == m ? n : idx[k];
+out:
+    records_drop(es, recs, size, done, total);
+    for (int i = 0; i < done; i++) {
+        const extent_rec_hdr_t *h = (const extent_rec_hdr_t*)recs[i];
+        int data = size[i] && !(h->flags & (EXTENT_FLAG_ZERO | EXTENT_FLAG_REF));
+        if (clen) clen[i] = data ? (int)h->clen : 0;
+        if (!size[i]) {
+            atomic_fetch_add_explicit(&es->pages_unchanged, 1, memory_order_relaxed);
+        } else if (h->flags & EXTENT_FLAG_ZERO) {
+            atomic_fetch_add_explicit(&es->pages_zero, 1, memory_order_relaxed);
+        } else if (h->flags & EXTENT_FLAG_REF) {
+            atomic_fetch_add_explicit(&es->pages_deduped, 1, memory_order_relaxed);
+        } else {
+            atomic_fetch_add_explicit(&es->pages_by_codec[h->codec], 1, memory_order_relaxed);
+        }
+        atomic_fetch_add_explicit(&es->bytes_stored, size[i], memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&es->pages_written, (uint64_t)done, memory_order_relaxed);
+    free(idx);
+    return done;
+}
+
+static int write_records(extent_store_t *es, const uint64_t *offs, const char *const *pages, int n, int hotness, int *clen) {
+    if (n <= 0) {
+        errno = EINVAL;
+        return 0;
+    }
+    char *stage = malloc((size_t)n * EXTENT_REC_MAX);
+    size_t *size = malloc((size_t)n * sizeof(size_t));
+    uint64_t *sums = malloc((size_t)n * sizeof(uint64_t));
+    char **recs = malloc((size_t)n * sizeof(char*));
+    if (!stage || !size || !sums || !recs) {
+        free(stage);
+        free(size);
+        free(sums);
+        free(recs);
+        return 0;
+    }
+    // Compression runs outside the append lock
+    for (int i = 0; i < n; i++) {
+        recs[i] = stage + (size_t)i * EXTENT_REC_MAX;
+        size[i] = extent_encode(es, offs[i], pages[i], hotness, recs[i], &sums[i]);
+    }
+    int done = append_records(es, offs, recs, size, sums, n, clen);
+    free(stage);
+    free(size);
+    free(sums);
+    free(recs);
+    return done;
+}
+
+int extent_write(extent_store_t *es, uint64_t off, const char *page, int hotness) {
+    int clen = 0;
+    return write_records(es, &off, &page, 1, hotness, &clen) == 1 ? clen : -1;
+}
+
+int extent_write_batch(extent_store_t *es, const uint64_t *offs, const char *const *pages, int n, int hotness) {
+    return write_records(es, offs, pages, n, hotness, NULL);
+}
+
+int extent_append(extent_store_t *es, const uint64_t *offs, char *const *recs, const size_t *sizes,
+                  const uint64_t *sums, int n) {
+    return append_records(es, offs, recs, sizes, sums, n, NULL);
+}
+
+void extent_stats(extent_store_t *es, extent_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->pages_written = atomic_load_explicit(&es->pages_written, memory_order_relaxed);
+    out->bytes_logical = out->pages_written * BLOCK_SIZE;
+    out->bytes_stored = atomic_load_explicit(&es->bytes_stored, memory_order_relaxed);
+    for (int i = 0; i < COMPRESS_CODECS; i++) {
+        out->pages_by_codec[i] = atomic_load_explicit(&es->pages_by_codec[i], memory_order_relaxed);
+    }
+    out->pages_unchanged = atomic_load_explicit(&es->pages_unchanged, memory_order_relaxed);
+    out->pages_zero = atomic_load_explicit(&es->pages_zero, memory_order_relaxed);
+    out->pages_deduped = atomic_load_explicit(&es->pages_deduped, memory_order_relaxed);
+    out->segments_cleaned = atomic_load_explicit(&es->segments_cleaned, memory_order_relaxed);
+    out->bytes_relocated = atomic_load_explicit(&es->bytes_relocated, memory_order_relaxed);
+    pthread_mutex_lock(&es->mutex);
+    out->segments_used = es->nseg - es->nfree;
+    out->segments_free = es->nfree;
+    for (uint32_t s = 0; s < es->nseg; s++) {
+        int64_t live = atomic_load_explicit(&es->segs[s].live, memory_order_relaxed);
+        if (live > 0) out->live_bytes += (uint64_t)live;
+    }
+    pthread_mutex_unlock(&es->mutex);
+    // Bytes held by references are the shared records counted once more
+    int64_t shared = atomic_load_explicit(&es->shared_bytes, memory_order_relaxed);
+    if (shared > 0) out->live_bytes = (uint64_t)shared < out->live_bytes ? out->live_bytes - (uint64_t)shared : 0;
+}
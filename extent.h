@@ -0,0 +1,176 @@
+#ifndef EXTENT_H
+#define EXTENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "config.h"
+#include "compress.h"
+
+// Хранилище экстентов: сжатые страницы дописываются в журнал сегментами,
+// индекс блок -> экстент восстанавливается сканированием журнала при открытии.
+// Блоки, которых нет в журнале, читаются из образа по их собственному смещению.
+// Когда свободных сегментов не остаётся, чистильщик переписывает живые записи самых пустых
+// сегментов в конец журнала, и те освобождаются; один сегмент всегда оставлен ему в запас.
+// Перед записью содержимое сравнивается по хешу с тем, что хранилище уже отдаёт для блока
+// (хеш снимается при чтении и записи): такая страница не пишется вовсе, нулевая становится
+// дырой (запись без данных), а совпавшая с другой записью — ссылкой на неё.
+
+#ifndef EXTENT_SEGMENT_MB
+#define EXTENT_SEGMENT_MB 4             // размер сегмента журнала
+#endif
+#ifndef EXTENT_LOG_MB
+#define EXTENT_LOG_MB 0                 // предел журнала; 0 — вдвое больше образа. Сегменты без живых записей переиспользуются
+#endif
+#ifndef EXTENT_CLEAN_BATCH
+#define EXTENT_CLEAN_BATCH 64           // записей, переносимых чистильщиком одной дозаписью
+#endif
+#ifndef EXTENT_DEDUP
+#define EXTENT_DEDUP 1                  // 1 — одинаковые страницы разных блоков хранятся одной записью
+#endif
+#ifndef EXTENT_DEDUP_ENTRIES
+#define EXTENT_DEDUP_ENTRIES 0          // таблица хеш -> запись для поиска дубликатов; 0 — блоков / 8
+#endif
+#ifndef EXTENT_INDEX_STRIPES
+#define EXTENT_INDEX_STRIPES 64         // полос блокировок замены записи блока, степень двойки
+#endif
+
+#define EXTENT_SEG_SIZE ((uint64_t)EXTENT_SEGMENT_MB * 1024 * 1024)
+#define EXTENT_SEG_MAGIC 0x47534350u    // "PCSG"
+#define EXTENT_REC_MAGIC 0x58454350u    // "PCEX"
+#define EXTENT_VERSION 2                // 2: дыры и ссылки; сегменты версии 1 читаются как прежде
+
+enum {
+    EXTENT_FLAG_DICT = 1,               // сжато со словарём (compress_setup_dictionary)
+    EXTENT_FLAG_ZERO = 2,               // нулевая страница: записи без данных (clen = 0)
+    EXTENT_FLAG_REF = 4,                // страница совпадает с другой записью: данные — extent_ref_t
+    EXTENT_FLAG_FILL = 8                // заполнитель на месте неудавшейся дозаписи: clen байт пропускаются,
+                                        // crc — только заголовка; блока нет (UINT64_MAX)
+};
+
+// Заголовок сегмента; seq растёт при каждом новом использовании сегмента
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;
+} extent_seg_hdr_t;
+
+// Заголовок записи; запись выровнена на 8 байт, crc — CRC32C заголовка (crc = 0) и данных
+typedef struct {
+    uint32_t magic;
+    uint8_t codec;                      // compress_codec_t; NONE — страница как есть
+    int8_t level;                       // уровень ZSTD (может быть отрицательным) или ускорение LZ4
+    uint16_t flags;
+    uint32_t clen;                      // байт полезной нагрузки
+    uint32_t crc;
+    uint64_t block;                     // логический блок (смещение / BLOCK_SIZE)
+    uint64_t seg_seq;                   // seq сегмента на момент записи: отсекает старые хвосты
+} extent_rec_hdr_t;
+
+// Полезная нагрузка ссылки: запись другого блока с тем же содержимым
+typedef struct {
+    uint64_t pos;                       // смещение записи в журнале
+    uint64_t seg_seq;                   // seq её сегмента: ссылка действительна, пока сегмент не переиспользован
+    uint32_t len;                       // длина записи
+    uint32_t reserved;
+} extent_ref_t;
+
+#define EXTENT_REC_MAX ((sizeof(extent_rec_hdr_t) + BLOCK_SIZE + 7) & ~(size_t)7)
+// С O_DIRECT пакет записей дополняется нулями до блока устройства; при восстановлении
+// нули пропускаются до следующей границы EXTENT_PAD_ALIGN (наименьший сектор)
+#define EXTENT_PAD_ALIGN 512
+
+typedef struct {
+    _Atomic int64_t live;               // байт записей, на которые ссылается индекс
+    uint64_t seq;                       // 0 — сегмент свободен
+} extent_segment_t;
+
+typedef struct {
+    uint64_t pages_written;
+    uint64_t bytes_logical;             // pages_written * BLOCK_SIZE
+    uint64_t bytes_stored;              // байт записей, дописанных в журнал
+    uint64_t pages_by_codec[COMPRESS_CODECS]; // NONE — несжимаемые страницы
+    uint64_t segments_used;
+    uint64_t segments_free;
+    uint64_t live_bytes;
+    uint64_t pages_unchanged;           // не записаны: то же содержимое уже в хранилище
+    uint64_t pages_zero;                // записаны дырами
+    uint64_t pages_deduped;             // записаны ссылками на одинаковую страницу
+    uint64_t segments_cleaned;          // освобождено чистильщиком
+    uint64_t bytes_relocated;           // байт живых записей, переписанных им
+} extent_stats_t;
+
+// Полоса блокировок замены записи блока (loc, ref и sum меняются вместе)
+typedef struct {
+    _Alignas(64) pthread_mutex_t mutex;
+} extent_stripe_t;
+
+// Кандидат для дедупликации: последняя запись с таким хешем содержимого
+typedef struct {
+    uint64_t sum;
+    uint64_t loc;
+    uint64_t seq;                       // seq сегмента записи; сегмент переиспользован — кандидат устарел
+} extent_dedup_t;
+
+typedef struct {
+    int log_fd;
+    int image_fd;                       // исходные страницы, ещё не попавшие в журнал
+    uint64_t blocks;
+    // На блок: (смещение записи в журнале << 16) | флаги | длина записи; 0 — блока нет в журнале.
+    // Для ссылки loc указывает прямо на запись с данными, а ref — на саму запись-ссылку
+    _Atomic uint64_t *loc;
+    uint64_t *ref;
+    _Atomic uint64_t *sum;              // хеш содержимого, которое хранилище отдаёт для блока; 0 — неизвестно
+    extent_stripe_t *stripes;
+    extent_dedup_t *dedup;              // NULL — без дедупликации
+    size_t dedup_mask;
+    extent_segment_t *segs;
+    uint32_t nseg, max_segs;
+    uint32_t *free_segs;
+    uint32_t nfree;
+    pthread_mutex_t mutex;              // курсор дозаписи и выбор сегментов
+    uint32_t active;
+    uint32_t victim;                    // сегмент, который переносит чистильщик: не освобождается до конца переноса
+    uint64_t active_pos;
+    uint64_t next_seq;
+    pthread_cond_t clean_cond;          // под mutex: чистильщик ждёт конца начатых дозаписей, дозаписи — конца чистки
+    int cleaning;
+    int appending;                      // зарезервировано прогонов, ещё не опубликованных
+    size_t dio_align;                   // журнал открыт с O_DIRECT: дозапись блоками этого размера; 0 — через page cache
+    _Atomic uint64_t pages_written;
+    _Atomic uint64_t bytes_stored;
+    _Atomic uint64_t pages_by_codec[COMPRESS_CODECS];
+    _Atomic uint64_t pages_unchanged;
+    _Atomic uint64_t pages_zero;
+    _Atomic uint64_t pages_deduped;
+    _Atomic int64_t shared_bytes;        // байт live, которые держат ссылки на чужие записи (в live_bytes не входят)
+    _Atomic uint64_t segments_cleaned;
+    _Atomic uint64_t bytes_relocated;
+} extent_store_t;
+
+// Открывает (создаёт) журнал и восстанавливает индекс для logical_bytes логического пространства
+int extent_open(extent_store_t *es, const char *log_path, int image_fd, uint64_t logical_bytes);
+void extent_close(extent_store_t *es);
+// Переоткрывает журнал с O_DIRECT (после extent_open: восстановление читает его как обычно);
+// 0 или -1 с errno — журнал остаётся в page cache
+int extent_set_direct(extent_store_t *es, const char *log_path);
+// Читает BLOCK_SIZE байт по логическому смещению; семантика pread (-1 и errno при ошибке)
+ssize_t extent_read(extent_store_t *es, uint64_t off, char *page);
+// Сжимает (кодек по горячести hotness, см. compress_page_auto) и дописывает;
+// возвращает байт сжатых данных (0 — страница не изменилась, стала дырой или ссылкой) или -1
+int extent_write(extent_store_t *es, uint64_t off, const char *page, int hotness);
+// Пакет одной дозаписью на сегмент; возвращает число записанных страниц (с начала массива)
+int extent_write_batch(extent_store_t *es, const uint64_t *offs, const char *const *pages, int n, int hotness);
+// Раздельные сжатие и дозапись (конвейер): extent_encode строит запись в rec
+// (EXTENT_REC_MAX байт) без блокировок дозаписи и возвращает её размер (0 — писать нечего,
+// содержимое уже в хранилище), в sum — хеш страницы; extent_append дописывает готовые записи
+// с их хешами и возвращает число записанных с начала массива
+size_t extent_encode(extent_store_t *es, uint64_t off, const char *page, int hotness, char *rec, uint64_t *sum);
+int extent_append(extent_store_t *es, const uint64_t *offs, char *const *recs, const size_t *sizes,
+                  const uint64_t *sums, int n);
+void extent_stats(extent_store_t *es, extent_stats_t *out);
+
+#endif // EXTENT_H
@@ -0,0 +1,283 @@
+// Модуль ввода-вывода для PseudoCore: синхронный путь и io_uring с кольцом на ядро
+#define _GNU_SOURCE
+#include "io_backend.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#ifdef PSEUDO_HAVE_IO_URING
+#include <liburing.h>
+#endif
+
+static io_backend_kind_t backend = IO_BACKEND_SYNC;
+
+// Synchronous execution of one request; result follows the io_request_t convention
+static void sync_execute(io_request_t *r) {
+    ssize_t ret;
+    if (r->iov) {
+        ret = r->write ? pwritev(r->fd, r->iov, r->iovcnt, (off_t)r->offset)
+                       : preadv(r->fd, r->iov, r->iovcnt, (off_t)r->offset);
+    } else {
+        ret = r->write ? pwrite(r->fd, r->buf, r->len, (off_t)r->offset)
+                       : pread(r->fd, r->buf, r->len, (off_t)r->offset);
+    }
+    r->result = ret < 0 ? -errno : ret;
+}
+
+#ifdef PSEUDO_HAVE_IO_URING
+// Per-thread ring; the registered buffer (index 0) is normally the core's cache arena
+typedef struct {
+    struct io_uring ring;
+    char *reg_base;
+    size_t reg_len;
+} io_thread_ctx_t;
+
+static _Thread_local io_thread_ctx_t *tctx;
+static pthread_key_t ctx_key;
+static pthread_once_t ctx_key_once = PTHREAD_ONCE_INIT;
+
+static void ctx_free(void *v) {
+    io_thread_ctx_t *t = v;
+    if (!t) return;
+    if (t->reg_base) io_uring_unregister_buffers(&t->ring);
+    io_uring_queue_exit(&t->ring);
+    free(t);
+}
+
+static void ctx_key_create(void) {
+    pthread_key_create(&ctx_key, ctx_free);
+}
+
+// Ring of the calling thread, created on first use; NULL means fall back to sync I/O
+static io_thread_ctx_t *ctx_get(void) {
+    if (tctx) return tctx;
+    pthread_once(&ctx_key_once, ctx_key_create);
+    io_thread_ctx_t *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    int ret = io_uring_queue_init(IO_URING_DEPTH, &t->ring, 0);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring_queue_init failed (errno: %d), using synchronous I/O\n", -ret);
+        free(t);
+        return NULL;
+    }
+    pthread_setspecific(ctx_key, t);
+    tctx = t;
+    return t;
+}
+
+static int in_registered(const io_thread_ctx_t *t, const void *buf, size_t len) {
+    const char *p = buf;
+    return t->reg_base && p >= t->reg_base && p + len <= t->reg_base + t->reg_len;
+}
+
+static void uring_prep(io_thread_ctx_t *t, struct io_uring_sqe *sqe, io_request_t *r) {
+    if (r->iov) {
+        if (r->write) io_uring_prep_writev(sqe, r->fd, r->iov, (unsigned)r->iovcnt, r->offset);
+        else io_uring_prep_readv(sqe, r->fd, r->iov, (unsigned)r->iovcnt, r->offset);
+    } else if (in_registered(t, r->buf, r->len)) {
+        if (r->write) io_uring_prep_write_fixed(sqe, r->fd, r->buf, (unsigned)r->len, r->offset, 0);
+        else io_uring_prep_read_fixed(sqe, r->fd, r->buf, (unsigned)r->len, r->offset, 0);
+    } else {
+        if (r->write) io_uring_prep_write(sqe, r->fd, r->buf, (unsigned)r->len, r->offset);
+        else io_uring_prep_read(sqe, r->fd, r->buf, (unsigned)r->len, r->offset);
+    }
+    io_uring_sqe_set_data(sqe, r);
+}
+
+// Keep the ring full: submit as many as fit, reap completions, refill until all are done
+static int uring_submit_batch(io_thread_ctx_t *t, io_request_t *reqs, int n) {
+    int queued = 0, done = 0;
+    for (int i = 0; i < n; i++) reqs[i].result = -ECANCELED;
+    while (done < n) {
+        while (queued < n) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&t->ring);
+            if (!sqe) break;
+            uring_prep(t, sqe, &reqs[queued++]);
+        }
+        int ret = io_uring_submit_and_wait(&t->ring, 1);
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            // Ring is unusable: finish whatever was not queued synchronously, report the rest
+            fprintf(stderr, "io_uring submit failed (errno: %d)\n", -ret);
+            for (int i = queued; i < n; i++) sync_execute(&reqs[i]);
+            return -1;
+        }
+        struct io_uring_cqe *cqe;
+        unsigned head, seen = 0;
+        io_uring_for_each_cqe(&t->ring, head, cqe) {
+            io_request_t *r = io_uring_cqe_get_data(cqe);
+            r->result = cqe->res;
+            seen++;
+        }
+        io_uring_cq_advance(&t->ring, seen);
+        done += (int)seen;
+    }
+    return 0;
+}
+#endif
+
+int io_backend_init(io_backend_kind_t kind) {
+#ifdef PSEUDO_HAVE_IO_URING
+    backend = kind;
+#else
+    if (kind == IO_BACKEND_URING) {
+        fprintf(stderr, "io_uring backend not built in (make WITH_URING=1), using synchronous I/O\n");
+    }
+    backend = IO_BACKEND_SYNC;
+#endif
+    return backend == kind ? 0 : -1;
+}
+
+io_backend_kind_t io_backend_kind(void) {
+    return backend;
+}
+
+const char *io_backend_name(void) {
+    return backend == IO_BACKEND_URING ? "io_uring" : "sync";
+}
+
+int io_thread_init(void) {
+#ifdef PSEUDO_HAVE_IO_URING
+    if (backend == IO_BACKEND_URING && !ctx_get()) return -1;
+#endif
+    return 0;
+}
+
+void io_thread_destroy(void) {
+#ifdef PSEUDO_HAVE_IO_URING
+    if (tctx) {
+        pthread_setspecific(ctx_key, NULL);
+        ctx_free(tctx);
+        tctx = NULL;
+    }
+#endif
+}
+
+int io_register_buffers(void *base, size_t len) {
+#ifdef PSEUDO_HAVE_IO_URING
+    if (backend != IO_BACKEND_URING) return 0;
+    io_thread_ctx_t *t = ctx_get();
+    if (!t) return -1;
+    if (t->reg_base) {
+        io_uring_unregister_buffers(&t->ring);
+        t->reg_base = NULL;
+        t->reg_len = 0;
+    }
+    struct iovec iov = { .iov_base = base, .iov_len = len };
+    int ret = io_uring_register_buffers(&t->ring, &iov, 1);
+    if (ret < 0) {
+        // Usually RLIMIT_MEMLOCK; plain (unregistered) reads still work
+        fprintf(stderr, "io_uring buffer registration failed (errno: %d)\n", -ret);
+        return -1;
+    }
+    t->reg_base = base;
+    t->reg_len = len;
+#else
+    (void)base;
+    (void)len;
+#endif
+    return 0;
+}
+
+int io_submit_batch(io_request_t *reqs, int n) {
+    if (n <= 0) return 0;
+    uint64_t t0 = metrics_now();
+#ifdef PSEUDO_HAVE_IO_URING
+    io_thread_ctx_t *t = backend == IO_BACKEND_URING ? ctx_get() : NULL;
+    if (t) {
+        uring_submit_batch(t, reqs, n);
+    } else
+#endif
+    {
+        for (int i = 0; i < n; i++) sync_execute(&reqs[i]);
+    }
+    // One sample per submission: a batch is timed as the caller waits for it
+    metrics_record(reqs[0].write ? METRIC_PWRITE : METRIC_PREAD, t0);
+    int failed = 0;
+    for (int i = 0; i < n; i++) {
+        if (reqs[i].result < 0) failed++;
+    }
+    return failed;
+}
+
+// Single request through the batch path, mapped back to pread/pwrite conventions
+static ssize_t single(io_request_t *r) {
+    if (backend == IO_BACKEND_SYNC) {
+        uint64_t t0 = metrics_now();
+        sync_execute(r);
+        metrics_record(r->write ? METRIC_PWRITE : METRIC_PREAD, t0);
+    } else {
+        io_submit_batch(r, 1);
+    }
+    if (r->result < 0) {
+        errno = (int)-r->result;
+        return -1;
+    }
+    return r->result;
+}
+
+ssize_t io_pread(int fd, void *buf, size_t len, uint64_t off) {
+    io_request_t r = { .fd = fd, .write = 0, .buf = buf, .len = len, .offset = off };
+    return single(&r);
+}
+
+ssize_t io_pwrite(int fd, const void *buf, size_t len, uint64_t off) {
+    io_request_t r = { .fd = fd, .write = 1, .buf = (void*)buf, .len = len, .offset = off };
+    return single(&r);
+}
+
+ssize_t io_preadv(int fd, const struct iovec *iov, int iovcnt, uint64_t off) {
+    io_request_t r = { .fd = fd, .write = 0, .iov = iov, .iovcnt = iovcnt, .offset = off };
+    return single(&r);
+}
+
+ssize_t io_pwritev(int fd, const struct iovec *iov, int iovcnt, uint64_t off) {
+    io_request_t r = { .fd = fd, .write = 1, .iov = iov, .iovcnt = iovcnt, .offset = off };
+    return single(&r);
+}
+
+// Alignment direct I/O needs on fd: statx where the kernel reports it, the logical sector
+// size of a block device, otherwise the file system block (a safe upper bound)
+static size_t direct_alignment(int fd) {
+#ifdef STATX_DIOALIGN
+    struct statx stx;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN)) {
+        if (stx.stx_dio_offset_align == 0) return 0; // Not supported for this file
+        return stx.stx_dio_mem_align > stx.stx_dio_offset_align ? stx.stx_dio_mem_align : stx.stx_dio_offset_align;
+    }
+#endif
+    struct stat st;
+    if (fstat(fd, &st) != 0) return 0;
+    int sector = 0;
+    if (S_ISBLK(st.st_mode) && ioctl(fd, BLKSSZGET, &sector) == 0 && sector > 0) return (size_t)sector;
+    return st.st_blksize > 0 ? (size_t)st.st_blksize : IO_DIRECT_MAX_ALIGN;
+}
+
+int io_open_direct(const char *path, int flags, size_t *align) {
+    int fd = open(path, flags | O_DIRECT);
+    if (fd < 0) return -1;
+    size_t a = direct_alignment(fd);
+    if (a == 0 || a > IO_DIRECT_MAX_ALIGN || (a & (a - 1))) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    // Some file systems accept the flag at open and refuse the first transfer instead
+    void *probe = aligned_alloc(IO_DIRECT_MAX_ALIGN, IO_DIRECT_MAX_ALIGN);
+    ssize_t r = probe ? pread(fd, probe, a, 0) : -1;
+    int err = errno;
+    free(probe);
+    if (r < 0) {
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    *align = a;
+    return fd;
+}
@@ -0,0 +1,67 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "config.h"
+
+// Бэкенд ввода-вывода: синхронный pread/pwrite или io_uring (сборка с WITH_URING=1)
+typedef enum {
+    IO_BACKEND_SYNC = 0,
+    IO_BACKEND_URING
+} io_backend_kind_t;
+
+#ifndef IO_BACKEND_DEFAULT
+#ifdef PSEUDO_HAVE_IO_URING
+#define IO_BACKEND_DEFAULT IO_BACKEND_URING
+#else
+#define IO_BACKEND_DEFAULT IO_BACKEND_SYNC
+#endif
+#endif
+
+#ifndef IO_URING_DEPTH
+#define IO_URING_DEPTH 64       // глубина очереди кольца на поток
+#endif
+#define IO_DIRECT_MAX_ALIGN 4096 // кадры кэша выровнены на страницу: устройства с большим блоком остаются без O_DIRECT
+
+// Один запрос пакета; iov != NULL — векторный запрос (buf/len игнорируются)
+typedef struct {
+    int fd;
+    int write;                  // 0 — чтение, 1 — запись
+    void *buf;
+    size_t len;
+    const struct iovec *iov;
+    int iovcnt;
+    uint64_t offset;
+    ssize_t result;             // байт передано или -errno
+} io_request_t;
+
+// Выбор бэкенда на процесс; вызывать до запуска потоков. Без io_uring — откат на sync
+int io_backend_init(io_backend_kind_t kind);
+io_backend_kind_t io_backend_kind(void);
+const char *io_backend_name(void);
+
+// Кольцо создаётся на поток при первом обращении; destroy освобождает его явно
+int io_thread_init(void);
+void io_thread_destroy(void);
+// Регистрирует область (арену кэша) как фиксированный буфер кольца текущего потока
+int io_register_buffers(void *base, size_t len);
+
+// Отправляет все запросы одним пакетом и ждёт их завершения; возвращает число неудачных
+int io_submit_batch(io_request_t *reqs, int n);
+
+// Одиночные операции с семантикой pread/pwrite: -1 и errno при ошибке
+ssize_t io_pread(int fd, void *buf, size_t len, uint64_t off);
+ssize_t io_pwrite(int fd, const void *buf, size_t len, uint64_t off);
+ssize_t io_preadv(int fd, const struct iovec *iov, int iovcnt, uint64_t off);
+ssize_t io_pwritev(int fd, const struct iovec *iov, int iovcnt, uint64_t off);
+
+// Открывает path с O_DIRECT; *align — выравнивание смещений, длин и адресов буферов
+// (логический блок устройства). -1 и errno (EINVAL), если файловая система O_DIRECT
+// не принимает или просит выравнивание больше IO_DIRECT_MAX_ALIGN
+int io_open_direct(const char *path, int flags, size_t *align);
+
+#endif // IO_BACKEND_H
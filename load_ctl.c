@@ -0,0 +1,147 @@
+#include "load_ctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+// Pressure is shared by all controllers of the process and refreshed by whichever core gets there first
+static _Atomic uint64_t pressure_read_at;
+static _Atomic uint64_t pressure_x100;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// CPU pressure in percent: PSI "some avg10" when the kernel has it, loadavg per CPU otherwise
+static double read_pressure(void) {
+    FILE *f = fopen("/proc/pressure/cpu", "r");
+    if (f) {
+        double avg10;
+        int ok = fscanf(f, "some avg10=%lf", &avg10) == 1;
+        fclose(f);
+        if (ok) return avg10;
+    }
+    double load;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (getloadavg(&load, 1) == 1 && cpus > 0) return load / (double)cpus * 100.0;
+    return 0.0;
+}
+
+static double pressure_get(uint64_t now) {
+    uint64_t last = atomic_load_explicit(&pressure_read_at, memory_order_relaxed);
+    if ((last == 0 || now - last >= LOADCTL_PRESSURE_INTERVAL_NS) &&
+        atomic_compare_exchange_strong(&pressure_read_at, &last, now)) {
+        atomic_store_explicit(&pressure_x100, (uint64_t)(read_pressure() * 100.0), memory_order_relaxed);
+    }
+    return (double)atomic_load_explicit(&pressure_x100, memory_order_relaxed) / 100.0;
+}
+
+// Log-linear buckets: exact below 4 ns, then 4 per power of two
+static int hist_bucket(uint64_t ns) {
+    if (ns < 4) return (int)ns;
+    int e = 63 - __builtin_clzll(ns);
+    int idx = 4 * (e - 1) + (int)((ns >> (e - 2)) & 3);
+    return idx < LOADCTL_HIST_BUCKETS ? idx : LOADCTL_HIST_BUCKETS - 1;
+}
+
+static uint64_t hist_upper(int idx) {
+    if (idx < 4) return (uint64_t)idx;
+    int e = idx / 4 + 1;
+    return (uint64_t)(4 + idx % 4 + 1) << (e - 2);
+}
+
+static uint64_t hist_percentile(const uint32_t *hist, uint64_t total, double q) {
+    uint64_t rank = (uint64_t)(q * (double)total);
+    uint64_t seen = 0;
+    for (int i = 0; i < LOADCTL_HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > rank) return hist_upper(i);
+    }
+    return hist_upper(LOADCTL_HIST_BUCKETS - 1);
+}
+
+void loadctl_init(loadctl_t *lc, loadctl_mode_t mode, double budget, int queue_limit) {
+    memset(lc, 0, sizeof(*lc));
+    lc->mode = mode;
+    lc->queue_limit = queue_limit > 0 ? queue_limit : 0;
+    lc->max_duty = 1.0;
+    if (mode == LOADCTL_BACKGROUND) {
+        lc->max_duty = budget > LOADCTL_MIN_DUTY && budget < 1.0 ? budget : 1.0;
+    }
+    lc->duty = lc->max_duty;
+    lc->window_start = now_ns();
+}
+
+const char *loadctl_mode_name(loadctl_mode_t mode) {
+    switch (mode) {
+    case LOADCTL_NO_THROTTLE: return "no-throttle";
+    case LOADCTL_LATENCY: return "latency";
+    case LOADCTL_BACKGROUND: return "background";
+    }
+    return "unknown";
+}
+
+void loadctl_begin(loadctl_t *lc) {
+    lc->op_start = now_ns();
+}
+
+// Close the window: percentiles, congestion verdict and the AIMD step
+static void window_close(loadctl_t *lc, uint64_t now) {
+    uint64_t span = now - lc->window_start;
+    lc->p50_ns = hist_percentile(lc->hist, lc->window_ops, 0.50);
+    lc->p99_ns = hist_percentile(lc->hist, lc->window_ops, 0.99);
+    lc->ops_per_sec = span > 0 ? (double)lc->window_ops * 1e9 / (double)span : 0.0;
+    lc->pressure = pressure_get(now);
+    lc->congested = lc->p99_ns > LOADCTL_LATENCY_TARGET_NS ||
+                    lc->backlog > LOADCTL_DIRTY_LIMIT ||
+                    (lc->queue_limit && lc->queue_depth > lc->queue_limit) ||
+                    lc->pressure > LOADCTL_PRESSURE_LIMIT;
+    lc->congested_run = lc->congested ? lc->congested_run + 1 : 0;
+    lc->overloaded = lc->congested_run >= LOADCTL_OVERLOAD_WINDOWS;
+    lc->windows++;
+    if (lc->congested) lc->congested_windows++;
+    if (lc->mode != LOADCTL_NO_THROTTLE) {
+        if (lc->congested) {
+            lc->duty *= LOADCTL_MD_FACTOR;
+            if (lc->duty < LOADCTL_MIN_DUTY) lc->duty = LOADCTL_MIN_DUTY;
+        } else {
+            lc->duty += LOADCTL_AI_STEP;
+            if (lc->duty > lc->max_duty) lc->duty = lc->max_duty;
+        }
+    }
+    memset(lc->hist, 0, sizeof(lc->hist));
+    lc->window_ops = 0;
+    lc->window_start = now;
+}
+
+int loadctl_end(loadctl_t *lc, int queue_depth, double dirty_backlog) {
+    uint64_t now = now_ns();
+    uint64_t work = now - lc->op_start;
+    lc->hist[hist_bucket(work)]++;
+    lc->window_ops++;
+    lc->queue_depth = queue_depth;
+    lc->backlog = dirty_backlog;
+    int closed = 0;
+    if (now - lc->window_start >= LOADCTL_WINDOW_NS) {
+        window_close(lc, now);
+        closed = 1;
+    }
+    if (lc->duty >= 1.0) return closed;
+    // Idle for work * (1 - duty) / duty per operation, paid in sleeps of at least LOADCTL_MIN_SLEEP_NS
+    lc->sleep_debt += (uint64_t)((double)work * (1.0 - lc->duty) / lc->duty);
+    if (lc->sleep_debt >= LOADCTL_MIN_SLEEP_NS) {
+        uint64_t d = lc->sleep_debt < LOADCTL_MAX_SLEEP_NS ? lc->sleep_debt : LOADCTL_MAX_SLEEP_NS;
+        struct timespec ts = { (time_t)(d / 1000000000ull), (long)(d % 1000000000ull) };
+        nanosleep(&ts, NULL);
+        uint64_t slept = now_ns() - now;
+        lc->slept_ns += slept;
+        lc->sleep_debt = slept >= lc->sleep_debt ? 0 : lc->sleep_debt - slept;
+        // Debt beyond one capped pause is forgiven: the next window recomputes the duty anyway
+        if (lc->sleep_debt > LOADCTL_MAX_SLEEP_NS) lc->sleep_debt = LOADCTL_MAX_SLEEP_NS;
+    }
+    return closed;
+}
@@ -0,0 +1,86 @@
+#ifndef LOAD_CTL_H
+#define LOAD_CTL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Регулятор нагрузки ядра: измеряет длительность операций и сигналы перегрузки,
+// по итогам окна меняет долю рабочего времени (AIMD) и досыпает разницу
+
+#ifndef LOADCTL_WINDOW_NS
+#define LOADCTL_WINDOW_NS 50000000ull   // окно измерений: 50 мс
+#endif
+#ifndef LOADCTL_LATENCY_TARGET_NS
+#define LOADCTL_LATENCY_TARGET_NS 2000000ull // цель для p99 длительности операции: 2 мс
+#endif
+#ifndef LOADCTL_DIRTY_LIMIT
+#define LOADCTL_DIRTY_LIMIT 0.5         // доля грязных страниц кэша, выше которой флашер не успевает
+#endif
+#ifndef LOADCTL_PRESSURE_LIMIT
+#define LOADCTL_PRESSURE_LIMIT 40.0     // PSI cpu "some avg10", %; без PSI — loadavg на CPU * 100
+#endif
+#ifndef LOADCTL_PRESSURE_INTERVAL_NS
+#define LOADCTL_PRESSURE_INTERVAL_NS 1000000000ull // давление читается не чаще раза в секунду на процесс
+#endif
+#ifndef LOADCTL_AI_STEP
+#define LOADCTL_AI_STEP 0.05            // прибавка доли рабочего времени за спокойное окно
+#endif
+#ifndef LOADCTL_MD_FACTOR
+#define LOADCTL_MD_FACTOR 0.5           // множитель доли при перегрузке
+#endif
+#ifndef LOADCTL_MIN_DUTY
+#define LOADCTL_MIN_DUTY 0.02
+#endif
+#ifndef LOADCTL_MIN_SLEEP_NS
+#define LOADCTL_MIN_SLEEP_NS 1000000ull // долг сна копится до 1 мс, чтобы не спать по микросекундам
+#endif
+#ifndef LOADCTL_MAX_SLEEP_NS
+#define LOADCTL_MAX_SLEEP_NS 100000000ull // одна пауза не дольше 100 мс: остановка не ждёт
+#endif
+#ifndef LOADCTL_OVERLOAD_WINDOWS
+#define LOADCTL_OVERLOAD_WINDOWS 3      // окон перегрузки подряд до признания ядра перегруженным
+#endif
+
+#define LOADCTL_HIST_BUCKETS 128        // 4 корзины на октаву наносекунд
+
+typedef enum {
+    LOADCTL_NO_THROTTLE = 0,            // только измерения, пауз нет (основной бинарник)
+    LOADCTL_LATENCY,                    // AIMD доли рабочего времени по сигналам перегрузки
+    LOADCTL_BACKGROUND                  // то же, но доля не выше бюджета CPU (демон)
+} loadctl_mode_t;
+
+typedef struct {
+    loadctl_mode_t mode;
+    double max_duty;                    // 1.0 или бюджет фонового режима
+    double duty;                        // доля времени, которую ядро работает
+    uint64_t op_start;
+    uint64_t window_start;
+    uint64_t window_ops;
+    uint32_t hist[LOADCTL_HIST_BUCKETS];
+    uint64_t sleep_debt;
+    int congested_run;
+    // Итоги последнего окна
+    uint64_t p50_ns, p99_ns;
+    double ops_per_sec;
+    double pressure;
+    double backlog;
+    int queue_depth;
+    int queue_limit;                    // глубина очереди работы, выше которой окно перегружено; 0 — не учитывается
+    int congested;
+    int overloaded;                     // перегрузка LOADCTL_OVERLOAD_WINDOWS окон подряд
+    // Накопительно
+    uint64_t windows, congested_windows;
+    uint64_t slept_ns;
+} loadctl_t;
+
+// budget — доля CPU для LOADCTL_BACKGROUND, для остальных режимов не используется;
+// queue_limit — предел очереди работы ядра (LOAD_THRESHOLD), 0 — без него
+void loadctl_init(loadctl_t *lc, loadctl_mode_t mode, double budget, int queue_limit);
+const char *loadctl_mode_name(loadctl_mode_t mode);
+void loadctl_begin(loadctl_t *lc);
+// Завершает операцию: queue_depth — очередь работы ядра (задания в деке и заявки конвейера,
+// ждущие записи), dirty_backlog — доля грязных страниц.
+// Досыпает долг по текущей доле; возвращает 1, если закрылось окно и итоги обновлены
+int loadctl_end(loadctl_t *lc, int queue_depth, double dirty_backlog);
+
+#endif // LOAD_CTL_H
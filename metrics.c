@@ -0,0 +1,237 @@
+// Гистограммы задержек в разделяемой памяти
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define METRICS_CALIBRATE_NS 10000000ull // калибровка счётчика тактов: 10 мс
+
+static const char *const metric_names[METRIC_COUNT] = {
+    [METRIC_CACHE_HIT] = "cache_hit",
+    [METRIC_CACHE_MISS] = "cache_miss",
+    [METRIC_PREAD] = "pread",
+    [METRIC_PWRITE] = "pwrite",
+    [METRIC_COMPRESS] = "compress",
+    [METRIC_DECOMPRESS] = "decompress",
+    [METRIC_MIGRATE] = "migrate",
+};
+
+static metrics_shm_t *shm;
+static char shm_name[64];
+static uint64_t tick_mult = 1ull << 32;     // нс на такт, 32.32 с фиксированной точкой
+static _Atomic unsigned generation;         // меняется в metrics_init/destroy: слоты потоков устаревают
+static __thread metrics_slot_t *tls_slot;
+static __thread unsigned tls_generation;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Ticks to nanoseconds: a short busy window against CLOCK_MONOTONIC
+static void calibrate(void) {
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+    uint64_t t0 = mono_ns(), c0 = metrics_now();
+    uint64_t t1;
+    do {
+        t1 = mono_ns();
+    } while (t1 - t0 < METRICS_CALIBRATE_NS);
+    uint64_t c1 = metrics_now();
+    if (c1 > c0) tick_mult = (uint64_t)(((unsigned __int128)(t1 - t0) << 32) / (c1 - c0));
+#endif
+}
+
+// HDR layout: values below 2^SUB_BITS map directly, above that each octave has 2^SUB_BITS buckets
+static inline int bucket_of(uint64_t ns) {
+    if (ns < (1ull << METRICS_SUB_BITS)) return (int)ns;
+    int e = 63 - __builtin_clzll(ns);
+    if (e > METRICS_MAX_EXP) return METRICS_BUCKETS - 1;
+    return ((e - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS) |
+           (int)((ns >> (e - METRICS_SUB_BITS)) & ((1u << METRICS_SUB_BITS) - 1));
+}
+
+static uint64_t bucket_upper(int idx) {
+    int g = idx >> METRICS_SUB_BITS;
+    uint64_t s = (uint64_t)(idx & ((1 << METRICS_SUB_BITS) - 1));
+    if (g == 0) return s;
+    int e = g + METRICS_SUB_BITS - 1;
+    uint64_t width = 1ull << (e - METRICS_SUB_BITS);
+    return (1ull << e) + s * width + width - 1;
+}
+
+static void layout_init(metrics_shm_t *m) {
+    memset(m, 0, sizeof(*m));
+    m->version = METRICS_VERSION;
+    m->metrics = METRIC_COUNT;
+    m->buckets = METRICS_BUCKETS;
+    m->sub_bits = METRICS_SUB_BITS;
+    m->max_threads = METRICS_MAX_THREADS;
+    m->pid = (int32_t)getpid();
+    m->started = (uint64_t)time(NULL);
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        snprintf(m->names[i], sizeof(m->names[i]), "%s", metric_names[i]);
+    }
+    m->slot[METRICS_MAX_THREADS - 1].shared = 1;
+    // Readers check the magic last
+    __atomic_store_n(&m->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+}
+
+int metrics_init(const char *name) {
+    if (shm) return 0;
+    if (!name) name = METRICS_SHM_NAME;
+    calibrate();
+    int rc = 0;
+    void *p = MAP_FAILED;
+    if (*name) {
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+        if (fd >= 0 && ftruncate(fd, sizeof(metrics_shm_t)) == 0) {
+            p = mmap(NULL, sizeof(metrics_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (p != MAP_FAILED) {
+            snprintf(shm_name, sizeof(shm_name), "%s", name);
+        } else {
+            fprintf(stderr, "Metrics segment %s not created: %s, keeping metrics in process\n", name, strerror(errno));
+            rc = -1;
+        }
+        if (fd >= 0) close(fd);
+    }
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, sizeof(metrics_shm_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return -1;
+    }
+    layout_init(p);
+    atomic_fetch_add(&generation, 1);
+    shm = p;
+    return rc;
+}
+
+void metrics_destroy(void) {
+    if (!shm) return;
+    metrics_shm_t *m = shm;
+    shm = NULL;
+    atomic_fetch_add(&generation, 1);
+    if (*shm_name) shm_unlink(shm_name);
+    shm_name[0] = '\0';
+    munmap(m, sizeof(*m));
+}
+
+// First sample of a thread (or of a new segment): take the next free slot
+static metrics_slot_t *slot_claim(metrics_shm_t *m) {
+    uint32_t n = atomic_fetch_add_explicit(&m->slots_used, 1, memory_order_relaxed);
+    if (n >= METRICS_MAX_THREADS) n = METRICS_MAX_THREADS - 1;
+    metrics_slot_t *s = &m->slot[n];
+    if (!s->shared) atomic_store_explicit(&s->tid, (int32_t)syscall(SYS_gettid), memory_order_relaxed);
+    tls_slot = s;
+    tls_generation = atomic_load_explicit(&generation, memory_order_relaxed);
+    return s;
+}
+
+// Single writer per slot: plain load and store, no locked instructions on the hot path
+static inline void add_owned(_Atomic uint64_t *v, uint64_t d) {
+    atomic_store_explicit(v, atomic_load_explicit(v, memory_order_relaxed) + d, memory_order_relaxed);
+}
+
+void metrics_record(metric_id_t m, uint64_t start) {
+    uint64_t d = metrics_now() - start;
+    metrics_shm_t *seg = shm;
+    if (!seg) return;
+    metrics_slot_t *s = tls_slot;
+    if (!s || tls_generation != atomic_load_explicit(&generation, memory_order_relaxed)) s = slot_claim(seg);
+    if ((int64_t)d < 0) d = 0; // TSC read on another CPU, slightly behind
+    uint64_t ns = (uint64_t)(((unsigned __int128)d * tick_mult) >> 32);
+    metrics_hist_t *h = &s->hist[m];
+    _Atomic uint64_t *b = &h->buckets[bucket_of(ns)];
+    if (!s->shared) {
+        add_owned(&h->count, 1);
+        add_owned(&h->sum_ns, ns);
+        add_owned(b, 1);
+        if (ns > atomic_load_explicit(&h->max_ns, memory_order_relaxed)) {
+            atomic_store_explicit(&h->max_ns, ns, memory_order_relaxed);
+        }
+        return;
+    }
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(b, 1, memory_order_relaxed);
+    uint64_t cur = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+    while (ns > cur && !atomic_compare_exchange_weak_explicit(&h->max_ns, &cur, ns,
+                                                               memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+const char *metrics_name(metric_id_t m) {
+    return m >= 0 && m < METRIC_COUNT ? metric_names[m] : "unknown";
+}
+
+const metrics_shm_t *metrics_local(void) {
+    return shm;
+}
+
+const metrics_shm_t *metrics_attach(const char *name) {
+    if (!name || !*name) name = METRICS_SHM_NAME;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(metrics_shm_t)) {
+        p = mmap(NULL, sizeof(metrics_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    } else {
+        errno = EINVAL;
+    }
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    const metrics_shm_t *m = p;
+    if (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC || m->version != METRICS_VERSION ||
+        m->metrics != METRIC_COUNT || m->buckets != METRICS_BUCKETS || m->max_threads != METRICS_MAX_THREADS) {
+        munmap(p, sizeof(metrics_shm_t));
+        errno = EPROTO;
+        return NULL;
+    }
+    return m;
+}
+
+void metrics_detach(const metrics_shm_t *m) {
+    if (m) munmap((void *)m, sizeof(*m));
+}
+
+void metrics_summarize(const metrics_shm_t *m, metric_id_t id, metrics_summary_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (!m) return;
+    uint32_t used = atomic_load_explicit(&m->slots_used, memory_order_relaxed);
+    if (used > METRICS_MAX_THREADS) used = METRICS_MAX_THREADS;
+    for (uint32_t i = 0; i < used; i++) {
+        const metrics_hist_t *h = &m->slot[i].hist[id];
+        out->count += atomic_load_explicit(&h->count, memory_order_relaxed);
+        out->sum_ns += atomic_load_explicit(&h->sum_ns, memory_order_relaxed);
+        uint64_t mx = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+        if (mx > out->max_ns) out->max_ns = mx;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            out->buckets[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t metrics_percentile(const metrics_summary_t *s, double q) {
+    // Buckets are read one by one while writers run: rank against their own sum
+    uint64_t total = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) total += s->buckets[b];
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        seen += s->buckets[b];
+        if (seen > rank) {
+            uint64_t up = bucket_upper(b);
+            return up < s->max_ns || s->max_ns == 0 ? up : s->max_ns;
+        }
+    }
+    return s->max_ns;
+}
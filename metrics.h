@@ -0,0 +1,113 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Гистограммы задержек, всегда включённые: у каждого потока свой слот, запись —
+// два чтения счётчика тактов и два счётчика без атомарных RMW. Корзины логарифмически-
+// линейные, как в HDR Histogram: 2^METRICS_SUB_BITS корзин на октаву наносекунд.
+// Слоты лежат в разделяемой памяти (shm_open), внешний сборщик читает их на ходу
+// (pseudo_metrics), процесс при этом не останавливается
+
+#ifndef METRICS_SHM_NAME
+#define METRICS_SHM_NAME "/pseudo_core.metrics"   // /dev/shm/pseudo_core.metrics; пусто — только в процессе
+#endif
+#ifndef METRICS_MAX_THREADS
+#define METRICS_MAX_THREADS 64                    // слотов; потоки сверх них делят последний (атомарно)
+#endif
+#ifndef METRICS_SUB_BITS
+#define METRICS_SUB_BITS 4                        // 16 корзин на октаву: погрешность не больше 6%
+#endif
+#define METRICS_MAX_EXP 40                        // верхняя граница: 2^40 нс, ~18 минут
+#define METRICS_BUCKETS ((METRICS_MAX_EXP - METRICS_SUB_BITS + 2) << METRICS_SUB_BITS)
+#define METRICS_MAGIC 0x5343495254454d50ull       // "PMETRICS"
+#define METRICS_VERSION 1
+
+typedef enum {
+    METRIC_CACHE_HIT = 0,       // cache_get/cache_pin, страница в кэше
+    METRIC_CACHE_MISS,          // то же с загрузкой (кольцо или диск)
+    METRIC_PREAD,               // чтение io_backend (один запрос или пакет)
+    METRIC_PWRITE,              // запись io_backend
+    METRIC_COMPRESS,            // compress_page_codec
+    METRIC_DECOMPRESS,          // decompress_page_codec
+    METRIC_MIGRATE,             // scheduler_get_migrated_task: попытка украсть блок
+    METRIC_COUNT
+} metric_id_t;
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+} metrics_hist_t;
+
+typedef struct {
+    _Atomic int32_t tid;        // поток-владелец, 0 — слот свободен
+    int32_t shared;             // последний слот: пишут несколько потоков
+    metrics_hist_t hist[METRIC_COUNT];
+} metrics_slot_t;
+
+// Раскладка сегмента; сборщик проверяет magic, version и размеры
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t metrics;           // METRIC_COUNT
+    uint32_t buckets;           // METRICS_BUCKETS
+    uint32_t sub_bits;
+    uint32_t max_threads;
+    int32_t pid;
+    uint64_t started;           // time(NULL) при создании
+    _Atomic uint32_t slots_used;
+    uint32_t reserved;
+    char names[METRIC_COUNT][16];
+    metrics_slot_t slot[METRICS_MAX_THREADS];
+} metrics_shm_t;
+
+// Итог по всем потокам: обычная копия
+typedef struct {
+    uint64_t count, sum_ns, max_ns;
+    uint64_t buckets[METRICS_BUCKETS];
+} metrics_summary_t;
+
+// Метка начала интервала в тактах: TSC, CNTVCT или CLOCK_MONOTONIC;
+// в наносекунды переводит metrics_record по калибровке metrics_init
+static inline uint64_t metrics_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Создаёт сегмент (name NULL — METRICS_SHM_NAME, "" — без разделяемой памяти) и
+// калибрует счётчик тактов; до вызова записи отбрасываются. 0 или -1 (тогда только в процессе)
+int metrics_init(const char *name);
+// Снимает сегмент с публикации; вызывать после остановки потоков
+void metrics_destroy(void);
+// Записывает длительность от start (metrics_now) до текущего момента
+void metrics_record(metric_id_t m, uint64_t start);
+const char *metrics_name(metric_id_t m);
+
+// Сегмент этого процесса, NULL до metrics_init
+const metrics_shm_t *metrics_local(void);
+// Открывает на чтение сегмент другого процесса; NULL с errno при ошибке
+const metrics_shm_t *metrics_attach(const char *name);
+void metrics_detach(const metrics_shm_t *shm);
+// Сумма слотов по одной метрике
+void metrics_summarize(const metrics_shm_t *shm, metric_id_t m, metrics_summary_t *out);
+// Верхняя граница корзины с квантилем q (0..1), нс
+uint64_t metrics_percentile(const metrics_summary_t *s, double q);
+
+#endif // METRICS_H
@@ -0,0 +1,372 @@
+// Конвейер записи PseudoCore: выборка/преобразование -> сжатие -> дозапись в журнал
+#include "pipeline.h"
+#include "io_backend.h"
+#include "ring_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+
+#define QUEUE_SPINS 64              // pops tried before sleeping on the condition variable
+#define QUEUE_WAIT_NS 1000000       // bounded sleep, a missed wakeup costs at most this
+
+static void log_pipeline_message(const char *level, const char *message) {
+    time_t now = time(NULL);
+    char timestamp[26];
+    ctime_r(&now, timestamp);
+    timestamp[24] = '\0';
+    fprintf(stderr, "[%s] [%s] Pipeline: %s\n", timestamp, level, message);
+}
+
+static int queue_init(pipeline_queue_t *q, size_t size) {
+    q->cells = calloc(size, sizeof(*q->cells));
+    if (!q->cells) return -1;
+    q->mask = size - 1;
+    for (size_t i = 0; i < size; i++) atomic_init(&q->cells[i].seq, i);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->waiters, 0);
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, &ca);
+    pthread_condattr_destroy(&ca);
+    return 0;
+}
+
+static void queue_destroy(pipeline_queue_t *q) {
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cond);
+    free(q->cells);
+    q->cells = NULL;
+}
+
+static size_t queue_depth(pipeline_queue_t *q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    return head > tail ? head - tail : 0;
+}
+
+// Every queue holds at most PIPELINE_ITEMS entries, so a push never finds it full
+static void queue_push(pipeline_queue_t *q, pipeline_item_t *it) {
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    pipeline_cell_t *cell;
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            sched_yield(); // A consumer is still reading this cell
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+    cell->item = it;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    // Pairs with the fence in queue_pop_wait: either the sleeper sees the item or we see it waiting
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&q->waiters, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&q->mutex);
+        pthread_cond_signal(&q->cond);
+        pthread_mutex_unlock(&q->mutex);
+    }
+}
+
+static pipeline_item_t *queue_try_pop(pipeline_queue_t *q) {
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    pipeline_cell_t *cell;
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+    pipeline_item_t *it = cell->item;
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+    return it;
+}
+
+// Pop, sleeping while the queue is empty; NULL once *done holds and the queue is drained.
+// *waited is set when the caller had to sleep
+static pipeline_item_t *queue_pop_wait(pipeline_queue_t *q, atomic_int *done, int *waited) {
+    for (int i = 0; i < QUEUE_SPINS; i++) {
+        pipeline_item_t *it = queue_try_pop(q);
+        if (it) return it;
+        if (i >= QUEUE_SPINS / 2) sched_yield();
+    }
+    if (waited) *waited = 1;
+    for (;;) {
+        pthread_mutex_lock(&q->mutex);
+        atomic_fetch_add_explicit(&q->waiters, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        pipeline_item_t *it = queue_try_pop(q);
+        int stop = !it && done && atomic_load(done);
+        if (!it && !stop) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_nsec += QUEUE_WAIT_NS;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&q->cond, &q->mutex, &ts);
+        }
+        atomic_fetch_sub_explicit(&q->waiters, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&q->mutex);
+        if (it) return it;
+        if (stop) return queue_try_pop(q);
+    }
+}
+
+static void queue_wake_all(pipeline_queue_t *q) {
+    pthread_mutex_lock(&q->mutex);
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static uint32_t inflight_slot(uint64_t offset) {
+    uint64_t block = offset / BLOCK_SIZE;
+    return (uint32_t)((block * 0x9E3779B97F4A7C15ull) >> 32) & (PIPELINE_INFLIGHT - 1);
+}
+
+// Compression stage: the CPU-bound part, as many workers as configured
+static void *compress_run(void *v) {
+    pipeline_t *p = v;
+    pipeline_item_t *it;
+    while ((it = queue_pop_wait(&p->compress_q, &p->stopping, NULL)) != NULL) {
+        it->rec_size = extent_encode(p->store, it->offset, it->page, it->hotness, it->rec, &it->sum);
+        atomic_fetch_add_explicit(&p->compressed, 1, memory_order_relaxed);
+        queue_push(&p->write_q, it);
+    }
+    // The last worker out lets the writers finish once their queue is drained
+    if (atomic_fetch_sub(&p->compress_live, 1) == 1) {
+        atomic_store(&p->compress_done, 1);
+        queue_wake_all(&p->write_q);
+    }
+    return NULL;
+}
+
+// Release a finished item: unpin its page, free its block slot and shard share, return it to the pool
+static void item_release(pipeline_t *p, pipeline_item_t *it) {
+    cache_unpin_exclusive(it->cache, it->page);
+    atomic_store_explicit(&p->inflight[it->slot], 0, memory_order_release);
+    atomic_fetch_sub_explicit(&p->shard_busy[it->shard], 1, memory_order_release);
+    queue_push(&p->free_q, it);
+}
+
+// Take one of the shard's in-flight places, waiting while its share is used up: every pinned
+// page is a frame the shard cannot evict, and PIPELINE_ITEMS of them would fill a small shard
+static int shard_acquire(pipeline_t *p, int shard) {
+    atomic_int *busy = &p->shard_busy[shard];
+    int waited = 0;
+    int n = atomic_load_explicit(busy, memory_order_relaxed);
+    for (;;) {
+        if (n < p->shard_limit[shard]) {
+            if (atomic_compare_exchange_weak_explicit(busy, &n, n + 1, memory_order_acquire, memory_order_relaxed)) break;
+            continue;
+        }
+        waited = 1;
+        sched_yield();
+        n = atomic_load_explicit(busy, memory_order_relaxed);
+    }
+    return waited;
+}
+
+// Write stage: whatever has been compressed goes to the log in one append
+static void *write_run(void *v) {
+    pipeline_t *p = v;
+    pipeline_item_t *batch[PIPELINE_WRITE_BATCH];
+    uint64_t offs[PIPELINE_WRITE_BATCH];
+    char *recs[PIPELINE_WRITE_BATCH];
+    size_t sizes[PIPELINE_WRITE_BATCH];
+    uint64_t sums[PIPELINE_WRITE_BATCH];
+    pipeline_item_t *it;
+    while ((it = queue_pop_wait(&p->write_q, &p->compress_done, NULL)) != NULL) {
+        int n = 0;
+        do {
+            batch[n] = it;
+            offs[n] = it->offset;
+            recs[n] = it->rec;
+            sizes[n] = it->rec_size;
+            sums[n] = it->sum;
+            n++;
+        } while (n < PIPELINE_WRITE_BATCH && (it = queue_try_pop(&p->write_q)) != NULL);
+        int done = extent_append(p->store, offs, recs, sizes, sums, n);
+        atomic_fetch_add_explicit(&p->write_batches, 1, memory_order_relaxed);
+        if (done < n) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Failed to append %d of %d extents (errno: %d)", n - done, n, errno);
+            log_pipeline_message("ERROR", msg);
+            atomic_fetch_add_explicit(&p->write_errors, (uint64_t)(n - done), memory_order_relaxed);
+        }
+        for (int i = 0; i < n; i++) {
+            if (i < done) {
+                ring_cache_invalidate(batch[i]->offset); // The ring gets the new copy when the page is evicted
+            } else {
+                cache_mark_dirty(batch[i]->cache, batch[i]->page); // Changed in place: the flusher retries it
+            }
+            item_release(p, batch[i]);
+        }
+        atomic_fetch_add_explicit(&p->written, (uint64_t)done, memory_order_relaxed);
+    }
+    io_thread_destroy();
+    return NULL;
+}
+
+int pipeline_init(pipeline_t *p, extent_store_t *store, cache_shared_t *cache, int compress_workers, int writers) {
+    memset(p, 0, sizeof(*p));
+    if (compress_workers < 1) compress_workers = 1;
+    if (writers < 1) writers = 1;
+    if (compress_workers + writers > PIPELINE_MAX_THREADS) {
+        compress_workers = PIPELINE_MAX_THREADS - writers > 0 ? PIPELINE_MAX_THREADS - writers : 1;
+        writers = PIPELINE_MAX_THREADS - compress_workers;
+    }
+    p->store = store;
+    p->cache = cache;
+    p->items = calloc(PIPELINE_ITEMS, sizeof(*p->items));
+    p->recs = malloc((size_t)PIPELINE_ITEMS * EXTENT_REC_MAX);
+    p->inflight = calloc(PIPELINE_INFLIGHT, sizeof(*p->inflight));
+    p->shard_busy = calloc((size_t)cache->nshards, sizeof(*p->shard_busy));
+    p->shard_limit = calloc((size_t)cache->nshards, sizeof(*p->shard_limit));
+    if (!p->items || !p->recs || !p->inflight || !p->shard_busy || !p->shard_limit ||
+        queue_init(&p->free_q, PIPELINE_ITEMS) != 0 ||
+        queue_init(&p->compress_q, PIPELINE_ITEMS) != 0 ||
+        queue_init(&p->write_q, PIPELINE_ITEMS) != 0) {
+        log_pipeline_message("ERROR", "Failed to allocate pipeline queues");
+        free(p->free_q.cells);
+        free(p->compress_q.cells);
+        free(p->write_q.cells);
+        free(p->items);
+        free(p->recs);
+        free((void*)p->inflight);
+        free(p->shard_busy);
+        free(p->shard_limit);
+        return -1;
+    }
+    for (int i = 0; i < cache->nshards; i++) {
+        size_t limit = cache->shard[i].capacity * PIPELINE_SHARD_PCT / 100;
+        p->shard_limit[i] = limit < 1 ? 1 : limit > PIPELINE_ITEMS ? PIPELINE_ITEMS : (int)limit;
+        atomic_init(&p->shard_busy[i], 0);
+    }
+    for (int i = 0; i < PIPELINE_ITEMS; i++) {
+        p->items[i].rec = p->recs + (size_t)i * EXTENT_REC_MAX;
+        queue_push(&p->free_q, &p->items[i]);
+    }
+    atomic_init(&p->stopping, 0);
+    atomic_init(&p->compress_live, compress_workers);
+    atomic_init(&p->compress_done, 0);
+    int started = 0;
+    for (int i = 0; i < compress_workers; i++) {
+        if (pthread_create(&p->threads[started], NULL, compress_run, p) != 0) {
+            if (atomic_fetch_sub(&p->compress_live, compress_workers - i) == compress_workers - i) {
+                atomic_store(&p->compress_done, 1);
+            }
+            break;
+        }
+        started++;
+    }
+    p->compress_workers = started;
+    for (int i = 0; i < writers && started > 0; i++) {
+        if (pthread_create(&p->threads[started], NULL, write_run, p) != 0) break;
+        started++;
+        p->writers++;
+    }
+    if (p->compress_workers == 0 || p->writers == 0) {
+        log_pipeline_message("ERROR", "Failed to start pipeline threads");
+        pipeline_destroy(p);
+        return -1;
+    }
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Started %d compression workers and %d writers", p->compress_workers, p->writers);
+    log_pipeline_message("INFO", msg);
+    return 0;
+}
+
+pipeline_item_t *pipeline_begin(pipeline_t *p, uint64_t offset) {
+    // The shard first: a core waiting for it holds no item other shards could use
+    int shard = (int)(cache_shard(p->cache, offset) - p->cache->shard);
+    if (shard_acquire(p, shard)) atomic_fetch_add_explicit(&p->shard_stalls, 1, memory_order_relaxed);
+    int waited = 0;
+    pipeline_item_t *it = queue_pop_wait(&p->free_q, NULL, &waited);
+    if (waited) atomic_fetch_add_explicit(&p->producer_stalls, 1, memory_order_relaxed);
+    // One version of a block in flight at a time: its page is changed in place, and the log
+    // must receive the versions in order
+    uint32_t slot = inflight_slot(offset);
+    uint64_t expected = 0;
+    if (!atomic_compare_exchange_strong(&p->inflight[slot], &expected, offset / BLOCK_SIZE + 1)) {
+        atomic_fetch_add_explicit(&p->inflight_waits, 1, memory_order_relaxed);
+        do {
+            sched_yield();
+            expected = 0;
+        } while (!atomic_compare_exchange_weak(&p->inflight[slot], &expected, offset / BLOCK_SIZE + 1));
+    }
+    it->offset = offset;
+    it->slot = slot;
+    it->shard = shard;
+    return it;
+}
+
+void pipeline_submit(pipeline_t *p, pipeline_item_t *it, cache_t *c, char *page, int hotness) {
+    it->cache = c;
+    it->page = page;
+    it->hotness = hotness;
+    atomic_fetch_add_explicit(&p->submitted, 1, memory_order_relaxed);
+    queue_push(&p->compress_q, it);
+}
+
+void pipeline_cancel(pipeline_t *p, pipeline_item_t *it) {
+    atomic_store_explicit(&p->inflight[it->slot], 0, memory_order_release);
+    atomic_fetch_sub_explicit(&p->shard_busy[it->shard], 1, memory_order_release);
+    queue_push(&p->free_q, it);
+}
+
+size_t pipeline_backlog(pipeline_t *p) {
+    return queue_depth(&p->compress_q) + queue_depth(&p->write_q);
+}
+
+void pipeline_stats(pipeline_t *p, pipeline_stats_t *out) {
+    out->free_items = queue_depth(&p->free_q);
+    out->compress_depth = queue_depth(&p->compress_q);
+    out->write_depth = queue_depth(&p->write_q);
+    out->submitted = atomic_load_explicit(&p->submitted, memory_order_relaxed);
+    out->compressed = atomic_load_explicit(&p->compressed, memory_order_relaxed);
+    out->written = atomic_load_explicit(&p->written, memory_order_relaxed);
+    out->write_batches = atomic_load_explicit(&p->write_batches, memory_order_relaxed);
+    out->write_errors = atomic_load_explicit(&p->write_errors, memory_order_relaxed);
+    out->producer_stalls = atomic_load_explicit(&p->producer_stalls, memory_order_relaxed);
+    out->inflight_waits = atomic_load_explicit(&p->inflight_waits, memory_order_relaxed);
+    out->shard_stalls = atomic_load_explicit(&p->shard_stalls, memory_order_relaxed);
+    out->compress_workers = p->compress_workers;
+    out->writers = p->writers;
+}
+
+void pipeline_destroy(pipeline_t *p) {
+    if (!p->items) return;
+    // Workers drain their queues before leaving, so every submitted page reaches the log
+    atomic_store(&p->stopping, 1);
+    queue_wake_all(&p->compress_q);
+    for (int i = 0; i < p->compress_workers + p->writers; i++) pthread_join(p->threads[i], NULL);
+    queue_destroy(&p->free_q);
+    queue_destroy(&p->compress_q);
+    queue_destroy(&p->write_q);
+    free(p->items);
+    free(p->recs);
+    free((void*)p->inflight);
+    free(p->shard_busy);
+    free(p->shard_limit);
+    p->items = NULL;
+}
@@ -0,0 +1,115 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "config.h"
+#include "cache.h"
+#include "extent.h"
+
+// Конвейер записи: ядро выбирает блок и преобразует закреплённую страницу на месте,
+// пул потоков сжатия строит записи журнала, потоки записи дописывают их пакетами.
+// Стадии связаны ограниченными MPMC-очередями; заявок в полёте не больше PIPELINE_ITEMS,
+// поэтому отставание записи доходит до ядер: pipeline_begin ждёт свободную заявку.
+// В одном шарде закреплено не больше PIPELINE_SHARD_PCT его кадров: заявки маленького шарда
+// не вытесняют из него всё остальное
+
+#ifndef PIPELINE_ITEMS
+#define PIPELINE_ITEMS 256          // заявок (закреплённых страниц) в полёте, степень двойки
+#endif
+#ifndef PIPELINE_SHARD_PCT
+#define PIPELINE_SHARD_PCT 25       // % кадров шарда, закреплённых заявками одновременно (не меньше одного)
+#endif
+#ifndef PIPELINE_WRITE_BATCH
+#define PIPELINE_WRITE_BATCH 64     // записей за одну дозапись в журнал
+#endif
+#ifndef PIPELINE_INFLIGHT
+#define PIPELINE_INFLIGHT 4096      // слотов таблицы блоков в полёте, степень двойки
+#endif
+#ifndef PIPELINE_MAX_THREADS
+#define PIPELINE_MAX_THREADS 32
+#endif
+
+// Заявка: одна закреплённая страница от ядра до журнала
+typedef struct {
+    uint64_t offset;
+    cache_t *cache;             // шард, в котором закреплена page
+    int shard;                  // его номер в cache_shared_t (счётчик p->shard_busy)
+    char *page;
+    int hotness;
+    uint32_t slot;              // слот в таблице блоков в полёте
+    size_t rec_size;            // 0 — страница не изменилась, писать нечего
+    uint64_t sum;               // хеш содержимого (extent_encode)
+    char *rec;                  // запись журнала, EXTENT_REC_MAX байт
+} pipeline_item_t;
+
+// Ограниченная MPMC-очередь (по Вьюкову) с ожиданием на условной переменной, когда пусто
+typedef struct {
+    _Atomic size_t seq;
+    pipeline_item_t *item;
+} pipeline_cell_t;
+
+typedef struct {
+    pipeline_cell_t *cells;
+    size_t mask;
+    _Alignas(64) _Atomic size_t head;   // позиция записи
+    _Alignas(64) _Atomic size_t tail;   // позиция чтения
+    _Alignas(64) atomic_int waiters;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} pipeline_queue_t;
+
+typedef struct {
+    size_t free_items;          // глубины очередей: свободные заявки
+    size_t compress_depth;      //   ждут сжатия
+    size_t write_depth;         //   ждут записи
+    uint64_t submitted;
+    uint64_t compressed;
+    uint64_t written;
+    uint64_t write_batches;
+    uint64_t write_errors;
+    uint64_t producer_stalls;   // ядро ждало свободную заявку: отстаёт сжатие или запись
+    uint64_t inflight_waits;    // ядро ждало, пока прежняя версия блока дойдёт до журнала
+    uint64_t shard_stalls;      // ядро ждало, пока в его шарде освободится место под заявку
+    int compress_workers;
+    int writers;
+} pipeline_stats_t;
+
+typedef struct {
+    extent_store_t *store;
+    cache_shared_t *cache;
+    atomic_int *shard_busy;     // заявок в полёте на шард
+    int *shard_limit;           // их предел: PIPELINE_SHARD_PCT ёмкости шарда
+    pipeline_item_t *items;
+    char *recs;
+    pipeline_queue_t free_q, compress_q, write_q;
+    _Atomic uint64_t *inflight; // блок + 1 или 0; один блок в полёте на слот
+    pthread_t threads[PIPELINE_MAX_THREADS];
+    int compress_workers, writers;
+    atomic_int stopping;
+    atomic_int compress_live;   // потоки сжатия, ещё не вышедшие
+    atomic_int compress_done;   // все потоки сжатия вышли: записи осталось дочистить очередь
+    _Atomic uint64_t submitted, compressed, written, write_batches, write_errors;
+    _Atomic uint64_t producer_stalls, inflight_waits, shard_stalls;
+} pipeline_t;
+
+// Страницы заявок закрепляются в шардах cache
+int pipeline_init(pipeline_t *p, extent_store_t *store, cache_shared_t *cache, int compress_workers, int writers);
+// Берёт заявку для offset: ждёт места в шарде блока, свободную заявку и, если этот блок
+// ещё в полёте, его завершения
+pipeline_item_t *pipeline_begin(pipeline_t *p, uint64_t offset);
+// Передаёт заявку дальше вместе с исключительным закреплением page в шарде c (cache_pin_exclusive);
+// страницу открепит запись
+void pipeline_submit(pipeline_t *p, pipeline_item_t *it, cache_t *c, char *page, int hotness);
+// Возвращает неиспользованную заявку (страницу не удалось получить)
+void pipeline_cancel(pipeline_t *p, pipeline_item_t *it);
+void pipeline_stats(pipeline_t *p, pipeline_stats_t *out);
+// Заявок, ждущих сжатия или записи (атомарный снимок)
+size_t pipeline_backlog(pipeline_t *p);
+// Дожидается записи всех заявок и останавливает потоки
+void pipeline_destroy(pipeline_t *p);
+
+#endif // PIPELINE_H
@@ -0,0 +1,87 @@
+// Модуль упреждающего чтения для PseudoCore
+#include "prefetch.h"
+#include <string.h>
+#include <fcntl.h>
+
+void prefetch_init(prefetch_stream_t *p) {
+    memset(p, 0, sizeof(*p));
+    p->window = PREFETCH_MIN_WINDOW;
+    for (int i = 0; i < PREFETCH_RECENT; i++) p->recent[i] = UINT64_MAX;
+}
+
+void prefetch_note_migrated(prefetch_stream_t *p, uint64_t off) {
+    p->recent[p->recent_pos] = off;
+    p->recent_pos = (p->recent_pos + 1) % PREFETCH_RECENT;
+}
+
+static int recently_migrated(const prefetch_stream_t *p, uint64_t off) {
+    for (int i = 0; i < PREFETCH_RECENT; i++) {
+        if (p->recent[i] == off) return 1;
+    }
+    return 0;
+}
+
+// Grow the window while read-ahead pages get used, shrink it when they are evicted unused
+static void adapt_window(prefetch_stream_t *p, const cache_t *c) {
+    cache_stats_t st;
+    cache_stats_snapshot(c, &st);
+    uint64_t hits = st.prefetch_hits - p->seen_hits;
+    uint64_t wasted = st.prefetch_wasted - p->seen_wasted;
+    if (st.prefetch_hits < p->seen_hits || st.prefetch_wasted < p->seen_wasted) hits = wasted = 0; // Stream moved to another shard
+    p->seen_hits = st.prefetch_hits;
+    p->seen_wasted = st.prefetch_wasted;
+    if (wasted > hits) {
+        p->window = p->window / 2 > PREFETCH_MIN_WINDOW ? p->window / 2 : PREFETCH_MIN_WINDOW;
+    } else if (hits > 0 && p->window * 2 <= PREFETCH_MAX_WINDOW) {
+        p->window *= 2;
+    }
+}
+
+int prefetch_access(prefetch_stream_t *p, cache_shared_t *sc, int fd, uint64_t off, int hotness, uint64_t lo, uint64_t hi) {
+    // A block the core keeps coming back to is most likely cached and says nothing about where
+    // the stream goes next: it neither breaks the stride nor reads ahead
+    if (hotness >= PREFETCH_REREF_HOTNESS) return 0;
+    int64_t delta = (int64_t)(off - p->last_offset);
+    p->last_offset = off;
+    if (++p->accesses % PREFETCH_ADAPT_INTERVAL == 0) adapt_window(p, cache_shard(sc, off));
+
+    if (delta != 0 && delta == p->stride) {
+        if (p->confidence < PREFETCH_CONFIRM) p->confidence++;
+    } else {
+        // Pattern broken (segment wrap, new stream): start over with a small window
+        p->stride = delta;
+        p->confidence = 0;
+        p->frontier_valid = 0;
+        p->advised = 0;
+        p->window = PREFETCH_MIN_WINDOW;
+        return 0;
+    }
+    if (p->confidence < PREFETCH_CONFIRM) return 0;
+
+    // Only the part of the window beyond what was already requested
+    uint64_t start = off + (uint64_t)p->stride;
+    if (p->frontier_valid) {
+        int64_t ahead = (int64_t)(p->frontier - off) / p->stride;
+        if (ahead >= (int64_t)p->window) return 0;
+        if (ahead > 0) start = p->frontier + (uint64_t)p->stride;
+    }
+    uint64_t offs[PREFETCH_MAX_WINDOW];
+    int n = 0;
+    uint64_t next = start;
+    while ((int64_t)(next - off) / p->stride <= (int64_t)p->window && n < PREFETCH_MAX_WINDOW) {
+        if (next < lo || next >= hi) break; // Out of this core's segment (or below offset 0: wraps high)
+        if (!recently_migrated(p, next)) offs[n++] = next;
+        p->frontier = next;
+        next += (uint64_t)p->stride;
+    }
+    p->frontier_valid = 1;
+    // Forward sequential streams: let the kernel read the window after this one asynchronously,
+    // advising a double window at a time so the hint costs one syscall per window, not per block
+    if (p->stride == BLOCK_SIZE && next >= p->advised && next < hi) {
+        size_t span = 2 * p->window * BLOCK_SIZE;
+        if (span > hi - next) span = (size_t)(hi - next);
+        posix_fadvise(fd, (off_t)next, (off_t)span, POSIX_FADV_WILLNEED);
+        p->advised = next + span;
+    }
+    return cache_shared_prefetch(sc, fd, offs, n);
+}
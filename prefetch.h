@@ -0,0 +1,53 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "config.h"
+#include "cache.h"
+
+#ifndef PREFETCH_MIN_WINDOW
+#define PREFETCH_MIN_WINDOW 4       // блоков
+#endif
+#ifndef PREFETCH_MAX_WINDOW
+#define PREFETCH_MAX_WINDOW CACHE_PREFETCH_MAX
+#endif
+#ifndef PREFETCH_CONFIRM
+#define PREFETCH_CONFIRM 2          // совпадений шага до начала упреждения
+#endif
+#ifndef PREFETCH_RECENT
+#define PREFETCH_RECENT 16          // недавно мигрировавших блоков, которые не читаем заранее
+#endif
+#ifndef PREFETCH_REREF_HOTNESS
+#define PREFETCH_REREF_HOTNESS 2    // горячесть повторного обращения: шаг по нему не ищется, упреждения нет
+#endif
+#ifndef PREFETCH_ADAPT_INTERVAL
+#define PREFETCH_ADAPT_INTERVAL 64  // обращений между пересчётами окна
+#endif
+
+// Поток обращений одного ядра: детектор шага и адаптивное окно упреждения
+typedef struct {
+    uint64_t last_offset;
+    int64_t stride;             // в байтах; 0 — шаблон не найден
+    int confidence;
+    size_t window;              // блоков, загружаемых в кэш заранее
+    uint64_t frontier;          // дальнее уже запрошенное смещение
+    int frontier_valid;
+    uint64_t advised;           // до какого смещения ядру уже отправлен WILLNEED
+    uint64_t recent[PREFETCH_RECENT];
+    int recent_pos;
+    unsigned accesses;
+    uint64_t seen_hits;         // снимок prefetch_hits/prefetch_wasted для адаптации окна
+    uint64_t seen_wasted;
+} prefetch_stream_t;
+
+void prefetch_init(prefetch_stream_t *p);
+// Блок пришёл миграцией с другого ядра: не тратить на него упреждение
+void prefetch_note_migrated(prefetch_stream_t *p, uint64_t off);
+// Учитывает обращение с горячестью hotness (scheduler_report_access) и при устойчивом шаге загружает окно
+// в шарды общего кэша; возвращает число загруженных. Окно и WILLNEED не выходят за [lo, hi):
+// сегмент ядра, обрезанный по концу образа
+int prefetch_access(prefetch_stream_t *p, cache_shared_t *sc, int fd, uint64_t off, int hotness, uint64_t lo, uint64_t hi);
+
+#endif // PREFETCH_H
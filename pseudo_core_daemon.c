@@ -5,58 +5,65 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <syslog.h>
-#include <fcntl.h>
 #include <string.h>
-#include <pthread.h>
-#include <time.h>
-#include <stdint.h>
+#include <limits.h>
 
 #include "config.h"
-#include "cache.h"
-#include "compress.h"
-#include "ring_cache.h"
-#include "scheduler.h"
-
-// Конфигурация демона
-#undef CORES
-#undef SEGMENT_MB
+#include "settings.h"
+#include "engine.h"
+
+// Конфигурация демона по умолчанию; в config.cfg — ключи с префиксом DAEMON_ (DAEMON_CORES=2)
+#define DAEMON_PREFIX "DAEMON_"
 #define DAEMON_CORES 2  // Уменьшаем количество ядер
 #define DAEMON_SEGMENT_MB 64  // Уменьшаем размер сегмента
-#define BLOCK_SIZE 4096
 #define LOAD_THRESHOLD 30
-#define HIGH_LOAD_DELAY_NS 50000000  // 50ms
-#define LOW_LOAD_DELAY_NS 25000000   // 25ms
-#define BASE_LOAD_DELAY_NS 10000000  // 10ms
+#define HIGH_LOAD_DELAY_MS 50        // пауза после ошибки получения страницы
+#define DAEMON_TRANSFORM_PASSES 1    // облегчённая нагрузка: один проход преобразования
+#define DAEMON_CPU_BUDGET 0.25       // фоновый бюджет: доля времени, которую ядро демона работает
 #define PID_FILE "/var/run/pseudo_core.pid"
-#define LOG_FILE "/var/log/pseudo_core.log"
-
-// Определяем структуру аргументов для потока
-typedef struct {
-    int id;               // ID ядра
-    int fd;               // Файловый дескриптор для операций I/O
-    uint64_t seg_size;    // Размер сегмента для выбора блока
-    volatile int running; // Флаг для контроля завершения потока
-} daemon_core_arg_t;
-
-volatile int global_running = 1;
-static pthread_t core_threads[DAEMON_CORES];
-static daemon_core_arg_t core_args[DAEMON_CORES];
-static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-void signal_handler(int sig) {
+#define DAEMON_METRICS_SHM "/pseudo_core_daemon.metrics" // свой сегмент: демон и pseudo_core могут работать вместе
+
+static engine_t engine;
+
+static void log_message(int prio, int core, const char *msg) {
+    if (core >= 0) {
+        syslog(prio, "Core %d: %s", core, msg);
+    } else {
+        syslog(prio, "%s", msg);
+    }
+}
+
+// Только флаг: потоки собирает и ресурсы освобождает main
+static void signal_handler(int sig) {
     if (sig == SIGTERM || sig == SIGINT) {
-        syslog(LOG_INFO, "Получен сигнал завершения, останавливаем сервис...");
-        global_running = 0;
-        
-        // Ждем завершения всех потоков
-        for (int i = 0; i < DAEMON_CORES; i++) {
-            core_args[i].running = 0;
-            pthread_join(core_threads[i], NULL);
-        }
-        
-        closelog();
-        unlink(PID_FILE);
-        exit(0);
+        engine_stop(&engine);
+    }
+}
+
+// После chdir("/") относительные пути из config.cfg считаются от каталога запуска
+static void make_absolute(char *path, size_t len, const char *cwd) {
+    if (!*path || *path == '/') return;
+    char abs[PATH_MAX];
+    const char *rel = strncmp(path, "./", 2) == 0 ? path + 2 : path;
+    if (snprintf(abs, sizeof(abs), "%s/%s", cwd, rel) < (int)len) {
+        strcpy(path, abs);
+    }
+}
+
+// То же для trace= в спецификации нагрузки replay ("replay,trace=путь,speed=1")
+static void make_workload_absolute(char *spec, size_t len, const char *cwd) {
+    if (strncmp(spec, "replay,", 7) != 0) return;
+    char *val = strstr(spec, ",trace=");
+    if (!val) return;
+    val += strlen(",trace=");
+    size_t vlen = strcspn(val, ",");
+    char path[PATH_MAX], out[SETTINGS_PATH_MAX * 2];
+    if (vlen >= sizeof(path)) return;
+    memcpy(path, val, vlen);
+    path[vlen] = '\0';
+    make_absolute(path, sizeof(path), cwd);
+    if (snprintf(out, sizeof(out), "%.*s%s%s", (int)(val - spec), spec, path, val + vlen) < (int)len) {
+        strcpy(spec, out);
     }
 }
 
@@ -95,89 +102,54 @@ void daemonize(void) {
     }
 }
 
-void* core_run(void *v) {
-    daemon_core_arg_t *c = (daemon_core_arg_t*)v;
-    cache_t cache;
-    cache_init(&cache);
-    ring_cache_init();
-
-    while (c->running && global_running) {
-        // Основная логика обработки с увеличенными задержками
-        static uint64_t pos[DAEMON_CORES] = {0};
-        uint64_t idx = pos[c->id]++;
-        uint64_t offset = (uint64_t)c->id * c->seg_size + 
-                         (idx % (c->seg_size / BLOCK_SIZE)) * BLOCK_SIZE;
-
-        char buf[BLOCK_SIZE];
-        char *page = cache_get(&cache, c->fd, offset, 1);
-        if (!page) {
-            syslog(LOG_ERR, "Core %d: Failed to get cache page", c->id);
-            struct timespec delay = {0, HIGH_LOAD_DELAY_NS};
-            nanosleep(&delay, NULL);
-            continue;
-        }
-
-        memcpy(buf, page, BLOCK_SIZE);
-
-        // Сокращенная обработка данных
-        for (int i = 0; i < BLOCK_SIZE; i++) {
-            buf[i] ^= c->id;
-        }
-
-        // Сжатие и запись
-        char cmp[BLOCK_SIZE];
-        int cs = compress_page(buf, BLOCK_SIZE, cmp, 1);
-        if (cs > 0) {
-            pwrite(c->fd, cmp, cs, offset);
-        }
-
-        cache_to_ring(offset, buf);
-
-        // Увеличенная задержка для снижения нагрузки
-        struct timespec delay = {0, BASE_LOAD_DELAY_NS * 2};
-        nanosleep(&delay, NULL);
+int main(void) {
+    settings_t cfg;
+    settings_defaults(&cfg);
+    cfg.cores = DAEMON_CORES;
+    cfg.segment_mb = DAEMON_SEGMENT_MB;
+    cfg.transform_passes = DAEMON_TRANSFORM_PASSES;
+    // Фоновый режим: AIMD по задержкам и давлению, доля работы не выше DAEMON_CPU_BUDGET
+    cfg.load_mode = LOADCTL_BACKGROUND;
+    cfg.cpu_budget = DAEMON_CPU_BUDGET;
+    cfg.load_threshold = LOAD_THRESHOLD;
+    cfg.fail_delay_ms = HIGH_LOAD_DELAY_MS;
+    snprintf(cfg.metrics_shm, sizeof(cfg.metrics_shm), "%s", DAEMON_METRICS_SHM);
+    // Файл читается до daemonize: ошибки ещё видны в терминале
+    if (settings_load(&cfg, NULL, DAEMON_PREFIX) < 0) exit(EXIT_FAILURE);
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd))) {
+        make_absolute(cfg.swap_img_path, sizeof(cfg.swap_img_path), cwd);
+        make_absolute(cfg.swap_log_path, sizeof(cfg.swap_log_path), cwd);
+        make_absolute(cfg.swap_dict_path, sizeof(cfg.swap_dict_path), cwd);
+        make_absolute(cfg.warm_path, sizeof(cfg.warm_path), cwd);
+        make_absolute(cfg.trace_record, sizeof(cfg.trace_record), cwd);
+        make_workload_absolute(cfg.workload, sizeof(cfg.workload), cwd);
     }
 
-    ring_cache_destroy();
-    cache_destroy(&cache, c->fd);
-    return NULL;
-}
-
-int main(void) {
     daemonize();
     syslog(LOG_INFO, "PseudoCore daemon запущен");
 
-    // Устанавливаем обработчики сигналов
-    signal(SIGTERM, signal_handler);
-    signal(SIGINT, signal_handler);
-
-    // Открываем файл хранилища
-    int fd = open("storage_swap.img", O_RDWR | O_CREAT, 0644);
-    if (fd < 0) {
-        syslog(LOG_ERR, "Не удалось открыть файл хранилища");
+    if (engine_open(&engine, &cfg, log_message) != 0) {
+        syslog(LOG_ERR, "Не удалось запустить движок");
+        unlink(PID_FILE);
+        closelog();
         exit(EXIT_FAILURE);
     }
 
-    // Запускаем потоки обработки
-    for (int i = 0; i < DAEMON_CORES; i++) {
-        core_args[i].id = i;
-        core_args[i].fd = fd;
-        core_args[i].seg_size = DAEMON_SEGMENT_MB * 1024 * 1024;
-        core_args[i].running = 1;
-
-        if (pthread_create(&core_threads[i], NULL, core_run, &core_args[i]) != 0) {
-            syslog(LOG_ERR, "Не удалось создать поток для ядра %d", i);
-            exit(EXIT_FAILURE);
-        }
-    }
+    // Устанавливаем обработчики сигналов
+    signal(SIGTERM, signal_handler);
+    signal(SIGINT, signal_handler);
 
-    // Основной цикл демона
-    while (global_running) {
-        sleep(1);
+    int rc = engine_start(&engine);
+    if (rc == 0) {
+        engine_wait(&engine);
+    } else {
+        syslog(LOG_ERR, "Не удалось запустить потоки ядер");
     }
-
-    close(fd);
+    syslog(LOG_INFO, "Получен сигнал завершения, останавливаем сервис...");
+    engine_close(&engine);
     syslog(LOG_INFO, "PseudoCore daemon завершил работу");
+    unlink(PID_FILE);
     closelog();
-    return 0;
+    return rc == 0 ? 0 : EXIT_FAILURE;
 }
@@ -0,0 +1,79 @@
+// Сборщик метрик: читает гистограммы задержек работающего pseudo_core или демона
+// из разделяемой памяти, процесс при этом не останавливается.
+//   pseudo_metrics [-p] [-i секунд] [имя сегмента]
+// -p — текстовый формат Prometheus (summary с квантилями), -i — повторять с интервалом
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "metrics.h"
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+#define NQUANTILES (sizeof(quantiles) / sizeof(quantiles[0]))
+
+static void print_table(const metrics_shm_t *m) {
+    time_t now = time(NULL);
+    printf("pid %d, up %lds, %u threads\n", m->pid, (long)(now - (time_t)m->started),
+           atomic_load_explicit(&m->slots_used, memory_order_relaxed));
+    printf("%-12s %12s %10s %10s %10s %10s %10s %12s\n",
+           "metric", "count", "mean ns", "p50 ns", "p90 ns", "p99 ns", "p999 ns", "max ns");
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        metrics_summary_t s;
+        metrics_summarize(m, (metric_id_t)i, &s);
+        printf("%-12s %12lu %10lu", m->names[i], s.count, s.count ? s.sum_ns / s.count : 0);
+        for (size_t q = 0; q < NQUANTILES; q++) printf(" %10lu", metrics_percentile(&s, quantiles[q]));
+        printf(" %12lu\n", s.max_ns);
+    }
+}
+
+static void print_prometheus(const metrics_shm_t *m) {
+    printf("# HELP pseudo_core_latency_seconds Operation latency by type\n");
+    printf("# TYPE pseudo_core_latency_seconds summary\n");
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        metrics_summary_t s;
+        metrics_summarize(m, (metric_id_t)i, &s);
+        for (size_t q = 0; q < NQUANTILES; q++) {
+            printf("pseudo_core_latency_seconds{op=\"%s\",quantile=\"%g\"} %.9f\n", m->names[i], quantiles[q],
+                   metrics_percentile(&s, quantiles[q]) / 1e9);
+        }
+        printf("pseudo_core_latency_seconds_sum{op=\"%s\"} %.9f\n", m->names[i], s.sum_ns / 1e9);
+        printf("pseudo_core_latency_seconds_count{op=\"%s\"} %lu\n", m->names[i], s.count);
+    }
+}
+
+int main(int argc, char **argv) {
+    int prometheus = 0;
+    int interval = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "pi:")) != -1) {
+        switch (opt) {
+        case 'p': prometheus = 1; break;
+        case 'i': interval = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-p] [-i seconds] [segment, default %s]\n", argv[0], METRICS_SHM_NAME);
+            return 2;
+        }
+    }
+    const char *name = optind < argc ? argv[optind] : METRICS_SHM_NAME;
+    const metrics_shm_t *m = metrics_attach(name);
+    if (!m) {
+        fprintf(stderr, "Cannot read metrics segment %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+    for (;;) {
+        if (prometheus) {
+            print_prometheus(m);
+        } else {
+            print_table(m);
+        }
+        fflush(stdout);
+        if (interval <= 0) break;
+        sleep((unsigned)interval);
+        if (!prometheus) printf("\n");
+    }
+    metrics_detach(m);
+    return 0;
+}
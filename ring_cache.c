@@ -1,41 +1,237 @@
 #include "ring_cache.h"
+#include "compress.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdatomic.h>
 
-static size_t ring_pos;
-static void *ring_buffer;
-static pthread_mutex_t ring_mutex;
+#define RING_TAG_BITS 24
+#define RING_TAG_MASK ((1ull << RING_TAG_BITS) - 1)
 
-void ring_cache_init(void) {
-    ring_buffer = malloc(RING_SIZE);
-    if (!ring_buffer) {
+// Заголовок записи в кольце; по нему читатель убеждается, что запись — искомая страница
+typedef struct {
+    uint64_t off;
+    uint16_t clen;
+    uint8_t codec;
+    uint8_t pad[5];
+} ring_rec_hdr_t;
+
+static char *ring_buffer;
+static uint64_t ring_chunks;            // блоков в кольце
+static unsigned ring_hash_bits;         // наборов индекса: 2^bits
+// Абсолютный счётчик зарезервированных блоков; блок x затирается резервированием x + ring_chunks
+static _Atomic uint64_t ring_head;
+// 2^ring_hash_bits наборов по RING_WAYS: (блок записи << RING_TAG_BITS) | метка смещения, 0 — пусто
+static _Atomic uint64_t *ring_index;
+// Резерв текущего потока: [res_pos, res_end) получены одним fetch-add
+static _Thread_local uint64_t res_pos, res_end;
+static _Atomic uint64_t stat_lookups, stat_hits, stat_inserts, stat_updates, stat_overwritten,
+                        stat_invalidations, stat_bypassed, stat_bytes_inserted;
+
+static uint64_t ring_hash(uint64_t off) {
+    return (off / BLOCK_SIZE) * 0x9E3779B97F4A7C15ull;
+}
+
+static _Atomic uint64_t *ring_set(uint64_t h) {
+    return &ring_index[(h >> (64 - ring_hash_bits)) * RING_WAYS];
+}
+
+static uint64_t ring_tag(uint64_t h) {
+    return (h & RING_TAG_MASK) | 1; // Never 0, so an entry is never mistaken for an empty way
+}
+
+static char *rec_at(uint64_t pos) {
+    return ring_buffer + (pos % ring_chunks) * RING_CHUNK;
+}
+
+// A record is intact until a writer reserves its first chunk on the next lap
+static int rec_live(uint64_t pos) {
+    return atomic_load_explicit(&ring_head, memory_order_relaxed) <= pos + ring_chunks;
+}
+
+// Does index entry v hold page off? The header is read optimistically and rechecked after
+static int rec_is(uint64_t v, uint64_t off) {
+    uint64_t pos = v >> RING_TAG_BITS;
+    if (!rec_live(pos)) return 0;
+    uint64_t rec_off;
+    memcpy(&rec_off, rec_at(pos), sizeof(rec_off));
+    atomic_thread_fence(memory_order_acquire);
+    return rec_live(pos) && rec_off == off;
+}
+
+// Reserve n contiguous chunks. Blocks of RING_RESERVE_CHUNKS never straddle the end of the
+// buffer, and a record that does not fit the rest of the block starts a new one
+static uint64_t ring_reserve(uint32_t n) {
+    uint64_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    // A reservation left idle for half a lap is dropped: its chunks are about to be reused
+    if (res_end - res_pos < n || head - res_pos > ring_chunks / 2) {
+        res_pos = atomic_fetch_add_explicit(&ring_head, RING_RESERVE_CHUNKS, memory_order_relaxed);
+        res_end = res_pos + RING_RESERVE_CHUNKS;
+        // Readers that may see our chunk writes must also see the new head and discard old data
+        atomic_thread_fence(memory_order_release);
+    }
+    uint64_t pos = res_pos;
+    res_pos += n;
+    return pos;
+}
+
+// Remove every way holding off; returns the number removed
+static int index_drop(uint64_t off) {
+    uint64_t h = ring_hash(off), tag = ring_tag(h);
+    _Atomic uint64_t *ways = ring_set(h);
+    int dropped = 0;
+    for (int w = 0; w < RING_WAYS; w++) {
+        uint64_t v = atomic_load_explicit(&ways[w], memory_order_acquire);
+        if (v && (v & RING_TAG_MASK) == tag && rec_is(v, off) &&
+            atomic_compare_exchange_strong(&ways[w], &v, 0)) {
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+// Publish entry nv for off: over its older copy, else into an empty or overwritten way, else over the oldest
+static int index_publish(uint64_t off, uint64_t nv) {
+    uint64_t h = ring_hash(off), tag = ring_tag(h);
+    _Atomic uint64_t *ways = ring_set(h);
+    for (int attempt = 0; attempt < RING_WAYS; attempt++) {
+        int victim = -1, same = 0;
+        uint64_t victim_v = 0, victim_pos = UINT64_MAX;
+        for (int w = 0; w < RING_WAYS; w++) {
+            uint64_t v = atomic_load_explicit(&ways[w], memory_order_acquire);
+            if (v && (v & RING_TAG_MASK) == tag && rec_is(v, off)) {
+                victim = w;
+                victim_v = v;
+                same = 1;
+                break;
+            }
+            uint64_t pos = v && rec_live(v >> RING_TAG_BITS) ? v >> RING_TAG_BITS : 0;
+            if (pos < victim_pos) {
+                victim = w;
+                victim_v = v;
+                victim_pos = pos;
+            }
+        }
+        if (atomic_compare_exchange_strong_explicit(&ways[victim], &victim_v, nv,
+                                                    memory_order_release, memory_order_relaxed)) {
+            if (same) atomic_fetch_add_explicit(&stat_updates, 1, memory_order_relaxed);
+            if (!same && victim_v && victim_pos == 0) {
+                atomic_fetch_add_explicit(&stat_overwritten, 1, memory_order_relaxed);
+            }
+            return 1;
+        }
+    }
+    return 0; // Lost every race for this set; the page simply is not cached
+}
+
+void ring_cache_init(size_t bytes) {
+    if (bytes == 0) bytes = RING_SIZE;
+    // Whole reservation blocks only, so none straddles the end of the buffer
+    ring_chunks = bytes / RING_CHUNK / RING_RESERVE_CHUNKS * RING_RESERVE_CHUNKS;
+    if (ring_chunks < 4 * RING_RESERVE_CHUNKS) ring_chunks = 4 * RING_RESERVE_CHUNKS;
+    // A set per two chunks: with RING_WAYS ways that leaves room for pages of one chunk each
+    ring_hash_bits = RING_HASH_BITS;
+    if (ring_hash_bits == 0) {
+        ring_hash_bits = 10;
+        while (ring_hash_bits < 28 && (1ull << ring_hash_bits) < ring_chunks / 2) ring_hash_bits++;
+    }
+    ring_buffer = malloc(ring_chunks * RING_CHUNK);
+    ring_index = calloc((size_t)1 << ring_hash_bits, RING_WAYS * sizeof(*ring_index));
+    if (!ring_buffer || !ring_index) {
         fprintf(stderr, "Error allocating memory for ring buffer\n");
         exit(1);
     }
-    ring_pos = 0;
-    pthread_mutex_init(&ring_mutex, NULL);
+    atomic_store(&ring_head, 0);
 }
 
 void cache_to_ring(uint64_t off, const void *data) {
-    if (!data || !ring_buffer) {
-        fprintf(stderr, "Invalid data or ring buffer not initialized for offset %lu\n", off);
+    if (!data || !ring_buffer) return; // Tier not set up (e.g. a cache used without the ring)
+    // Compressed with this thread's context; the fast codec, as for hot pages
+    char cbuf[BLOCK_SIZE];
+    compress_codec_t codec;
+    int lvl;
+    int clen = compress_page_auto(data, BLOCK_SIZE, cbuf, COMPRESS_HOT_THRESHOLD, &codec, &lvl);
+    if (clen <= 0 || clen > RING_MAX_STORED) {
+        index_drop(off); // The page leaves the tier rather than keep an older copy
+        atomic_fetch_add_explicit(&stat_bypassed, 1, memory_order_relaxed);
         return;
     }
-    pthread_mutex_lock(&ring_mutex);
-    // Copy block data into the ring buffer
-    if (ring_pos + BLOCK_SIZE <= RING_SIZE) {
-        memcpy((char*)ring_buffer + ring_pos, data, BLOCK_SIZE);
-        ring_pos = (ring_pos + BLOCK_SIZE) % RING_SIZE;
-    } else {
-        fprintf(stderr, "Ring buffer overflow prevented for offset %lu\n", off);
+    ring_rec_hdr_t hdr = { .off = off, .clen = (uint16_t)clen, .codec = (uint8_t)codec };
+    uint32_t n = (uint32_t)((sizeof(hdr) + (size_t)clen + RING_CHUNK - 1) / RING_CHUNK);
+    uint64_t pos = ring_reserve(n);
+    // The chunks are ours alone: copied in without any lock
+    char *rec = rec_at(pos);
+    memcpy(rec, &hdr, sizeof(hdr));
+    memcpy(rec + sizeof(hdr), cbuf, (size_t)clen);
+    if (index_publish(off, (pos << RING_TAG_BITS) | ring_tag(ring_hash(off)))) {
+        atomic_fetch_add_explicit(&stat_inserts, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stat_bytes_inserted, (uint64_t)clen, memory_order_relaxed);
+    }
+}
+
+int ring_cache_lookup(uint64_t off, void *out) {
+    if (!ring_buffer) return 0;
+    atomic_fetch_add_explicit(&stat_lookups, 1, memory_order_relaxed);
+    uint64_t h = ring_hash(off), tag = ring_tag(h);
+    _Atomic uint64_t *ways = ring_set(h);
+    for (int w = 0; w < RING_WAYS; w++) {
+        uint64_t v = atomic_load_explicit(&ways[w], memory_order_acquire);
+        if (!v || (v & RING_TAG_MASK) != tag) continue;
+        uint64_t pos = v >> RING_TAG_BITS;
+        if (!rec_live(pos)) continue;
+        // Copy optimistically, then check that no writer lapped the record meanwhile
+        ring_rec_hdr_t hdr;
+        char cbuf[BLOCK_SIZE];
+        const char *rec = rec_at(pos);
+        memcpy(&hdr, rec, sizeof(hdr));
+        if (hdr.off != off || hdr.clen == 0 || hdr.clen > RING_MAX_STORED) continue;
+        memcpy(cbuf, rec + sizeof(hdr), hdr.clen);
+        atomic_thread_fence(memory_order_acquire);
+        if (!rec_live(pos)) continue;
+        if (decompress_page_codec((compress_codec_t)hdr.codec, cbuf, hdr.clen, out, BLOCK_SIZE) != BLOCK_SIZE) {
+            fprintf(stderr, "Ring cache: corrupt page at offset %lu, reading from disk\n", off);
+            atomic_compare_exchange_strong(&ways[w], &v, 0);
+            return 0;
+        }
+        atomic_fetch_add_explicit(&stat_hits, 1, memory_order_relaxed);
+        return 1;
+    }
+    return 0;
+}
+
+void ring_cache_invalidate(uint64_t off) {
+    if (!ring_buffer) return;
+    int dropped = index_drop(off);
+    if (dropped) atomic_fetch_add_explicit(&stat_invalidations, (uint64_t)dropped, memory_order_relaxed);
+}
+
+void ring_cache_stats(ring_cache_stats_t *out) {
+    out->lookups = atomic_load_explicit(&stat_lookups, memory_order_relaxed);
+    out->hits = atomic_load_explicit(&stat_hits, memory_order_relaxed);
+    out->inserts = atomic_load_explicit(&stat_inserts, memory_order_relaxed);
+    out->updates = atomic_load_explicit(&stat_updates, memory_order_relaxed);
+    out->overwritten = atomic_load_explicit(&stat_overwritten, memory_order_relaxed);
+    out->invalidations = atomic_load_explicit(&stat_invalidations, memory_order_relaxed);
+    out->bypassed = atomic_load_explicit(&stat_bypassed, memory_order_relaxed);
+    out->bytes_inserted = atomic_load_explicit(&stat_bytes_inserted, memory_order_relaxed);
+    out->live_pages = out->live_bytes = 0;
+    out->size = ring_buffer ? ring_chunks * RING_CHUNK : 0;
+    if (!ring_buffer) return;
+    // Walk the index; approximate while writers are running
+    for (size_t i = 0; i < ((size_t)1 << ring_hash_bits) * RING_WAYS; i++) {
+        uint64_t v = atomic_load_explicit(&ring_index[i], memory_order_acquire);
+        if (!v || !rec_live(v >> RING_TAG_BITS)) continue;
+        ring_rec_hdr_t hdr;
+        memcpy(&hdr, rec_at(v >> RING_TAG_BITS), sizeof(hdr));
+        out->live_pages++;
+        out->live_bytes += hdr.clen;
     }
-    pthread_mutex_unlock(&ring_mutex);
 }
 
 void ring_cache_destroy(void) {
-    pthread_mutex_destroy(&ring_mutex);
     free(ring_buffer);
+    free(ring_index);
     ring_buffer = NULL;
-    ring_pos = 0;
+    ring_index = NULL;
+    atomic_store(&ring_head, 0);
 }
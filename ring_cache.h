@@ -2,13 +2,57 @@
 #define RING_CACHE_H
 
 #include <stdint.h>
-#include <pthread.h>
+#include <stddef.h>
 #include "config.h"
 
-#define RING_SIZE (CACHE_MB * 1024 * 1024)
+// Кольцо вытесненных страниц в сжатом виде: записи переменной длины дописываются
+// по кругу в буфер (RING_SIZE или размер из ring_cache_init) блоками по RING_CHUNK байт, самые старые затираются первыми.
+// Без блокировок: место резервируется atomic fetch-add, индекс публикуется атомарно,
+// читатель проверяет после копирования, что запись не затёрта (как seqlock).
 
-void ring_cache_init(void);
+#define RING_SIZE ((size_t)CACHE_MB * 1024 * 1024) // размер по умолчанию
+#ifndef RING_CHUNK
+#define RING_CHUNK 256                  // гранулярность размещения сжатых страниц
+#endif
+#ifndef RING_RESERVE_CHUNKS
+#define RING_RESERVE_CHUNKS 32          // потоку за один fetch-add; число блоков кольца кратно ему
+#endif
+#ifndef RING_MAX_STORED
+#define RING_MAX_STORED (BLOCK_SIZE - BLOCK_SIZE / 4) // хуже сжатые страницы в кольцо не попадают
+#endif
+
+#ifndef RING_HASH_BITS
+#define RING_HASH_BITS 0                // наборов индекса смещение -> запись: 2^bits; 0 — по размеру кольца
+#endif
+#ifndef RING_WAYS
+#define RING_WAYS 4                     // ассоциативность набора
+#endif
+
+// Статистика кольца как кэша второго уровня
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t inserts;
+    uint64_t updates;                   // из них страница уже была в кольце, старая копия заменена
+    uint64_t overwritten;               // записи индекса, затёртые переходом кольца через начало
+    uint64_t invalidations;
+    uint64_t bypassed;                  // несжимаемые страницы, не принятые в кольцо
+    uint64_t bytes_inserted;            // сжатых байт всех вставок: средний размер = bytes_inserted / inserts
+    uint64_t live_pages;                // по обходу индекса в момент вызова
+    uint64_t live_bytes;                // сжатых байт, занятых живыми страницами
+    uint64_t size;                      // размер буфера кольца
+} ring_cache_stats_t;
+
+// Кольцо общее для процесса: init/destroy вызываются один раз, до и после рабочих потоков.
+// bytes — размер буфера (0 — RING_SIZE); индекс — набор на два блока кольца
+void ring_cache_init(size_t bytes);
+// Сжимает и кладёт актуальную (совпадающую с хранилищем) копию страницы, заменяя прежнюю
 void cache_to_ring(uint64_t off, const void *data);
+// Распаковывает страницу в out; 1 — найдена, 0 — нет в кольце
+int ring_cache_lookup(uint64_t off, void *out);
+// Убирает копию, ставшую устаревшей
+void ring_cache_invalidate(uint64_t off);
+void ring_cache_stats(ring_cache_stats_t *out);
 void ring_cache_destroy(void);
 
 #endif // RING_CACHE_H
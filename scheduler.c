@@ -3,71 +3,263 @@
 // Пожалуйста, обновите includePath, выбрав команду "C/C++: Select IntelliSense Configuration..." 
 // или добавив необходимые пути в настройки c_cpp_properties.json.
 #include "scheduler.h"
+#include "affinity.h"
+#include "metrics.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
-CoreQueue queues[CORES] = {0};
+#define DEQUE_EMPTY UINT64_MAX
+#define DEQUE_ABORT (UINT64_MAX - 1)
 
-void scheduler_init() {
-    for (int i = 0; i < CORES; i++) {
-        queues[i].count = 0;
-        pthread_mutex_init(&queues[i].mutex, NULL);
+CoreDeque *deques;
+int sched_cores;
+static HotTable *hot_tables;
+// Состояние, которое трогает только поток ядра: генератор выбора жертв и выбранная жертва
+typedef struct {
+    _Alignas(64) uint64_t rng;
+    int victim;
+} steal_state_t;
+static steal_state_t *steal_state;
+
+// 2^(-k/16): fractional part of the decay factor, the whole half-lives are applied with ldexpf
+static const float decay_frac[16] = {
+    1.0000000f, 0.9576033f, 0.9170040f, 0.8781261f, 0.8408964f, 0.8052452f, 0.7711054f, 0.7384131f,
+    0.7071068f, 0.6771278f, 0.6484198f, 0.6209289f, 0.5946036f, 0.5693943f, 0.5452539f, 0.5221369f
+};
+
+static float hot_decay(float score, uint64_t age) {
+    uint64_t halves = age / SCHED_HOT_HALF_LIFE;
+    if (halves >= 32) return 0.0f;
+    return ldexpf(score * decay_frac[(age % SCHED_HOT_HALF_LIFE) * 16 / SCHED_HOT_HALF_LIFE], -(int)halves);
+}
+
+static uint32_t hot_set(const HotTable *t, uint64_t block) {
+    return (uint32_t)(((block / BLOCK_SIZE) * 0x9E3779B97F4A7C15ull) >> 32) & t->set_mask;
+}
+
+static int64_t deque_size(CoreDeque *q) {
+    int64_t n = atomic_load_explicit(&q->bottom, memory_order_relaxed) -
+                atomic_load_explicit(&q->top, memory_order_relaxed);
+    return n > 0 ? n : 0;
+}
+
+// Owner only
+static int deque_push(CoreDeque *q, uint64_t block) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    if (b - t >= SCHED_DEQUE_SIZE) return -1;
+    atomic_store_explicit(&q->buf[b & (SCHED_DEQUE_SIZE - 1)], block, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    return 0;
+}
+
+// Owner only: the newest task from the bottom; the last one left is raced for with the thieves
+static uint64_t deque_pop(CoreDeque *q) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    if (t > b) {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        return DEQUE_EMPTY;
     }
+    uint64_t task = atomic_load_explicit(&q->buf[b & (SCHED_DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (t == b) {
+        if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            task = DEQUE_EMPTY; // A thief took it
+        }
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+// Any thread, the owner included; DEQUE_ABORT when another thief won the race
+static uint64_t deque_steal(CoreDeque *q) {
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t >= b) return DEQUE_EMPTY;
+    uint64_t block = atomic_load_explicit(&q->buf[t & (SCHED_DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return DEQUE_ABORT;
+    }
+    return block;
 }
 
-void scheduler_report_access(int core_id, uint64_t block) {
-    pthread_mutex_lock(&queues[core_id].mutex);
-    CoreQueue *q = &queues[core_id];
-    for (int i = 0; i < q->count; i++) {
-        if (q->w[i].block == block) {
-            q->w[i].hot++;
-            q->w[i].last_seen = time(NULL);
-            pthread_mutex_unlock(&queues[core_id].mutex);
-            return;
+static int random_victim(int core_id) {
+    uint64_t x = steal_state[core_id].rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    steal_state[core_id].rng = x;
+    int v = (int)(x % (uint64_t)(sched_cores - 1));
+    return v >= core_id ? v + 1 : v;
+}
+
+int scheduler_init(int cores, size_t hot_sets) {
+    if (cores < 1) cores = 1;
+    size_t sets = 1;
+    while (sets < (hot_sets ? hot_sets : SCHED_HOT_SETS)) sets <<= 1;
+    deques = aligned_alloc(_Alignof(CoreDeque), (size_t)cores * sizeof(*deques));
+    hot_tables = calloc((size_t)cores, sizeof(*hot_tables));
+    steal_state = aligned_alloc(_Alignof(steal_state_t), (size_t)cores * sizeof(*steal_state));
+    if (!deques || !hot_tables || !steal_state) {
+        scheduler_destroy();
+        return -1;
+    }
+    sched_cores = cores;
+    for (int i = 0; i < cores; i++) {
+        HotTable *t = &hot_tables[i];
+        t->bytes = (sets * sizeof(*t->e) + 4095) & ~(size_t)4095;
+        t->e = aligned_alloc(4096, t->bytes);
+        if (!t->e) {
+            scheduler_destroy();
+            return -1;
         }
+        memset(t->e, 0, t->bytes);
+        t->set_mask = (uint32_t)(sets - 1);
+        t->tick = 0;
+        atomic_init(&deques[i].top, 0);
+        atomic_init(&deques[i].bottom, 0);
+        steal_state[i].rng = 0x9E3779B97F4A7C15ull * (uint64_t)(i + 1);
+        steal_state[i].victim = -1;
     }
-    if (q->count < 64) {
-        q->w[q->count].block = block;
-        q->w[q->count].hot = 1;
-        q->w[q->count].last_seen = time(NULL);
-        q->count++;
+    return 0;
+}
+
+int scheduler_report_access(int core_id, uint64_t block) {
+    HotTable *t = &hot_tables[core_id];
+    uint64_t now = ++t->tick;
+    HotEntry *set = t->e[hot_set(t, block)];
+    HotEntry *victim = &set[0];
+    float victim_score = INFINITY;
+    for (int w = 0; w < SCHED_HOT_WAYS; w++) {
+        HotEntry *e = &set[w];
+        if (e->last_seen && e->block == block) {
+            e->score = hot_decay(e->score, now - e->last_seen) + 1.0f;
+            e->last_seen = now;
+            return (int)(e->score + 0.5f);
+        }
+        float s = e->last_seen ? hot_decay(e->score, now - e->last_seen) : -1.0f;
+        if (s < victim_score) {
+            victim = e;
+            victim_score = s;
+        }
     }
-    pthread_mutex_unlock(&queues[core_id].mutex);
+    // New block replaces the coldest one of its set
+    victim->block = block;
+    victim->score = 1.0f;
+    victim->last_seen = now;
+    return 1;
+}
+
+int scheduler_push_task(int core_id, uint64_t task) {
+    return deque_push(&deques[core_id], task);
+}
+
+int scheduler_pop_task(int core_id, uint64_t *task) {
+    uint64_t t = deque_pop(&deques[core_id]);
+    if (t == DEQUE_EMPTY) return 0;
+    *task = t;
+    return 1;
 }
 
 int scheduler_should_migrate(int core_id) {
-    int total = 0;
-    int other_cores = 0;
-    for (int i = 0; i < CORES; i++) {
-        if (i != core_id) {
-            pthread_mutex_lock(&queues[i].mutex);
-            total += queues[i].count;
-            pthread_mutex_unlock(&queues[i].mutex);
-            other_cores++;
+    if (sched_cores < 2) return 0;
+    // Two random candidates instead of every other core: O(1) atomic loads per operation
+    int64_t own = deque_size(&deques[core_id]);
+    int best = -1;
+    int64_t best_size = own + MIGRATION_THRESHOLD;
+    for (int k = 0; k < SCHED_STEAL_TRIES; k++) {
+        int v = random_victim(core_id);
+        int64_t n = deque_size(&deques[v]);
+        if (n > best_size) {
+            best = v;
+            best_size = n;
         }
     }
-    int avg = (other_cores > 0) ? (total / other_cores) : 0;
-    pthread_mutex_lock(&queues[core_id].mutex);
-    int result = (queues[core_id].count < avg - MIGRATION_THRESHOLD);
-    pthread_mutex_unlock(&queues[core_id].mutex);
-    return result;
-}
-
-uint64_t scheduler_get_migrated_task(int core_id) {
-    for (int i = 0; i < CORES; i++) {
-        if (i == core_id) continue;
-        pthread_mutex_lock(&queues[i].mutex);
-        CoreQueue *q = &queues[i];
-        if (q->count > 0) {
-            uint64_t b = q->w[--q->count].block;
-            pthread_mutex_unlock(&queues[i].mutex);
-            return b;
+    steal_state[core_id].victim = best;
+    return best >= 0;
+}
+
+int scheduler_get_migrated_task(int core_id, uint64_t *task) {
+    if (sched_cores < 2) return 0;
+    uint64_t t0 = metrics_now();
+    int v = steal_state[core_id].victim;
+    steal_state[core_id].victim = -1;
+    int got = 0;
+    for (int k = 0; k <= SCHED_STEAL_TRIES && !got; k++) {
+        if (v < 0) v = random_victim(core_id);
+        uint64_t t = deque_steal(&deques[v]);
+        if (t != DEQUE_EMPTY && t != DEQUE_ABORT) {
+            *task = t;
+            got = 1;
         }
-        pthread_mutex_unlock(&queues[i].mutex);
+        v = -1;
     }
-    return 0;
+    metrics_record(METRIC_MIGRATE, t0);
+    return got;
 }
 
-void scheduler_destroy() {
-    for (int i = 0; i < CORES; i++) {
-        pthread_mutex_destroy(&queues[i].mutex);
+size_t scheduler_hot_snapshot(int core_id, uint64_t *blocks, float *scores, size_t max) {
+    const HotTable *t = &hot_tables[core_id];
+    size_t n = 0;
+    for (uint32_t set = 0; set <= t->set_mask; set++) {
+        for (int w = 0; w < SCHED_HOT_WAYS && n < max; w++) {
+            const HotEntry *e = &t->e[set][w];
+            if (!e->last_seen) continue;
+            float s = hot_decay(e->score, t->tick - e->last_seen);
+            if (s <= 0.0f) continue;
+            blocks[n] = e->block;
+            scores[n++] = s;
+        }
     }
+    return n;
+}
+
+void scheduler_seed_hot(int core_id, uint64_t block, float score) {
+    HotTable *t = &hot_tables[core_id];
+    uint64_t now = ++t->tick;
+    HotEntry *set = t->e[hot_set(t, block)];
+    HotEntry *victim = &set[0];
+    float victim_score = INFINITY;
+    for (int w = 0; w < SCHED_HOT_WAYS; w++) {
+        HotEntry *e = &set[w];
+        float s = e->last_seen ? hot_decay(e->score, now - e->last_seen) : -1.0f;
+        if (e->last_seen && e->block == block) {
+            victim = e;
+            break;
+        }
+        if (s < victim_score) {
+            victim = e;
+            victim_score = s;
+        }
+    }
+    victim->block = block;
+    victim->score = score;
+    victim->last_seen = now;
+}
+
+void scheduler_bind_core(int core_id, int node) {
+    affinity_bind_memory(&deques[core_id], sizeof(deques[core_id]), node);
+    affinity_bind_memory(hot_tables[core_id].e, hot_tables[core_id].bytes, node);
+}
+
+int scheduler_queue_depth(int core_id) {
+    return (int)deque_size(&deques[core_id]);
+}
+
+void scheduler_destroy(void) {
+    for (int i = 0; hot_tables && i < sched_cores; i++) free(hot_tables[i].e);
+    free(hot_tables);
+    free(deques);
+    free(steal_state);
+    hot_tables = NULL;
+    deques = NULL;
+    steal_state = NULL;
+    sched_cores = 0;
 }
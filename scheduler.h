@@ -2,33 +2,86 @@
 #define SCHEDULER_H
 
 #include <stdint.h>
-#include <time.h>
-#include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
 
 #include "config.h"
 
-#ifndef CORES
-#define CORES 4
+#ifndef SCHED_HOT_SETS
+#define SCHED_HOT_SETS 1024             // наборов таблицы горячих блоков на ядро по умолчанию (степень двойки)
 #endif
+#ifndef SCHED_HOT_WAYS
+#define SCHED_HOT_WAYS 4                // блоков в наборе; вытесняется наименее горячий
+#endif
+#ifndef SCHED_HOT_HALF_LIFE
+#define SCHED_HOT_HALF_LIFE 1024        // обращений ядра, за которые горячесть убывает вдвое
+#endif
+
+#ifndef SCHED_DEQUE_SIZE
+#define SCHED_DEQUE_SIZE 256            // заданий в деке ядра (степень двойки)
+#endif
+#ifndef SCHED_REFILL
+#define SCHED_REFILL 16                 // заданий, которые ядро порождает в свой дек за раз, когда он пуст
+#endif
+#ifndef SCHED_KEEP_HOT
+#define SCHED_KEEP_HOT 2                // с этой горячести задание ядро выполняет первым, холодные ближе к ворам
+#endif
+#ifndef SCHED_STEAL_TRIES
+#define SCHED_STEAL_TRIES 2             // случайных жертв на одну попытку миграции
+#endif
+
+// Дек Чейза–Леви: владелец кладёт и снимает снизу, воры забирают сверху, без блокировок;
+// за последнее задание владелец и вор спорят CAS по top. Задание — непрозрачные 64 бита (engine.c).
+// Выровнен по странице, чтобы его можно было разместить на узле ядра (scheduler_bind_core)
+typedef struct {
+    _Alignas(4096) _Atomic int64_t top;
+    _Alignas(64) _Atomic int64_t bottom;
+    _Atomic uint64_t buf[SCHED_DEQUE_SIZE];
+} CoreDeque;
 
-typedef struct { 
-    uint64_t block; 
-    int hot; 
-    time_t last_seen; 
-} WorkUnit;
+// Горячесть блока: частота обращений с экспоненциальным затуханием по last_seen
+typedef struct {
+    uint64_t block;
+    float score;                        // значение на момент last_seen
+    uint64_t last_seen;                 // такт ядра (номер обращения); 0 — запись пуста
+} HotEntry;
 
-typedef struct { 
-    WorkUnit w[64]; 
-    int count; 
-    pthread_mutex_t mutex;
-} CoreQueue;
+// Таблица горячих блоков ядра; пишет только поток этого ядра, поэтому без блокировок.
+// Наборы — отдельный блок, выровненный по странице, чтобы его можно было разместить на узле ядра
+typedef struct {
+    HotEntry (*e)[SCHED_HOT_WAYS];
+    uint32_t set_mask;
+    size_t bytes;
+    uint64_t tick;
+} HotTable;
 
-extern CoreQueue queues[CORES];
+extern CoreDeque *deques;
+extern int sched_cores;
 
-void scheduler_init();
-void scheduler_report_access(int core_id, uint64_t block);
+// Таблицы на cores ядер по hot_sets наборов (округляется до степени двойки; 0 — SCHED_HOT_SETS);
+// 0 или -1, если не хватило памяти
+int scheduler_init(int cores, size_t hot_sets);
+// Учитывает обращение ядра core_id (вызывается только его потоком) за O(1);
+// возвращает округлённую горячесть блока с учётом затухания, не меньше 1
+int scheduler_report_access(int core_id, uint64_t block);
+// Кладёт задание в свой дек (только поток ядра core_id); 0 или -1, если дек полон
+int scheduler_push_task(int core_id, uint64_t task);
+// Снимает последнее положенное задание своего дека (только поток ядра); 1 или 0, если дек пуст
+int scheduler_pop_task(int core_id, uint64_t *task);
+// Сравнивает свою очередь со случайно выбранными ядрами по атомарным снимкам размеров
 int scheduler_should_migrate(int core_id);
-uint64_t scheduler_get_migrated_task(int core_id);
-void scheduler_destroy();
+// Крадёт старейшее задание у жертвы, выбранной scheduler_should_migrate, затем у случайных;
+// 1 или 0 — красть нечего
+int scheduler_get_migrated_task(int core_id, uint64_t *task);
+// Разместить дек и таблицу горячих блоков ядра на NUMA-узле node
+void scheduler_bind_core(int core_id, int node);
+// Горячие блоки ядра с горячестью на текущий такт, не больше max; возвращает их число
+// (снимок тёплого кэша: вызывать, когда поток ядра остановлен)
+size_t scheduler_hot_snapshot(int core_id, uint64_t *blocks, float *scores, size_t max);
+// Заносит блок с горячестью score в таблицу ядра до запуска его потока (прогрев)
+void scheduler_seed_hot(int core_id, uint64_t block, float score);
+// Атомарный снимок глубины дека ядра
+int scheduler_queue_depth(int core_id);
+void scheduler_destroy(void);
 
 #endif // SCHEDULER_H
@@ -0,0 +1,319 @@
+// Настройки времени выполнения: config.cfg поверх config.h и подбор размеров под машину
+#include "settings.h"
+#include "cache.h"
+#include "scheduler.h"
+#include "workload.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifndef CORE_CPUS
+#define CORE_CPUS ""
+#endif
+#ifndef CORE_TRANSFORM
+#define CORE_TRANSFORM "xor"
+#endif
+#ifndef CORE_WORKLOAD
+#define CORE_WORKLOAD "seq"
+#endif
+#ifndef CORE_TRACE_RECORD
+#define CORE_TRACE_RECORD ""
+#endif
+#ifndef SWAP_LOG_PATH
+#define SWAP_LOG_PATH "./storage_swap.log"
+#endif
+#ifndef SWAP_DICT_PATH
+#define SWAP_DICT_PATH "./storage_swap.dict"
+#endif
+#ifndef SWAP_WARM_PATH
+#define SWAP_WARM_PATH "./storage_swap.warm"
+#endif
+#ifndef DIRECT_IO
+#define DIRECT_IO 0
+#endif
+
+typedef enum { KEY_INT, KEY_SIZE, KEY_DOUBLE, KEY_STR, KEY_LOADCTL } key_type_t;
+
+typedef struct {
+    const char *name;
+    key_type_t type;
+    size_t off;
+    size_t len;                 // KEY_STR: размер буфера
+} settings_key_t;
+
+#define KEY(name, type, field) { name, type, offsetof(settings_t, field), 0 }
+#define KEY_S(name, field) { name, KEY_STR, offsetof(settings_t, field), sizeof(((settings_t *)0)->field) }
+
+static const settings_key_t keys[] = {
+    KEY("CORES", KEY_INT, cores),
+    KEY("CACHE_MB", KEY_SIZE, cache_mb),
+    KEY("RING_MB", KEY_SIZE, ring_mb),
+    KEY("SEGMENT_MB", KEY_SIZE, segment_mb),
+    KEY("MAX_CACHE_ENTRIES", KEY_SIZE, max_cache_entries),
+    KEY("HASH_SIZE", KEY_SIZE, hash_size),
+    KEY("MUTEX_GROUPS", KEY_SIZE, mutex_groups),
+    KEY("SCHED_HOT_SETS", KEY_SIZE, sched_hot_sets),
+    KEY_S("SWAP_IMG_PATH", swap_img_path),
+    KEY_S("SWAP_LOG_PATH", swap_log_path),
+    KEY_S("SWAP_DICT_PATH", swap_dict_path),
+    KEY_S("WARM_SNAPSHOT", warm_path),
+    KEY_S("CORE_CPUS", cpus),
+    KEY_S("CORE_TRANSFORM", transform),
+    KEY("TRANSFORM_PASSES", KEY_INT, transform_passes),
+    KEY_S("WORKLOAD", workload),
+    KEY_S("TRACE_RECORD", trace_record),
+    KEY("PIPELINE", KEY_INT, pipeline),
+    KEY("COMPRESS_WORKERS", KEY_INT, compress_workers),
+    KEY("WRITE_THREADS", KEY_INT, write_threads),
+    KEY("LOADCTL_MODE", KEY_LOADCTL, load_mode),
+    KEY("CPU_BUDGET", KEY_DOUBLE, cpu_budget),
+    KEY("LOAD_THRESHOLD", KEY_INT, load_threshold),
+    KEY("STATS_WINDOWS", KEY_INT, stats_windows),
+    KEY("FAIL_DELAY_MS", KEY_INT, fail_delay_ms),
+    KEY_S("METRICS_SHM", metrics_shm),
+    KEY("DIRECT_IO", KEY_INT, direct_io),
+};
+
+static void copy_str(char *dst, size_t len, const char *src) {
+    snprintf(dst, len, "%s", src);
+}
+
+void settings_defaults(settings_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->cores = CORES;
+    s->cache_mb = CACHE_MB;
+    s->segment_mb = SEGMENT_MB;
+    s->max_cache_entries = MAX_CACHE_ENTRIES;
+    s->hash_size = HASH_SIZE;
+    s->mutex_groups = 0;        // по числу ядер; MUTEX_GROUPS остаётся значением кэшей вне движка
+    s->sched_hot_sets = 0;
+    copy_str(s->swap_img_path, sizeof(s->swap_img_path), SWAP_IMG_PATH);
+    copy_str(s->swap_log_path, sizeof(s->swap_log_path), SWAP_LOG_PATH);
+    copy_str(s->swap_dict_path, sizeof(s->swap_dict_path), SWAP_DICT_PATH);
+    copy_str(s->warm_path, sizeof(s->warm_path), SWAP_WARM_PATH);
+    copy_str(s->cpus, sizeof(s->cpus), CORE_CPUS);
+    copy_str(s->transform, sizeof(s->transform), CORE_TRANSFORM);
+    s->transform_passes = 1;
+    copy_str(s->workload, sizeof(s->workload), CORE_WORKLOAD);
+    copy_str(s->trace_record, sizeof(s->trace_record), CORE_TRACE_RECORD);
+    s->pipeline = 0;
+    s->compress_workers = 2;
+    s->write_threads = 1;
+    s->load_mode = LOADCTL_NO_THROTTLE;
+    s->cpu_budget = 1.0;
+    s->load_threshold = 50;
+    s->stats_windows = 0;
+    s->fail_delay_ms = 0;
+    copy_str(s->metrics_shm, sizeof(s->metrics_shm), METRICS_SHM_NAME);
+    s->direct_io = DIRECT_IO;
+}
+
+const char *settings_path(void) {
+    const char *p = getenv(SETTINGS_ENV);
+    return p && *p ? p : SETTINGS_FILE;
+}
+
+static char *trim(char *p) {
+    while (isspace((unsigned char)*p)) p++;
+    char *end = p + strlen(p);
+    while (end > p && isspace((unsigned char)end[-1])) *--end = '\0';
+    return p;
+}
+
+static int set_key(settings_t *s, const settings_key_t *k, const char *val, const char *path, int line) {
+    char *field = (char *)s + k->off;
+    char *end;
+    int is_auto = strcasecmp(val, "auto") == 0;
+    errno = 0;
+    switch (k->type) {
+    case KEY_INT: {
+        long v = is_auto ? 0 : strtol(val, &end, 0);
+        if (!is_auto && (end == val || *end || errno || v < 0 || v > 1 << 30)) break;
+        *(int *)field = (int)v;
+        return 0;
+    }
+    case KEY_SIZE: {
+        unsigned long long v = is_auto ? 0 : strtoull(val, &end, 0);
+        if (!is_auto && (end == val || *end || errno || val[0] == '-')) break;
+        *(size_t *)field = (size_t)v;
+        return 0;
+    }
+    case KEY_DOUBLE: {
+        double v = strtod(val, &end);
+        if (end == val || *end || v < 0.0) break;
+        *(double *)field = v;
+        return 0;
+    }
+    case KEY_STR:
+        if (strlen(val) >= k->len) break;
+        strcpy(field, val);
+        return 0;
+    case KEY_LOADCTL:
+        for (int m = LOADCTL_NO_THROTTLE; m <= LOADCTL_BACKGROUND; m++) {
+            if (strcasecmp(val, loadctl_mode_name((loadctl_mode_t)m)) == 0) {
+                *(loadctl_mode_t *)field = (loadctl_mode_t)m;
+                return 0;
+            }
+        }
+        break;
+    }
+    fprintf(stderr, "%s:%d: invalid value \"%s\" for %s\n", path, line, val, k->name);
+    return -1;
+}
+
+// One KEY=VALUE line, shell syntax: comments after #, optional quotes around the value
+static int parse_line(char *line, char **key, char **val) {
+    char *hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+    char *p = trim(line);
+    if (!*p) return 0;
+    if (strncmp(p, "export ", 7) == 0) p = trim(p + 7);
+    char *eq = strchr(p, '=');
+    if (!eq) return -1;
+    *eq = '\0';
+    *key = trim(p);
+    char *v = trim(eq + 1);
+    size_t n = strlen(v);
+    if (n >= 2 && (v[0] == '"' || v[0] == '\'') && v[n - 1] == v[0]) {
+        v[n - 1] = '\0';
+        v++;
+    }
+    *val = v;
+    return 1;
+}
+
+static const settings_key_t *find_key(const char *name) {
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (strcmp(keys[i].name, name) == 0) return &keys[i];
+    }
+    return NULL;
+}
+
+int settings_load(settings_t *s, const char *path, const char *prefix) {
+    if (!path) path = settings_path();
+    size_t plen = prefix ? strlen(prefix) : 0;
+    int rc = 0;
+    FILE *f = fopen(path, "r");
+    if (f) {
+        // Two passes: common keys first, so that prefixed ones win wherever they appear
+        for (int pass = 0; pass < (plen ? 2 : 1); pass++) {
+            char buf[1024];
+            int line = 0;
+            rewind(f);
+            while (fgets(buf, sizeof(buf), f)) {
+                char *key, *val;
+                line++;
+                int r = parse_line(buf, &key, &val);
+                if (r == 0) continue;
+                if (r < 0) {
+                    if (pass == 0) fprintf(stderr, "%s:%d: expected KEY=VALUE\n", path, line);
+                    rc = -1;
+                    continue;
+                }
+                int prefixed = plen && strncmp(key, prefix, plen) == 0;
+                if (prefixed != pass) continue;
+                const char *name = key + (prefixed ? plen : 0);
+                if (strcmp(name, "BLOCK_SIZE") == 0) {
+                    // Fixed at build time: PAGE_SIZE sizes structures and on-disk records
+                    if (strtol(val, NULL, 0) != BLOCK_SIZE) {
+                        fprintf(stderr, "%s:%d: BLOCK_SIZE %s ignored, built for %d\n", path, line, val, BLOCK_SIZE);
+                    }
+                    continue;
+                }
+                const settings_key_t *k = find_key(name);
+                if (!k) {
+                    // Another front-end's key (OTHER_CORES=...) is not ours to check
+                    const char *us = strchr(name, '_');
+                    if (prefixed || !us || !find_key(us + 1)) {
+                        fprintf(stderr, "%s:%d: unknown setting %s\n", path, line, key);
+                    }
+                    continue;
+                }
+                if (set_key(s, k, val, path, line) != 0) rc = -1;
+            }
+        }
+        fclose(f);
+    } else {
+        rc = 1;
+    }
+    // The environment still wins for the workload, as before the file existed
+    const char *env = getenv(WORKLOAD_ENV);
+    if (env && *env) copy_str(s->workload, sizeof(s->workload), env);
+    env = getenv(WORKLOAD_TRACE_ENV);
+    if (env && *env) copy_str(s->trace_record, sizeof(s->trace_record), env);
+    return rc;
+}
+
+// MemAvailable from /proc/meminfo, else free physical pages; bytes, 0 if unknown
+static uint64_t available_memory(void) {
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (f) {
+        char line[128];
+        unsigned long long kb;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) {
+                fclose(f);
+                return (uint64_t)kb * 1024;
+            }
+        }
+        fclose(f);
+    }
+    long pages = sysconf(_SC_AVPHYS_PAGES), psize = sysconf(_SC_PAGESIZE);
+    return pages > 0 && psize > 0 ? (uint64_t)pages * (uint64_t)psize : 0;
+}
+
+static size_t pow2_at_least(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+void settings_autosize(settings_t *s) {
+    if (s->cores <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        s->cores = n > 0 ? (int)n : 1;
+    }
+    // One cache shard per core
+    if (s->cores > CACHE_SHARDS_MAX) s->cores = CACHE_SHARDS_MAX;
+    if (s->segment_mb == 0) s->segment_mb = SEGMENT_MB;
+    if (s->cache_mb == 0) {
+        uint64_t avail = available_memory();
+        s->cache_mb = avail ? (size_t)(avail / (s->direct_io ? SETTINGS_CACHE_SHARE_DIRECT : SETTINGS_CACHE_SHARE) >> 20) : CACHE_MB;
+        if (s->cache_mb < 16) s->cache_mb = 16;
+    }
+    if (s->ring_mb == 0) s->ring_mb = s->cache_mb;
+    s->shard_frames = ((uint64_t)s->cache_mb << 20) / PAGE_SIZE / (size_t)s->cores;
+    if (s->max_cache_entries && s->shard_frames > s->max_cache_entries) s->shard_frames = s->max_cache_entries;
+    if (s->shard_frames == 0) s->shard_frames = 1;
+    // Index: a bucket per frame; stripes: enough that all cores rarely meet on one shard's mutex
+    if (s->hash_size == 0) s->hash_size = pow2_at_least(s->shard_frames);
+    if (s->mutex_groups == 0) {
+        s->mutex_groups = pow2_at_least((size_t)s->cores * 4);
+        if (s->mutex_groups < MUTEX_GROUPS) s->mutex_groups = MUTEX_GROUPS;
+        if (s->mutex_groups > 1024) s->mutex_groups = 1024;
+    }
+    // Hot table: about as many blocks per core as its shard holds
+    if (s->sched_hot_sets == 0) {
+        s->sched_hot_sets = pow2_at_least(s->shard_frames / SCHED_HOT_WAYS);
+        if (s->sched_hot_sets < 256) s->sched_hot_sets = 256;
+        if (s->sched_hot_sets > (1u << 20)) s->sched_hot_sets = 1u << 20;
+    }
+    if (s->compress_workers < 1) s->compress_workers = 1;
+    if (s->write_threads < 1) s->write_threads = 1;
+    if (s->transform_passes < 1) s->transform_passes = 1;
+    if (s->cpu_budget <= 0.0 || s->cpu_budget > 1.0) s->cpu_budget = 1.0;
+}
+
+void settings_describe(const settings_t *s, char *buf, size_t len) {
+    // Cache size as allocated: MAX_CACHE_ENTRIES may cap it below CACHE_MB
+    size_t cache_mb = (size_t)(((uint64_t)s->shard_frames * PAGE_SIZE * (size_t)s->cores) >> 20);
+    snprintf(buf, len, "%d cores, %zu MB segments; cache %zu MB in %d shards of %zu frames "
+             "(%zu buckets, %zu lock stripes each); ring %zu MB; %zu hot-block sets per core",
+             s->cores, s->segment_mb, cache_mb, s->cores, s->shard_frames,
+             pow2_at_least(s->hash_size), pow2_at_least(s->mutex_groups), s->ring_mb, s->sched_hot_sets);
+}
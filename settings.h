@@ -0,0 +1,72 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "load_ctl.h"
+
+// Настройки времени выполнения: значения по умолчанию из config.h, поверх них config.cfg
+// (строки KEY=VALUE, # — комментарий; тот же файл читает core_manager.sh).
+// Ключи с префиксом фронтенда (DAEMON_CORES=2) важнее общих. auto или 0 в размерах —
+// подобрать по числу CPU и доступной памяти (settings_autosize)
+
+#ifndef SETTINGS_FILE
+#define SETTINGS_FILE "./config.cfg"
+#endif
+#ifndef SETTINGS_ENV
+#define SETTINGS_ENV "PSEUDO_CORE_CONFIG"   // другой файл настроек
+#endif
+#ifndef SETTINGS_CACHE_SHARE
+#define SETTINGS_CACHE_SHARE 8              // CACHE_MB=auto: 1/8 доступной памяти (и столько же кольцу)
+#endif
+#ifndef SETTINGS_CACHE_SHARE_DIRECT
+#define SETTINGS_CACHE_SHARE_DIRECT 4       // то же с DIRECT_IO: память page cache ядра отдана кэшу
+#endif
+#define SETTINGS_PATH_MAX 256
+
+typedef struct {
+    int cores;                  // CORES
+    size_t cache_mb;            // CACHE_MB: на все шарды вместе
+    size_t ring_mb;             // RING_MB; 0 — как CACHE_MB
+    size_t segment_mb;          // SEGMENT_MB: сегмент образа на ядро
+    size_t max_cache_entries;   // MAX_CACHE_ENTRIES: кадров на шард не больше; 0 — без предела
+    size_t hash_size;           // HASH_SIZE: бакетов индекса на шард
+    size_t mutex_groups;        // MUTEX_GROUPS: полос блокировок на шард
+    size_t sched_hot_sets;      // SCHED_HOT_SETS: наборов таблицы горячих блоков на ядро
+    char swap_img_path[SETTINGS_PATH_MAX];  // SWAP_IMG_PATH
+    char swap_log_path[SETTINGS_PATH_MAX];  // SWAP_LOG_PATH
+    char swap_dict_path[SETTINGS_PATH_MAX]; // SWAP_DICT_PATH
+    char warm_path[SETTINGS_PATH_MAX];      // WARM_SNAPSHOT: снимок тёплого кэша; пусто — без снимка
+    char cpus[SETTINGS_PATH_MAX];           // CORE_CPUS
+    char transform[32];                     // CORE_TRANSFORM
+    int transform_passes;                   // TRANSFORM_PASSES
+    char workload[SETTINGS_PATH_MAX * 2];   // WORKLOAD (или WORKLOAD_ENV)
+    char trace_record[SETTINGS_PATH_MAX];   // TRACE_RECORD (или WORKLOAD_TRACE_ENV)
+    int pipeline;                           // PIPELINE: 1 — сжатие и запись в конвейере
+    int compress_workers;                   // COMPRESS_WORKERS
+    int write_threads;                      // WRITE_THREADS
+    loadctl_mode_t load_mode;               // LOADCTL_MODE: no-throttle, latency, background
+    double cpu_budget;                      // CPU_BUDGET: доля CPU ядра в режиме background
+    int load_threshold;                     // LOAD_THRESHOLD: очередь работы ядра (дек и конвейер), выше которой окно перегружено, а сегмент сокращается
+    int stats_windows;                      // STATS_WINDOWS: окон регулятора между выводами; 0 — только в конце
+    int fail_delay_ms;                      // FAIL_DELAY_MS: пауза ядра после ошибки получения страницы
+    int direct_io;                          // DIRECT_IO: 1 — O_DIRECT для образа и журнала
+    char metrics_shm[64];                   // METRICS_SHM: сегмент гистограмм задержек; пусто — только в процессе
+    size_t shard_frames;                    // итог settings_autosize: кадров на шард
+} settings_t;
+
+// Значения по умолчанию из config.h
+void settings_defaults(settings_t *s);
+// Читает файл (NULL — SETTINGS_ENV или SETTINGS_FILE) поверх s; prefix — ключи фронтенда
+// ("DAEMON_") или NULL. 0, 1 — файла нет (остаются прежние значения), -1 — ошибка в значении
+int settings_load(settings_t *s, const char *path, const char *prefix);
+// Подбирает нулевые размеры по числу CPU и доступной памяти и считает shard_frames
+void settings_autosize(settings_t *s);
+// Путь к файлу, который читает settings_load(s, NULL, ...)
+const char *settings_path(void);
+// Строка для журнала запуска: итоговые размеры
+void settings_describe(const settings_t *s, char *buf, size_t len);
+
+#endif // SETTINGS_H
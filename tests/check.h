@@ -0,0 +1,72 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+
+// Проверки make check: CHECK считает провалы и продолжает, итог — check_done() в main.
+// Файлы тестов создаются в каталоге check_dir() (mkdtemp в $TMPDIR или /tmp) и удаляются
+
+static int check_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        check_failures++; \
+    } \
+} while (0)
+
+static char check_path_buf[256];
+
+static inline const char *check_dir(void) {
+    if (!check_path_buf[0]) {
+        const char *tmp = getenv("TMPDIR");
+        snprintf(check_path_buf, sizeof(check_path_buf), "%s/pseudocore-check-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+        if (!mkdtemp(check_path_buf)) {
+            perror("mkdtemp");
+            exit(2);
+        }
+    }
+    return check_path_buf;
+}
+
+// Путь name в каталоге теста, в буфер out
+static inline const char *check_file(const char *name, char *out, size_t len) {
+    snprintf(out, len, "%s/%s", check_dir(), name);
+    return out;
+}
+
+// Сжимаемая страница: одна строка с key и version по кругу
+static inline void check_fill_text(char *page, uint64_t key, int version) {
+    char line[64];
+    int n = snprintf(line, sizeof(line), "key %lu version %d; ", key, version);
+    for (size_t i = 0; i < BLOCK_SIZE; i++) page[i] = line[i % (size_t)n];
+}
+
+// Несжимаемая страница: байты xorshift от seed
+static inline void check_fill_random(char *page, uint64_t seed) {
+    uint64_t x = seed * 0x9e3779b97f4a7c15ull + 1;
+    for (size_t i = 0; i < BLOCK_SIZE; i += 8) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        memcpy(page + i, &x, 8);
+    }
+}
+
+static inline int check_done(const char *suite) {
+    if (check_path_buf[0]) rmdir(check_path_buf);
+    if (check_failures) {
+        fprintf(stderr, "%s: %d checks failed\n", suite, check_failures);
+        return 1;
+    }
+    printf("%s: ok\n", suite);
+    return 0;
+}
+
+#endif // TESTS_CHECK_H
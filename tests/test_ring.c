@@ -0,0 +1,88 @@
+// Victim ring as a compressed tier: insert and look up, replace and invalidate,
+// bypass of incompressible pages, entries overwritten once the ring laps and
+// producers inserting in parallel
+#include <stdint.h>
+#include <pthread.h>
+
+#include "check.h"
+#include "config.h"
+#include "ring_cache.h"
+
+#define RING_BYTES (4 * RING_RESERVE_CHUNKS * RING_CHUNK) // smallest ring ring_cache_init accepts
+
+#define PRODUCERS 4
+#define PRODUCER_PAGES 4096
+
+// Each producer its own range of offsets, several laps of the ring together
+static void *produce(void *arg) {
+    uint64_t base = (uint64_t)(uintptr_t)arg * PRODUCER_PAGES;
+    char page[BLOCK_SIZE];
+    for (uint64_t k = 0; k < PRODUCER_PAGES; k++) {
+        check_fill_text(page, (base + k) * BLOCK_SIZE, 4);
+        cache_to_ring((base + k) * BLOCK_SIZE, page);
+    }
+    return NULL;
+}
+
+int main(void) {
+    char page[BLOCK_SIZE], out[BLOCK_SIZE];
+    ring_cache_stats_t st;
+    ring_cache_init(RING_BYTES);
+    ring_cache_stats(&st);
+    CHECK(st.size == RING_BYTES);
+
+    check_fill_text(page, 0, 1);
+    cache_to_ring(0, page);
+    CHECK(ring_cache_lookup(0, out) == 1 && memcmp(out, page, BLOCK_SIZE) == 0);
+    CHECK(ring_cache_lookup(BLOCK_SIZE, out) == 0);
+
+    // A new copy replaces the old one
+    check_fill_text(page, 0, 2);
+    cache_to_ring(0, page);
+    CHECK(ring_cache_lookup(0, out) == 1 && memcmp(out, page, BLOCK_SIZE) == 0);
+    ring_cache_stats(&st);
+    CHECK(st.inserts == 2 && st.updates == 1);
+    CHECK(st.bytes_inserted < BLOCK_SIZE);      // stored compressed, both copies in less than a page
+
+    ring_cache_invalidate(0);
+    CHECK(ring_cache_lookup(0, out) == 0);
+
+    // Incompressible pages do not get in, and drop an older copy
+    check_fill_text(page, BLOCK_SIZE, 1);
+    cache_to_ring(BLOCK_SIZE, page);
+    check_fill_random(page, 1);
+    cache_to_ring(BLOCK_SIZE, page);
+    CHECK(ring_cache_lookup(BLOCK_SIZE, out) == 0);
+    ring_cache_stats(&st);
+    CHECK(st.bypassed == 1);
+
+    // Many laps, more pages than the index has ways: stale entries get reused, the newest still read back
+    uint64_t pages = 16384;
+    for (uint64_t k = 0; k < pages; k++) {
+        check_fill_text(page, k * BLOCK_SIZE, 3);
+        cache_to_ring(k * BLOCK_SIZE, page);
+    }
+    ring_cache_stats(&st);
+    CHECK(st.overwritten > 0);
+    CHECK(st.live_bytes <= st.size);
+    CHECK(ring_cache_lookup(0, out) == 0);
+    uint64_t last = (pages - 1) * BLOCK_SIZE;
+    check_fill_text(page, last, 3);
+    CHECK(ring_cache_lookup(last, out) == 1 && memcmp(out, page, BLOCK_SIZE) == 0);
+
+    // Parallel producers: whatever is still found reads back as its own page, never a torn or foreign one
+    pthread_t th[PRODUCERS];
+    for (uintptr_t t = 0; t < PRODUCERS; t++) CHECK(pthread_create(&th[t], NULL, produce, (void *)t) == 0);
+    for (int t = 0; t < PRODUCERS; t++) pthread_join(th[t], NULL);
+    uint64_t found = 0;
+    for (uint64_t k = 0; k < (uint64_t)PRODUCERS * PRODUCER_PAGES; k++) {
+        if (!ring_cache_lookup(k * BLOCK_SIZE, out)) continue;
+        check_fill_text(page, k * BLOCK_SIZE, 4);
+        CHECK(memcmp(out, page, BLOCK_SIZE) == 0);
+        found++;
+    }
+    CHECK(found > 0);
+
+    ring_cache_destroy();
+    return check_done("ring");
+}
@@ -0,0 +1,109 @@
+// Warm snapshot: pages resident at save time and the hot blocks' scores come back on load;
+// a missing snapshot or one from another geometry is not used
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "check.h"
+#include "config.h"
+#include "cache.h"
+#include "scheduler.h"
+#include "warm.h"
+#include "io_backend.h"
+
+#define NCORES 2
+#define SEG_BLOCKS 64
+#define SEG_BYTES ((uint64_t)SEG_BLOCKS * BLOCK_SIZE)
+#define FRAMES 32
+#define HOT_OFFSET (3 * BLOCK_SIZE)
+
+static int offs_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Resident offsets of every shard, sorted
+static size_t resident(cache_shared_t *sc, uint64_t *offs) {
+    size_t n = 0;
+    for (int i = 0; i < sc->nshards; i++) n += cache_resident_offsets(&sc->shard[i], offs + n, FRAMES);
+    qsort(offs, n, sizeof(*offs), offs_cmp);
+    return n;
+}
+
+static void open_cache(cache_shared_t *sc) {
+    cache_geometry_t geo = { .frames = FRAMES };
+    if (cache_shared_init_geometry(sc, NCORES, SEG_BYTES, CACHE_POLICY_2Q, &geo) != 0 || scheduler_init(NCORES, 0) != 0) {
+        fprintf(stderr, "cache or scheduler init failed\n");
+        exit(1);
+    }
+}
+
+int main(void) {
+    char image_path[512], warm_path[512];
+    check_file("image.img", image_path, sizeof(image_path));
+    check_file("image.warm", warm_path, sizeof(warm_path));
+    io_backend_init(IO_BACKEND_SYNC);
+    int fd = open(image_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("image");
+        return 1;
+    }
+    char page[BLOCK_SIZE];
+    for (uint64_t b = 0; b < NCORES * SEG_BLOCKS; b++) {
+        memset(page, (int)(b & 0xff), BLOCK_SIZE);
+        CHECK(pwrite(fd, page, BLOCK_SIZE, (off_t)(b * BLOCK_SIZE)) == BLOCK_SIZE);
+    }
+
+    cache_shared_t sc;
+    warm_stats_t ws;
+    open_cache(&sc);
+    CHECK(warm_load(warm_path, &sc, fd, NCORES, SEG_BYTES, &ws) == 1); // no snapshot yet
+
+    // A few pages of each segment, one of them hot on core 0
+    for (uint64_t b = 0; b < NCORES * SEG_BLOCKS; b += 5) {
+        cache_t *c = cache_shard(&sc, b * BLOCK_SIZE);
+        char *p = cache_pin(c, fd, b * BLOCK_SIZE, 0);
+        CHECK(p && (unsigned char)p[0] == (b & 0xff));
+        if (p) cache_unpin(c, p);
+    }
+    for (int k = 0; k < 8; k++) scheduler_report_access(0, HOT_OFFSET);
+    uint64_t before[NCORES * FRAMES], after[NCORES * FRAMES];
+    size_t n_before = resident(&sc, before);
+    CHECK(n_before > 0);
+    long saved = warm_save(warm_path, &sc, NCORES, SEG_BYTES);
+    CHECK(saved >= (long)n_before);
+    cache_shared_destroy(&sc, fd);
+    scheduler_destroy();
+
+    open_cache(&sc);
+    CHECK(warm_load(warm_path, &sc, fd, NCORES, SEG_BYTES, &ws) == 0);
+    CHECK(ws.entries == (uint64_t)saved);
+    size_t n_after = resident(&sc, after);
+    CHECK(n_after >= n_before);
+    // Every page resident at save time is back (the hot block joins them)
+    size_t j = 0;
+    for (size_t i = 0; i < n_before; i++) {
+        while (j < n_after && after[j] < before[i]) j++;
+        CHECK(j < n_after && after[j] == before[i]);
+    }
+    uint64_t blocks[FRAMES];
+    float scores[FRAMES];
+    size_t hot = scheduler_hot_snapshot(0, blocks, scores, FRAMES);
+    int found = 0;
+    for (size_t i = 0; i < hot; i++) found |= blocks[i] == HOT_OFFSET && scores[i] > 1.0f;
+    CHECK(found);
+    cache_shared_destroy(&sc, fd);
+    scheduler_destroy();
+
+    // Another segment layout: the offsets would land in the wrong shards
+    open_cache(&sc);
+    errno = 0;
+    CHECK(warm_load(warm_path, &sc, fd, NCORES, SEG_BYTES * 2, &ws) == -1 && errno == EPROTO);
+    cache_shared_destroy(&sc, fd);
+    scheduler_destroy();
+
+    close(fd);
+    unlink(warm_path);
+    unlink(image_path);
+    return check_done("warm");
+}
@@ -0,0 +1,205 @@
+// Преобразования страниц с выбором векторной реализации при запуске
+#include "transform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define TRANSFORM_ARM 1
+#include <arm_neon.h>
+#endif
+
+typedef struct {
+    transform_desc_t desc;
+    transform_fn_t fn;          // dispatched implementation
+    transform_isa_t isa;
+} transform_slot_t;
+
+static transform_slot_t transforms[TRANSFORM_MAX];
+static int transform_count;
+static transform_isa_t cpu_isa = TRANSFORM_ISA_SCALAR;
+
+static const char *const isa_names[TRANSFORM_ISAS] = { "scalar", "sse2", "avx2", "avx512", "neon" };
+
+const char *transform_isa_name(transform_isa_t isa) {
+    return isa >= 0 && isa < TRANSFORM_ISAS ? isa_names[isa] : "unknown";
+}
+
+transform_isa_t transform_isa(void) {
+    return cpu_isa;
+}
+
+// XOR page[from, len) with k (the key byte in every lane): 64-bit words, then the odd bytes;
+// the vector kernels finish their last partial 64-byte step here
+static void xor_tail(char *page, size_t from, size_t len, uint64_t k) {
+    size_t i = from;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, page + i, 8);
+        w ^= k;
+        memcpy(page + i, &w, 8);
+    }
+    for (; i < len; i++) page[i] ^= (char)k;
+}
+
+// XOR every byte with the low byte of key, passes times: the reference workload of core_run
+static void xor_scalar(char *page, size_t len, uint64_t key, int passes, void *ctx) {
+    (void)ctx;
+    uint64_t k = (key & 0xff) * 0x0101010101010101ull;
+    for (int p = 0; p < passes; p++) xor_tail(page, 0, len, k);
+}
+
+// Unaligned loads and stores: as fast as aligned ones on aligned data (cache frames always are),
+// and any buffer a custom caller passes stays valid
+#ifdef TRANSFORM_X86
+__attribute__((target("sse2")))
+static void xor_sse2(char *page, size_t len, uint64_t key, int passes, void *ctx) {
+    (void)ctx;
+    __m128i k = _mm_set1_epi8((char)key);
+    for (int p = 0; p < passes; p++) {
+        size_t i = 0;
+        for (; i + 64 <= len; i += 64) {
+            __m128i *v = (__m128i *)(page + i);
+            _mm_storeu_si128(v + 0, _mm_xor_si128(_mm_loadu_si128(v + 0), k));
+            _mm_storeu_si128(v + 1, _mm_xor_si128(_mm_loadu_si128(v + 1), k));
+            _mm_storeu_si128(v + 2, _mm_xor_si128(_mm_loadu_si128(v + 2), k));
+            _mm_storeu_si128(v + 3, _mm_xor_si128(_mm_loadu_si128(v + 3), k));
+        }
+        xor_tail(page, i, len, (key & 0xff) * 0x0101010101010101ull);
+    }
+}
+
+__attribute__((target("avx2")))
+static void xor_avx2(char *page, size_t len, uint64_t key, int passes, void *ctx) {
+    (void)ctx;
+    __m256i k = _mm256_set1_epi8((char)key);
+    for (int p = 0; p < passes; p++) {
+        size_t i = 0;
+        for (; i + 64 <= len; i += 64) {
+            __m256i *v = (__m256i *)(page + i);
+            _mm256_storeu_si256(v + 0, _mm256_xor_si256(_mm256_loadu_si256(v + 0), k));
+            _mm256_storeu_si256(v + 1, _mm256_xor_si256(_mm256_loadu_si256(v + 1), k));
+        }
+        xor_tail(page, i, len, (key & 0xff) * 0x0101010101010101ull);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void xor_avx512(char *page, size_t len, uint64_t key, int passes, void *ctx) {
+    (void)ctx;
+    __m512i k = _mm512_set1_epi8((char)key);
+    for (int p = 0; p < passes; p++) {
+        size_t i = 0;
+        for (; i + 64 <= len; i += 64) {
+            void *v = page + i;
+            _mm512_storeu_si512(v, _mm512_xor_si512(_mm512_loadu_si512(v), k));
+        }
+        xor_tail(page, i, len, (key & 0xff) * 0x0101010101010101ull);
+    }
+}
+#endif
+
+#ifdef TRANSFORM_ARM
+static void xor_neon(char *page, size_t len, uint64_t key, int passes, void *ctx) {
+    (void)ctx;
+    uint8x16_t k = vdupq_n_u8((uint8_t)key);
+    for (int p = 0; p < passes; p++) {
+        size_t i = 0;
+        for (; i + 64 <= len; i += 64) {
+            uint8_t *v = (uint8_t *)page + i;
+            vst1q_u8(v + 0, veorq_u8(vld1q_u8(v + 0), k));
+            vst1q_u8(v + 16, veorq_u8(vld1q_u8(v + 16), k));
+            vst1q_u8(v + 32, veorq_u8(vld1q_u8(v + 32), k));
+            vst1q_u8(v + 48, veorq_u8(vld1q_u8(v + 48), k));
+        }
+        xor_tail(page, i, len, (key & 0xff) * 0x0101010101010101ull);
+    }
+}
+#endif
+
+// Widest instruction set the CPU and the OS both support
+static transform_isa_t detect_isa(void) {
+#ifdef TRANSFORM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return TRANSFORM_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2")) return TRANSFORM_ISA_AVX2;
+    if (__builtin_cpu_supports("sse2")) return TRANSFORM_ISA_SSE2;
+#elif defined(TRANSFORM_ARM)
+    return TRANSFORM_ISA_NEON; // Advanced SIMD is mandatory on AArch64 and implied by __ARM_NEON
+#endif
+    return TRANSFORM_ISA_SCALAR;
+}
+
+// Best implementation not above the detected set; NEON and the x86 sets never mix
+static transform_isa_t pick_impl(const transform_desc_t *d) {
+    if (cpu_isa == TRANSFORM_ISA_NEON) {
+        return d->impl[TRANSFORM_ISA_NEON] ? TRANSFORM_ISA_NEON : TRANSFORM_ISA_SCALAR;
+    }
+    for (int isa = cpu_isa; isa > TRANSFORM_ISA_SCALAR; isa--) {
+        if (d->impl[isa]) return (transform_isa_t)isa;
+    }
+    return TRANSFORM_ISA_SCALAR;
+}
+
+int transform_register(const transform_desc_t *desc) {
+    if (!desc->name || !desc->impl[TRANSFORM_ISA_SCALAR]) return -1;
+    if (transform_find(desc->name) >= 0 || transform_count >= TRANSFORM_MAX) return -1;
+    transform_slot_t *t = &transforms[transform_count];
+    t->desc = *desc;
+    t->isa = pick_impl(desc);
+    t->fn = desc->impl[t->isa];
+    return transform_count++;
+}
+
+int transform_find(const char *name) {
+    for (int i = 0; i < transform_count; i++) {
+        if (strcmp(transforms[i].desc.name, name) == 0) return i;
+    }
+    return -1;
+}
+
+const char *transform_name(int id) {
+    return transforms[id].desc.name;
+}
+
+transform_isa_t transform_kernel_isa(int id) {
+    return transforms[id].isa;
+}
+
+void transform_apply(int id, char *page, size_t len, uint64_t key, int passes) {
+    const transform_slot_t *t = &transforms[id];
+    t->fn(page, len, key, passes, t->desc.ctx);
+}
+
+int transform_init(void) {
+    cpu_isa = detect_isa();
+    // The environment can only lower the choice, e.g. to compare kernels on one machine
+    const char *cap = getenv(TRANSFORM_ISA_ENV);
+    if (cap && *cap) {
+        int isa = 0;
+        while (isa < TRANSFORM_ISAS && strcmp(isa_names[isa], cap) != 0) isa++;
+        if (isa == TRANSFORM_ISAS) {
+            fprintf(stderr, "Unknown instruction set \"%s\" in %s, using %s\n", cap, TRANSFORM_ISA_ENV, isa_names[cpu_isa]);
+        } else if (isa == TRANSFORM_ISA_SCALAR ||
+                   (isa <= (int)cpu_isa && (isa == TRANSFORM_ISA_NEON) == (cpu_isa == TRANSFORM_ISA_NEON))) {
+            cpu_isa = (transform_isa_t)isa;
+        } else {
+            fprintf(stderr, "Instruction set %s not supported here, using %s\n", cap, isa_names[cpu_isa]);
+        }
+    }
+    if (transform_find("xor") >= 0) return 0;
+    transform_desc_t xor_desc = { .name = "xor" };
+    xor_desc.impl[TRANSFORM_ISA_SCALAR] = xor_scalar;
+#ifdef TRANSFORM_X86
+    xor_desc.impl[TRANSFORM_ISA_SSE2] = xor_sse2;
+    xor_desc.impl[TRANSFORM_ISA_AVX2] = xor_avx2;
+    xor_desc.impl[TRANSFORM_ISA_AVX512] = xor_avx512;
+#endif
+#ifdef TRANSFORM_ARM
+    xor_desc.impl[TRANSFORM_ISA_NEON] = xor_neon;
+#endif
+    return transform_register(&xor_desc) < 0 ? -1 : 0;
+}
@@ -0,0 +1,48 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Преобразования страницы (нагрузка ядра): у каждого — реализации под наборы векторных
+// инструкций, при регистрации выбирается лучшая из доступных на этом CPU
+
+typedef enum {
+    TRANSFORM_ISA_SCALAR = 0,   // машинные слова по 64 бита
+    TRANSFORM_ISA_SSE2,
+    TRANSFORM_ISA_AVX2,
+    TRANSFORM_ISA_AVX512,
+    TRANSFORM_ISA_NEON,
+    TRANSFORM_ISAS
+} transform_isa_t;
+
+#ifndef TRANSFORM_MAX
+#define TRANSFORM_MAX 16            // зарегистрированных преобразований
+#endif
+#define TRANSFORM_ISA_ENV "PSEUDO_CORE_ISA" // ограничивает набор инструкций: scalar, sse2, avx2, avx512, neon
+
+// page и len любые (встроенные ядра читают невыровненно и дочищают хвост скалярно);
+// key и ctx задаёт вызывающий, passes — число проходов
+typedef void (*transform_fn_t)(char *page, size_t len, uint64_t key, int passes, void *ctx);
+
+typedef struct {
+    const char *name;
+    transform_fn_t impl[TRANSFORM_ISAS]; // NULL — нет версии; скалярная обязательна
+    void *ctx;
+} transform_desc_t;
+
+// Определяет набор инструкций (с учётом TRANSFORM_ISA_ENV) и регистрирует встроенные
+// преобразования ("xor"); вызывать до запуска потоков
+int transform_init(void);
+transform_isa_t transform_isa(void);
+const char *transform_isa_name(transform_isa_t isa);
+// Регистрирует преобразование после transform_init, до запуска потоков; возвращает id или -1
+int transform_register(const transform_desc_t *desc);
+// id по имени или -1
+int transform_find(const char *name);
+const char *transform_name(int id);
+// Набор инструкций, выбранный для преобразования id
+transform_isa_t transform_kernel_isa(int id);
+void transform_apply(int id, char *page, size_t len, uint64_t key, int passes);
+
+#endif // TRANSFORM_H
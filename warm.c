@@ -0,0 +1,256 @@
+// Снимок тёплого кэша: запись при остановке и прогрев при запуске
+#include "warm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "scheduler.h"
+#include "io_backend.h"
+
+#define WARM_PAGE(r) ((r) >> WARM_FREQ_BITS)
+#define WARM_FREQ(r) ((unsigned)((r) & WARM_FREQ_MAX))
+
+// One shard's share of the snapshot, loaded by its own thread
+typedef struct {
+    cache_t *c;
+    int fd;
+    uint64_t *offs;             // repeat pages first, then pages seen once; each part by offset
+    size_t n;
+    size_t repeat;              // leading pages admitted straight to Am
+    uint64_t loaded;
+    pthread_t thread;
+} warm_job_t;
+
+static uint64_t warm_record(uint64_t off, unsigned freq) {
+    if (freq < 1) freq = 1;
+    if (freq > WARM_FREQ_MAX) freq = WARM_FREQ_MAX;
+    return (off / BLOCK_SIZE) << WARM_FREQ_BITS | freq;
+}
+
+static int u64_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Most frequent first; ties by offset so the cut is deterministic
+static int freq_desc_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    if (WARM_FREQ(x) != WARM_FREQ(y)) return WARM_FREQ(x) < WARM_FREQ(y) ? 1 : -1;
+    return u64_cmp(a, b);
+}
+
+static double elapsed_ms(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (double)(t1.tv_sec - t0->tv_sec) * 1e3 + (double)(t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+long warm_save(const char *path, cache_shared_t *sc, int cores, uint64_t seg_bytes) {
+    size_t max = 0, total = 0;
+    for (int i = 0; i < sc->nshards; i++) {
+        total += sc->shard[i].capacity;
+        if (sc->shard[i].capacity > max) max = sc->shard[i].capacity;
+    }
+    total += (size_t)cores * max;
+    uint64_t *recs = malloc(total * sizeof(*recs));
+    uint64_t *offs = malloc(max * sizeof(*offs));
+    float *scores = malloc(max * sizeof(*scores));
+    if (!recs || !offs || !scores) {
+        free(recs);
+        free(offs);
+        free(scores);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // Resident pages count once; the hot tables add their decayed access counts
+    size_t n = 0;
+    for (int i = 0; i < sc->nshards; i++) {
+        size_t got = cache_resident_offsets(&sc->shard[i], offs, max);
+        for (size_t k = 0; k < got; k++) recs[n++] = warm_record(offs[k], 1);
+    }
+    for (int i = 0; i < cores; i++) {
+        size_t got = scheduler_hot_snapshot(i, offs, scores, max);
+        for (size_t k = 0; k < got; k++) recs[n++] = warm_record(offs[k], (unsigned)lroundf(scores[k]));
+    }
+    free(offs);
+    free(scores);
+
+    // Sorted by page, then frequency: the last record of each page carries its highest count
+    qsort(recs, n, sizeof(*recs), u64_cmp);
+    size_t m = 0;
+    for (size_t k = 0; k < n; k++) {
+        if (m > 0 && WARM_PAGE(recs[m - 1]) == WARM_PAGE(recs[k])) {
+            recs[m - 1] = recs[k];
+        } else {
+            recs[m++] = recs[k];
+        }
+    }
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        free(recs);
+        return -1;
+    }
+    warm_header_t h = {
+        .magic = WARM_MAGIC, .version = WARM_VERSION, .block_size = BLOCK_SIZE,
+        .cores = (uint32_t)cores, .seg_bytes = seg_bytes, .count = m,
+    };
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(recs, sizeof(*recs), m, f) == m;
+    free(recs);
+    ok = fflush(f) == 0 && ok;
+    ok = fsync(fileno(f)) == 0 && ok;
+    int saved = errno;
+    if (fclose(f) != 0) ok = 0;
+    // The previous snapshot stays until the new one is complete
+    if (!ok || rename(tmp, path) != 0) {
+        if (ok) saved = errno;
+        unlink(tmp);
+        errno = saved;
+        return -1;
+    }
+    return (long)m;
+}
+
+static void *warm_run(void *v) {
+    warm_job_t *j = v;
+    io_thread_init();
+    j->loaded += (uint64_t)cache_warm_batch(j->c, j->fd, j->offs, (int)j->repeat, 1);
+    j->loaded += (uint64_t)cache_warm_batch(j->c, j->fd, j->offs + j->repeat, (int)(j->n - j->repeat), 0);
+    io_thread_destroy();
+    return NULL;
+}
+
+// Reads and validates the snapshot; NULL with errno (ENOENT: no snapshot)
+static uint64_t *warm_read(const char *path, int cores, uint64_t seg_bytes, uint64_t *count) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    warm_header_t h;
+    struct stat st;
+    uint64_t *recs = NULL;
+    if (fread(&h, sizeof(h), 1, f) != 1 || fstat(fileno(f), &st) != 0 ||
+        h.magic != WARM_MAGIC || h.version != WARM_VERSION ||
+        (uint64_t)st.st_size != sizeof(h) + h.count * sizeof(*recs)) {
+        errno = EPROTO;
+        goto out;
+    }
+    // Offsets mean nothing under another page size or segment layout
+    if (h.block_size != BLOCK_SIZE || h.cores != (uint32_t)cores || h.seg_bytes != seg_bytes) {
+        errno = EPROTO;
+        goto out;
+    }
+    recs = malloc((h.count ? h.count : 1) * sizeof(*recs));
+    if (!recs) goto out;
+    if (fread(recs, sizeof(*recs), h.count, f) != h.count) {
+        free(recs);
+        recs = NULL;
+        errno = EIO;
+        goto out;
+    }
+    *count = h.count;
+out:
+    fclose(f);
+    return recs;
+}
+
+int warm_load(const char *path, cache_shared_t *sc, int fd, int cores, uint64_t seg_bytes, warm_stats_t *st) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    memset(st, 0, sizeof(*st));
+    uint64_t count = 0;
+    uint64_t *recs = warm_read(path, cores, seg_bytes, &count);
+    if (!recs) return errno == ENOENT ? 1 : -1;
+    st->entries = count;
+
+    // Group by shard (counting sort, records keep their page order within a shard)
+    int ns = sc->nshards;
+    uint64_t image = (uint64_t)cores * seg_bytes;
+    size_t *start = calloc((size_t)ns + 1, sizeof(*start));
+    uint64_t *by_shard = malloc((count ? count : 1) * sizeof(*by_shard));
+    warm_job_t *jobs = calloc((size_t)ns, sizeof(*jobs));
+    if (!start || !by_shard || !jobs) {
+        free(start);
+        free(by_shard);
+        free(jobs);
+        free(recs);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (uint64_t k = 0; k < count; k++) {
+        uint64_t off = WARM_PAGE(recs[k]) * BLOCK_SIZE;
+        if (off < image) start[cache_shard(sc, off) - sc->shard + 1]++;
+    }
+    for (int i = 0; i < ns; i++) start[i + 1] += start[i];
+    for (int i = 0; i < ns; i++) jobs[i].n = start[i]; // fill cursor
+    for (uint64_t k = 0; k < count; k++) {
+        uint64_t off = WARM_PAGE(recs[k]) * BLOCK_SIZE;
+        if (off < image) by_shard[jobs[cache_shard(sc, off) - sc->shard].n++] = recs[k];
+    }
+    free(recs);
+
+    for (int i = 0; i < ns; i++) {
+        warm_job_t *j = &jobs[i];
+        uint64_t *r = by_shard + start[i];
+        size_t n = start[i + 1] - start[i];
+        // More pages than frames: keep the most frequent ones
+        if (n > sc->shard[i].capacity) {
+            qsort(r, n, sizeof(*r), freq_desc_cmp);
+            n = sc->shard[i].capacity;
+        }
+        // Repeat pages ahead of the ones seen once, each part in offset order for sequential reads
+        size_t repeat = 0;
+        for (size_t k = 0; k < n; k++) {
+            if (WARM_FREQ(r[k]) > 1) {
+                uint64_t t = r[repeat];
+                r[repeat++] = r[k];
+                r[k] = t;
+            }
+        }
+        qsort(r, repeat, sizeof(*r), u64_cmp);
+        qsort(r + repeat, n - repeat, sizeof(*r), u64_cmp);
+        // The scheduler gets the old scores back before the records turn into offsets
+        if (i < cores) {
+            for (size_t k = 0; k < repeat; k++) {
+                scheduler_seed_hot(i, WARM_PAGE(r[k]) * BLOCK_SIZE, (float)WARM_FREQ(r[k]));
+            }
+        }
+        for (size_t k = 0; k < n; k++) r[k] = WARM_PAGE(r[k]) * BLOCK_SIZE;
+        j->c = &sc->shard[i];
+        j->fd = fd;
+        j->offs = r;
+        j->n = n;
+        j->repeat = repeat;
+        st->selected += n;
+    }
+
+    // One loader per shard; a shard whose thread cannot start is loaded here afterwards
+    int *started = calloc((size_t)ns, sizeof(*started));
+    for (int i = 0; i < ns; i++) {
+        if (jobs[i].n && started) started[i] = pthread_create(&jobs[i].thread, NULL, warm_run, &jobs[i]) == 0;
+    }
+    for (int i = 0; i < ns; i++) {
+        if (started && started[i]) {
+            pthread_join(jobs[i].thread, NULL);
+        } else if (jobs[i].n) {
+            warm_run(&jobs[i]);
+        }
+        st->loaded += jobs[i].loaded;
+        // Prewarm reads are not the workload's misses
+        cache_stats_reset(&sc->shard[i]);
+    }
+    free(started);
+    free(jobs);
+    free(by_shard);
+    free(start);
+    st->ms = elapsed_ms(&t0);
+    return 0;
+}
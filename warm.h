@@ -0,0 +1,45 @@
+#ifndef WARM_H
+#define WARM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cache.h"
+
+// Снимок тёплого кэша для быстрого перезапуска: при остановке движок записывает смещения
+// страниц, которые были в кэше, и горячих блоков планировщика с частотой обращений; при запуске,
+// до потоков ядер, эти страницы загружаются параллельно по шардам, пакетами по возрастанию
+// смещения, а таблицы горячих блоков получают прежние оценки.
+// Файл: заголовок warm_header_t, затем count записей по 8 байт:
+// номер страницы (смещение / BLOCK_SIZE) << 16 | частота (1..65535)
+
+#define WARM_MAGIC 0x4d5241574f435350ull    // "PSCOWARM"
+#define WARM_VERSION 1
+#define WARM_FREQ_BITS 16
+#define WARM_FREQ_MAX ((1u << WARM_FREQ_BITS) - 1)
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t block_size;        // BLOCK_SIZE сборки, записавшей снимок
+    uint32_t cores;
+    uint32_t reserved;
+    uint64_t seg_bytes;
+    uint64_t count;             // записей после заголовка
+} warm_header_t;
+
+typedef struct {
+    uint64_t entries;           // записей в снимке
+    uint64_t selected;          // из них поместилось в шарды
+    uint64_t loaded;            // загружено страниц
+    double ms;                  // время прогрева
+} warm_stats_t;
+
+// Записывает снимок кэша и таблиц горячих блоков (потоки ядер остановлены, планировщик ещё жив)
+// через временный файл и rename; число записей или -1 с errno
+long warm_save(const char *path, cache_shared_t *sc, int cores, uint64_t seg_bytes);
+// Прогревает кэш по снимку и заполняет таблицы горячих блоков; вызывать до запуска ядер.
+// 0; 1 — снимка нет; -1 — ошибка чтения или другая геометрия (errno EPROTO)
+int warm_load(const char *path, cache_shared_t *sc, int fd, int cores, uint64_t seg_bytes, warm_stats_t *st);
+
+#endif // WARM_H
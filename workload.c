@@ -0,0 +1,317 @@
+// Генераторы нагрузки ядра и трассы обращений
+#include "workload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char *const kind_names[WORKLOAD_KINDS] = { "seq", "uniform", "zipf", "hotspot", "replay" };
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// splitmix64: cheap, and every core gets its own well-mixed stream from its id
+static uint64_t next_u64(uint64_t *s) {
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static double next_unit(uint64_t *s) {
+    return (double)(next_u64(s) >> 11) * (1.0 / 9007199254740992.0); // [0, 1)
+}
+
+const char *workload_kind_name(workload_kind_t kind) {
+    return kind >= 0 && kind < WORKLOAD_KINDS ? kind_names[kind] : "unknown";
+}
+
+static int parse_fraction(const char *key, const char *val, double *out, int open_interval) {
+    char *end;
+    double v = strtod(val, &end);
+    int ok = end != val && *end == '\0' && (open_interval ? v > 0.0 && v < 1.0 : v >= 0.0 && v <= 1.0);
+    if (!ok) {
+        fprintf(stderr, "Workload: %s=%s out of range\n", key, val);
+        return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+int workload_parse(const char *spec, workload_config_t *cfg) {
+    *cfg = (workload_config_t){ .kind = WORKLOAD_SEQ, .theta = 0.99, .hot_fraction = 0.1,
+                                .hot_prob = 0.9, .write_ratio = 1.0, .speed = 1.0 };
+    char copy[WORKLOAD_PATH_MAX * 2];
+    if (!spec || !*spec) return 0;
+    if (strlen(spec) >= sizeof(copy)) {
+        fprintf(stderr, "Workload: spec too long\n");
+        return -1;
+    }
+    strcpy(copy, spec);
+    char *save = NULL;
+    char *tok = strtok_r(copy, ",", &save);
+    int kind = 0;
+    while (kind < WORKLOAD_KINDS && strcmp(kind_names[kind], tok) != 0) kind++;
+    if (kind == WORKLOAD_KINDS) {
+        fprintf(stderr, "Workload: unknown generator \"%s\"\n", tok);
+        return -1;
+    }
+    cfg->kind = (workload_kind_t)kind;
+    while ((tok = strtok_r(NULL, ",", &save))) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            fprintf(stderr, "Workload: expected key=value, got \"%s\"\n", tok);
+            return -1;
+        }
+        *eq = '\0';
+        const char *key = tok, *val = eq + 1;
+        int rc = 0;
+        if (strcmp(key, "write") == 0) {
+            rc = parse_fraction(key, val, &cfg->write_ratio, 0);
+        } else if (strcmp(key, "theta") == 0 && cfg->kind == WORKLOAD_ZIPF) {
+            rc = parse_fraction(key, val, &cfg->theta, 1); // the closed form below needs theta != 1
+        } else if (strcmp(key, "hot") == 0 && cfg->kind == WORKLOAD_HOTSPOT) {
+            rc = parse_fraction(key, val, &cfg->hot_fraction, 1);
+        } else if (strcmp(key, "prob") == 0 && cfg->kind == WORKLOAD_HOTSPOT) {
+            rc = parse_fraction(key, val, &cfg->hot_prob, 0);
+        } else if (strcmp(key, "trace") == 0 && cfg->kind == WORKLOAD_REPLAY) {
+            if (strlen(val) >= sizeof(cfg->trace)) {
+                fprintf(stderr, "Workload: trace path too long\n");
+                return -1;
+            }
+            strcpy(cfg->trace, val);
+        } else if (strcmp(key, "speed") == 0 && cfg->kind == WORKLOAD_REPLAY) {
+            char *end;
+            cfg->speed = strtod(val, &end);
+            if (end == val || *end != '\0' || cfg->speed < 0.0) {
+                fprintf(stderr, "Workload: speed=%s out of range\n", val);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "Workload: parameter \"%s\" does not apply to %s\n", key, kind_names[cfg->kind]);
+            return -1;
+        }
+        if (rc != 0) return -1;
+    }
+    if (cfg->kind == WORKLOAD_REPLAY && !cfg->trace[0]) {
+        fprintf(stderr, "Workload: replay needs trace=<path>\n");
+        return -1;
+    }
+    return 0;
+}
+
+void workload_describe(const workload_config_t *cfg, char *buf, size_t len) {
+    int n;
+    switch (cfg->kind) {
+    case WORKLOAD_ZIPF:
+        n = snprintf(buf, len, "zipf (theta %.2f)", cfg->theta);
+        break;
+    case WORKLOAD_HOTSPOT:
+        n = snprintf(buf, len, "hotspot (%.0f%% of accesses to %.0f%% of blocks)",
+                     cfg->hot_prob * 100.0, cfg->hot_fraction * 100.0);
+        break;
+    case WORKLOAD_REPLAY:
+        if (cfg->speed > 0.0) {
+            n = snprintf(buf, len, "replay of %s at %.2fx", cfg->trace, cfg->speed);
+        } else {
+            n = snprintf(buf, len, "replay of %s, unpaced", cfg->trace);
+        }
+        break;
+    default:
+        n = snprintf(buf, len, "%s", workload_kind_name(cfg->kind));
+        break;
+    }
+    // Replayed operations come from the trace
+    if (cfg->kind != WORKLOAD_REPLAY && n >= 0 && (size_t)n < len) {
+        snprintf(buf + n, len - (size_t)n, ", %.0f%% writes", cfg->write_ratio * 100.0);
+    }
+}
+
+int workload_recorder_open(workload_recorder_t *r, const char *path, int cores, uint64_t seg_bytes) {
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (r->fd < 0) return -1;
+    workload_trace_header_t h = { .version = WORKLOAD_TRACE_VERSION, .block_size = BLOCK_SIZE,
+                                  .cores = (uint32_t)cores, .seg_bytes = seg_bytes };
+    memcpy(h.magic, WORKLOAD_TRACE_MAGIC, sizeof(WORKLOAD_TRACE_MAGIC));
+    if (write(r->fd, &h, sizeof(h)) != (ssize_t)sizeof(h)) {
+        close(r->fd);
+        r->fd = -1;
+        return -1;
+    }
+    pthread_mutex_init(&r->lock, NULL);
+    r->start_ns = now_ns();
+    return 0;
+}
+
+void workload_recorder_close(workload_recorder_t *r) {
+    if (r->fd < 0) return;
+    fsync(r->fd);
+    close(r->fd);
+    r->fd = -1;
+    pthread_mutex_destroy(&r->lock);
+}
+
+static void recorder_flush(workload_gen_t *g) {
+    workload_recorder_t *r = g->recorder;
+    if (!r || g->buffered == 0) return;
+    size_t bytes = g->buffered * sizeof(workload_trace_rec_t);
+    pthread_mutex_lock(&r->lock);
+    ssize_t w = write(r->fd, g->buf, bytes);
+    if (w == (ssize_t)bytes) {
+        r->records += g->buffered;
+    } else {
+        r->write_errors++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    g->buffered = 0;
+}
+
+int workload_trace_open(workload_trace_t *t, const char *path) {
+    memset(t, 0, sizeof(*t));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(workload_trace_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    t->map_size = (size_t)st.st_size;
+    t->map = mmap(NULL, t->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (t->map == MAP_FAILED) {
+        t->map = NULL;
+        return -1;
+    }
+    memcpy(&t->header, t->map, sizeof(t->header));
+    if (memcmp(t->header.magic, WORKLOAD_TRACE_MAGIC, sizeof(WORKLOAD_TRACE_MAGIC)) != 0 ||
+        t->header.version != WORKLOAD_TRACE_VERSION || t->header.block_size != BLOCK_SIZE) {
+        workload_trace_close(t);
+        errno = EINVAL;
+        return -1;
+    }
+    // A torn last record (recorder killed mid-write) is dropped
+    t->recs = (const workload_trace_rec_t *)((const char *)t->map + sizeof(workload_trace_header_t));
+    t->count = (t->map_size - sizeof(workload_trace_header_t)) / sizeof(workload_trace_rec_t);
+    madvise(t->map, t->map_size, MADV_SEQUENTIAL);
+    workload_trace_start(t);
+    return 0;
+}
+
+void workload_trace_start(workload_trace_t *t) {
+    t->start_ns = now_ns();
+}
+
+void workload_trace_close(workload_trace_t *t) {
+    if (t->map) munmap(t->map, t->map_size);
+    t->map = NULL;
+    t->recs = NULL;
+    t->count = 0;
+}
+
+int workload_gen_init(workload_gen_t *g, const workload_config_t *cfg, int core, uint64_t blocks,
+                      const workload_trace_t *trace, workload_recorder_t *recorder) {
+    memset(g, 0, sizeof(*g));
+    g->cfg = *cfg;
+    g->core = core;
+    g->blocks = blocks ? blocks : 1;
+    g->rng = 0x2545F4914F6CDD1Dull ^ ((uint64_t)core << 32);
+    g->trace = trace;
+    g->recorder = recorder && recorder->fd >= 0 && core <= WORKLOAD_TRACE_MAX_CORE ? recorder : NULL;
+    if (cfg->kind == WORKLOAD_REPLAY && !trace) return -1;
+    if (cfg->kind == WORKLOAD_ZIPF) {
+        // Gray et al., "Quickly generating billion-record synthetic databases": one pass for zeta(n),
+        // then each sample is O(1)
+        double theta = cfg->theta;
+        for (uint64_t i = 1; i <= g->blocks; i++) g->zeta_n += 1.0 / pow((double)i, theta);
+        g->zeta2 = 1.0 + pow(0.5, theta);
+        g->alpha = 1.0 / (1.0 - theta);
+        g->eta = (1.0 - pow(2.0 / (double)g->blocks, 1.0 - theta)) / (1.0 - g->zeta2 / g->zeta_n);
+    }
+    return 0;
+}
+
+static uint64_t zipf_rank(workload_gen_t *g) {
+    double u = next_unit(&g->rng);
+    double uz = u * g->zeta_n;
+    if (uz < 1.0) return 0;
+    if (uz < g->zeta2) return 1;
+    uint64_t r = (uint64_t)((double)g->blocks * pow(g->eta * u - g->eta + 1.0, g->alpha));
+    return r < g->blocks ? r : g->blocks - 1;
+}
+
+// Sleep until the trace time of the record, scaled by speed, has come
+static void replay_pace(const workload_gen_t *g, uint64_t rec_ns) {
+    if (g->cfg.speed <= 0.0) return;
+    uint64_t due = g->trace->start_ns + (uint64_t)((double)rec_ns / g->cfg.speed);
+    uint64_t now = now_ns();
+    if (due <= now) return;
+    struct timespec ts = { .tv_sec = (time_t)((due - now) / 1000000000ull),
+                           .tv_nsec = (long)((due - now) % 1000000000ull) };
+    nanosleep(&ts, NULL);
+}
+
+int workload_next(workload_gen_t *g, uint64_t seg_base, uint64_t blocks, uint64_t *offset, workload_op_t *op) {
+    if (blocks == 0) blocks = 1;
+    if (g->cfg.kind == WORKLOAD_REPLAY) {
+        // Records are in per-core runs of the recorder's buffers: take the next one of this core
+        const workload_trace_t *t = g->trace;
+        while (g->cursor < t->count && (int)((t->recs[g->cursor].word >> 1) & WORKLOAD_TRACE_MAX_CORE) != g->core) {
+            g->cursor++;
+        }
+        if (g->cursor >= t->count) return -1;
+        const workload_trace_rec_t *rec = &t->recs[g->cursor++];
+        replay_pace(g, rec->ns);
+        *offset = rec->word & ~(uint64_t)(BLOCK_SIZE - 1);
+        *op = (workload_op_t)(rec->word & 1);
+    } else {
+        uint64_t idx;
+        switch (g->cfg.kind) {
+        case WORKLOAD_UNIFORM:
+            idx = next_u64(&g->rng) % blocks;
+            break;
+        case WORKLOAD_ZIPF:
+            idx = zipf_rank(g);
+            break;
+        case WORKLOAD_HOTSPOT: {
+            uint64_t hot = (uint64_t)((double)blocks * g->cfg.hot_fraction);
+            if (hot == 0) hot = 1;
+            uint64_t r = next_u64(&g->rng);
+            if (hot >= blocks) {
+                idx = r % blocks;
+            } else if (next_unit(&g->rng) < g->cfg.hot_prob) {
+                idx = r % hot;
+            } else {
+                idx = hot + r % (blocks - hot);
+            }
+            break;
+        }
+        default:
+            idx = g->pos++;
+            break;
+        }
+        *offset = seg_base + (idx % blocks) * BLOCK_SIZE;
+        *op = g->cfg.write_ratio >= 1.0 || next_unit(&g->rng) < g->cfg.write_ratio ? WORKLOAD_WRITE : WORKLOAD_READ;
+    }
+    if (g->recorder) {
+        workload_trace_rec_t *rec = &g->buf[g->buffered++];
+        rec->ns = now_ns() - g->recorder->start_ns;
+        rec->word = *offset | (uint64_t)g->core << 1 | (uint64_t)*op;
+        if (g->buffered == WORKLOAD_TRACE_BUF) recorder_flush(g);
+    }
+    return 0;
+}
+
+void workload_gen_destroy(workload_gen_t *g) {
+    recorder_flush(g);
+}
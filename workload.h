@@ -0,0 +1,132 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "config.h"
+
+// Генераторы обращений ядра и запись/воспроизведение трасс.
+// Шаблон задаётся строкой "вид[,ключ=значение...]":
+//   seq                           — круговой проход по сегменту ядра (как раньше)
+//   uniform                       — равномерно по сегменту
+//   zipf,theta=0.99               — Зипф, блок 0 сегмента самый горячий; 0 < theta < 1
+//   hotspot,hot=0.1,prob=0.9      — доля prob обращений в первых hot блоков сегмента
+//   replay,trace=путь,speed=1     — трасса с исходной скоростью, speed=2 — вдвое быстрее, 0 — без пауз
+// Для любого генератора write=0.3 задаёт долю записей (по умолчанию 1 — каждое обращение пишет блок)
+
+#ifndef WORKLOAD_ENV
+#define WORKLOAD_ENV "PSEUDO_CORE_WORKLOAD"     // перекрывает шаблон из конфигурации
+#endif
+#ifndef WORKLOAD_TRACE_ENV
+#define WORKLOAD_TRACE_ENV "PSEUDO_CORE_TRACE"  // путь, куда записывать трассу обращений
+#endif
+#ifndef WORKLOAD_TRACE_BUF
+#define WORKLOAD_TRACE_BUF 1024                 // записей трассы в буфере ядра до сброса в файл
+#endif
+#define WORKLOAD_PATH_MAX 256
+#define WORKLOAD_TRACE_MAGIC "PCTRACE"
+#define WORKLOAD_TRACE_VERSION 1
+
+typedef enum {
+    WORKLOAD_SEQ = 0,
+    WORKLOAD_UNIFORM,
+    WORKLOAD_ZIPF,
+    WORKLOAD_HOTSPOT,
+    WORKLOAD_REPLAY,
+    WORKLOAD_KINDS
+} workload_kind_t;
+
+typedef enum {
+    WORKLOAD_READ = 0,
+    WORKLOAD_WRITE = 1
+} workload_op_t;
+
+typedef struct {
+    workload_kind_t kind;
+    double theta;               // zipf
+    double hot_fraction;        // hotspot: доля блоков сегмента
+    double hot_prob;            //   и доля обращений к ним
+    double write_ratio;
+    double speed;               // replay: множитель скорости, 0 — без пауз
+    char trace[WORKLOAD_PATH_MAX];
+} workload_config_t;
+
+// Файл трассы: заголовок и записи по 16 байт. Смещения кратны BLOCK_SIZE,
+// поэтому младшие биты слова несут операцию (бит 0) и номер ядра (биты 1..11)
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t cores;
+    uint32_t reserved;
+    uint64_t seg_bytes;
+} workload_trace_header_t;
+
+typedef struct {
+    uint64_t ns;                // от начала записи трассы
+    uint64_t word;              // offset | core << 1 | op
+} workload_trace_rec_t;
+
+#define WORKLOAD_TRACE_MAX_CORE 2047
+
+// Запись трассы: ядра копят обращения в своих буферах и дописывают их под мьютексом
+typedef struct {
+    int fd;
+    uint64_t start_ns;
+    uint64_t records;
+    uint64_t write_errors;
+    pthread_mutex_t lock;
+} workload_recorder_t;
+
+// Трасса для воспроизведения, отображённая в память и общая для ядер
+typedef struct {
+    const workload_trace_rec_t *recs;
+    size_t count;
+    size_t map_size;
+    void *map;
+    workload_trace_header_t header;
+    uint64_t start_ns;          // момент, соответствующий нулю трассы, общий для ядер
+} workload_trace_t;
+
+// Генератор одного ядра; не разделяется между потоками
+typedef struct {
+    workload_config_t cfg;
+    int core;
+    uint64_t blocks;            // блоков в сегменте ядра
+    uint64_t pos;
+    uint64_t rng;
+    double zeta_n, zeta2, alpha, eta; // константы Зипфа для blocks (Gray et al.)
+    const workload_trace_t *trace;
+    size_t cursor;
+    workload_recorder_t *recorder;
+    workload_trace_rec_t buf[WORKLOAD_TRACE_BUF];
+    size_t buffered;
+} workload_gen_t;
+
+// Разбирает шаблон; 0 или -1 с сообщением в stderr
+int workload_parse(const char *spec, workload_config_t *cfg);
+const char *workload_kind_name(workload_kind_t kind);
+// Человекочитаемое описание шаблона для журнала запуска
+void workload_describe(const workload_config_t *cfg, char *buf, size_t len);
+
+int workload_recorder_open(workload_recorder_t *r, const char *path, int cores, uint64_t seg_bytes);
+void workload_recorder_close(workload_recorder_t *r);
+
+int workload_trace_open(workload_trace_t *t, const char *path);
+// Совмещает нулевой момент трассы с текущим; вызывать перед запуском ядер
+void workload_trace_start(workload_trace_t *t);
+void workload_trace_close(workload_trace_t *t);
+
+// trace — для replay (иначе NULL), recorder — если обращения надо записывать (иначе NULL)
+int workload_gen_init(workload_gen_t *g, const workload_config_t *cfg, int core, uint64_t blocks,
+                      const workload_trace_t *trace, workload_recorder_t *recorder);
+// Следующее обращение ядра к сегменту seg_base из blocks блоков (blocks не больше, чем при init;
+// меньше — когда ядро сократило сегмент под нагрузкой). Replay ждёт момента записи трассы
+// и отдаёт записанное смещение. 0 или -1, когда трасса этого ядра кончилась
+int workload_next(workload_gen_t *g, uint64_t seg_base, uint64_t blocks, uint64_t *offset, workload_op_t *op);
+// Сбрасывает буфер записи трассы
+void workload_gen_destroy(workload_gen_t *g);
+
+#endif // WORKLOAD_H